@@ -1,3 +1,11 @@
+#if defined(__linux__)
+/* glibc declares a struct file_handle in fcntl.h which clashes with ours */
+#define file_handle glibc_file_handle
+#include <fcntl.h>
+#undef file_handle
+#include <unistd.h>
+#endif
+
 #include "file_system.h"
 
 const FileSystem* FileSystem::i()
@@ -298,7 +306,36 @@ bool FileSystem::deleteFile(const path& path) const
 
 bool FileSystem::fallocate(const path& path, size_t size) const
 {
-  return false;
+  /* never truncates, existing contents are preserved and the file is created if missing */
+  std::error_code error;
+  size_t length = fs::file_size(fs::path(path.data()), error);
+  
+  if (!error && length >= size)
+    return true;
+  
+#if defined(__linux__)
+  FILE* file = fopen(path.c_str(), "ab");
+  
+  if (!file)
+    return false;
+  
+  bool success = posix_fallocate(fileno(file), 0, size) == 0;
+  fclose(file);
+  return success;
+#else
+  if (error)
+  {
+    FILE* file = fopen(path.c_str(), "ab");
+    
+    if (!file)
+      return false;
+    
+    fclose(file);
+  }
+  
+  fs::resize_file(fs::path(path.data()), size, error);
+  return !error;
+#endif
 }
 
 //#else
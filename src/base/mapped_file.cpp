@@ -0,0 +1,189 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <utility>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+/* fcntl.h is avoided on purpose, glibc declares its own struct file_handle */
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file() : _data(nullptr), _length(0)
+#if _WIN32
+, _file(nullptr), _mapping(nullptr)
+#endif
+{
+
+}
+
+mapped_file::mapped_file(mapped_file&& other) : mapped_file()
+{
+  *this = std::move(other);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other)
+{
+  if (this != &other)
+  {
+    unmap();
+    std::swap(_data, other._data);
+    std::swap(_length, other._length);
+#if _WIN32
+    std::swap(_file, other._file);
+    std::swap(_mapping, other._mapping);
+#endif
+  }
+
+  return *this;
+}
+
+#if _WIN32
+
+bool mapped_file::map(const path& path, map_mode mode)
+{
+  unmap();
+
+  DWORD access = mode == map_mode::SHARED ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+  HANDLE file = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  DWORD protect = mode == map_mode::SHARED ? PAGE_READWRITE : (mode == map_mode::PRIVATE ? PAGE_WRITECOPY : PAGE_READONLY);
+  DWORD view = mode == map_mode::SHARED ? FILE_MAP_WRITE : (mode == map_mode::PRIVATE ? FILE_MAP_COPY : FILE_MAP_READ);
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, protect, 0, 0, nullptr);
+  void* data = mapping ? MapViewOfFile(mapping, view, 0, 0, 0) : nullptr;
+
+  if (!data)
+  {
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  _file = file;
+  _mapping = mapping;
+  _data = static_cast<u8*>(data);
+  _length = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void mapped_file::unmap()
+{
+  if (_data)
+    UnmapViewOfFile(_data);
+  if (_mapping)
+    CloseHandle(static_cast<HANDLE>(_mapping));
+  if (_file)
+    CloseHandle(static_cast<HANDLE>(_file));
+
+  _data = nullptr;
+  _length = 0;
+  _mapping = nullptr;
+  _file = nullptr;
+}
+
+void mapped_file::advise(size_t offset, size_t length, map_advice advice) const
+{
+  /* no equivalent of madvise hints worth the trouble */
+}
+
+bool mapped_file::sync(bool async) const
+{
+  if (!_data)
+    return false;
+
+  bool success = FlushViewOfFile(_data, _length) != 0;
+  if (!async && success)
+    success = FlushFileBuffers(static_cast<HANDLE>(_file)) != 0;
+  return success;
+}
+
+#else
+
+bool mapped_file::map(const path& path, map_mode mode)
+{
+  unmap();
+
+  FILE* file = fopen(path.c_str(), mode == map_mode::SHARED ? "rb+" : "rb");
+  if (!file)
+    return false;
+
+  int fd = fileno(file);
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  int protection = mode == map_mode::READING ? PROT_READ : (PROT_READ | PROT_WRITE);
+  int flags = mode == map_mode::SHARED ? MAP_SHARED : MAP_PRIVATE;
+
+  void* data = mmap(nullptr, sb.st_size, protection, flags, fd, 0);
+  /* mapping keeps its own reference to the file */
+  fclose(file);
+
+  if (data == MAP_FAILED)
+    return false;
+
+  _data = static_cast<u8*>(data);
+  _length = static_cast<size_t>(sb.st_size);
+  return true;
+}
+
+void mapped_file::unmap()
+{
+  if (_data)
+    munmap(_data, _length);
+
+  _data = nullptr;
+  _length = 0;
+}
+
+void mapped_file::advise(size_t offset, size_t length, map_advice advice) const
+{
+  if (!_data || offset >= _length)
+    return;
+
+  /* madvise wants a page aligned start */
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t start = offset & ~(pageSize - 1);
+  length = std::min(length + (offset - start), _length - start);
+
+  int hint = MADV_NORMAL;
+  switch (advice)
+  {
+    case map_advice::NORMAL: hint = MADV_NORMAL; break;
+    case map_advice::SEQUENTIAL: hint = MADV_SEQUENTIAL; break;
+    case map_advice::RANDOM: hint = MADV_RANDOM; break;
+    case map_advice::WILLNEED: hint = MADV_WILLNEED; break;
+  }
+
+  madvise(_data + start, length, hint);
+}
+
+bool mapped_file::sync(bool async) const
+{
+  if (!_data)
+    return false;
+
+  return msync(_data, _length, async ? MS_ASYNC : MS_SYNC) == 0;
+}
+
+#endif
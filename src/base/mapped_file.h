@@ -0,0 +1,55 @@
+#pragma once
+
+#include "path.h"
+#include "common.h"
+
+enum class map_mode
+{
+  /* read only view, pages are shared with every other mapping of the same file */
+  READING,
+  /* copy on write view, changes never reach the file */
+  PRIVATE,
+  /* read/write view, changes are written back to the file */
+  SHARED,
+};
+
+enum class map_advice
+{
+  NORMAL,
+  SEQUENTIAL,
+  RANDOM,
+  WILLNEED,
+};
+
+class mapped_file
+{
+private:
+  u8* _data;
+  size_t _length;
+#if _WIN32
+  void* _file;
+  void* _mapping;
+#endif
+
+public:
+  mapped_file();
+  mapped_file(const mapped_file&) = delete;
+  mapped_file(mapped_file&& other);
+  ~mapped_file() { unmap(); }
+
+  mapped_file& operator=(const mapped_file&) = delete;
+  mapped_file& operator=(mapped_file&& other);
+
+  /* maps the whole file, fails for anything which is not a non empty regular file */
+  bool map(const path& path, map_mode mode);
+  void unmap();
+
+  void advise(size_t offset, size_t length, map_advice advice) const;
+  /* flushes dirty pages of a SHARED mapping, async only schedules the write */
+  bool sync(bool async) const;
+
+  u8* data() const { return _data; }
+  size_t length() const { return _length; }
+
+  operator bool() const { return _data != nullptr; }
+};
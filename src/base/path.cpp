@@ -91,10 +91,10 @@ std::string path::filenameWithoutExtension() const
 
 size_t path::length() const
 {
-  if (exists() && !isFolder())
-    return fs::file_size(_data);
-  else
-    return 0;
+  /* a single stat, fails for folders and missing files */
+  std::error_code error;
+  auto size = fs::file_size(_data, error);
+  return error ? 0 : size;
 }
 
 size_t path::writeAll(const void* data, size_t count, size_t size) const
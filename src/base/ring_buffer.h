@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+namespace structures
+{
+  /*
+    lock free ring for exactly one producer and one consumer thread (eg. emulation and SDL audio thread).
+    head is written only by the producer and tail only by the consumer, both grow indefinitely and are
+    masked on access. Each side caches the other index so that the shared cache line is touched only
+    when the cached view says the ring is full/empty.
+  */
+  template<typename T, size_t N>
+  struct RingBuffer
+  {
+    static_assert((N& (N - 1)) == 0, "N must be power of two");
+
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::array<T, N> buffer{};
+
+    /* producer side */
+    alignas(CACHE_LINE) std::atomic<size_t> head{ 0 };
+    size_t cachedTail = 0;
+
+    /* consumer side */
+    alignas(CACHE_LINE) std::atomic<size_t> tail{ 0 };
+    size_t cachedHead = 0;
+
+    static constexpr size_t mask() { return N - 1; }
+
+    /* copies count elements starting from ring index, wrapping around the end */
+    static void copyIn(std::array<T, N>& buffer, size_t index, const T* values, size_t count)
+    {
+      size_t first = std::min(count, N - index);
+      std::copy(values, values + first, buffer.begin() + index);
+      std::copy(values + first, values + count, buffer.begin());
+    }
+
+    static void copyOut(const std::array<T, N>& buffer, size_t index, T* out, size_t count)
+    {
+      size_t first = std::min(count, N - index);
+      std::copy(buffer.begin() + index, buffer.begin() + index + first, out);
+      std::copy(buffer.begin(), buffer.begin() + (count - first), out + first);
+    }
+
+  public:
+    /* these are exact only when called from one of the two sides with the other idle */
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() == N; }
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return N; }
+
+    /* producer: room available for push */
+    size_t space()
+    {
+      cachedTail = tail.load(std::memory_order_acquire);
+      return N - (head.load(std::memory_order_relaxed) - cachedTail);
+    }
+
+    /* consumer: elements available for pop */
+    size_t available()
+    {
+      cachedHead = head.load(std::memory_order_acquire);
+      return cachedHead - tail.load(std::memory_order_relaxed);
+    }
+
+    bool push(const T& value)
+    {
+      size_t h = head.load(std::memory_order_relaxed);
+
+      if (h - cachedTail == N && space() == 0)
+        return false;
+
+      buffer[h & mask()] = value;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /* pushes as many values as fit, returns how many */
+    size_t push(const T* values, size_t count)
+    {
+      size_t h = head.load(std::memory_order_relaxed);
+
+      if (N - (h - cachedTail) < count)
+        cachedTail = tail.load(std::memory_order_acquire);
+
+      count = std::min(count, N - (h - cachedTail));
+      copyIn(buffer, h & mask(), values, count);
+      head.store(h + count, std::memory_order_release);
+      return count;
+    }
+
+    bool pop(T& value)
+    {
+      size_t t = tail.load(std::memory_order_relaxed);
+
+      if (cachedHead == t && available() == 0)
+        return false;
+
+      value = std::move(buffer[t & mask()]);
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    /* pops up to count values, returns how many */
+    size_t pop(T* out, size_t count)
+    {
+      size_t t = tail.load(std::memory_order_relaxed);
+
+      if (cachedHead - t < count)
+        cachedHead = head.load(std::memory_order_acquire);
+
+      count = std::min(count, cachedHead - t);
+      copyOut(buffer, t & mask(), out, count);
+      tail.store(t + count, std::memory_order_release);
+      return count;
+    }
+
+    /* consumer: drops everything currently in the ring */
+    void clear()
+    {
+      cachedHead = head.load(std::memory_order_acquire);
+      tail.store(cachedHead, std::memory_order_release);
+    }
+  };
+}
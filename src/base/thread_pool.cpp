@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace
+{
+  /* pool and worker index running on this thread, if any */
+  thread_local const ThreadPool* currentPool = nullptr;
+  thread_local size_t currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(size_t threads) : _pending(0), _queued(0), _next(0), _steals(0), _running(true)
+{
+  if (threads == 0)
+    threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  for (size_t i = 0; i < threads; ++i)
+    _workers.push_back(std::make_unique<Worker>());
+
+  for (size_t i = 0; i < threads; ++i)
+    _threads.emplace_back([this, i]() { loop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  wait();
+
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _running = false;
+  }
+  _wake.notify_all();
+
+  for (auto& thread : _threads)
+    thread.join();
+}
+
+void ThreadPool::submit(task task)
+{
+  const size_t index = currentPool == this ? currentWorker : _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+
+  _pending.fetch_add(1, std::memory_order_relaxed);
+
+  {
+    std::lock_guard<std::mutex> guard(_workers[index]->lock);
+    _workers[index]->tasks.push_back(std::move(task));
+  }
+
+  /* counted under the lock, so a worker going to sleep either sees it or gets the notification */
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _queued.fetch_add(1, std::memory_order_relaxed);
+  }
+  _wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  _idle.wait(guard, [this]() { return _pending.load(std::memory_order_acquire) == 0; });
+}
+
+bool ThreadPool::pop(size_t index, task& task)
+{
+  Worker& worker = *_workers[index];
+  std::lock_guard<std::mutex> guard(worker.lock);
+
+  if (worker.tasks.empty())
+    return false;
+
+  task = std::move(worker.tasks.back());
+  worker.tasks.pop_back();
+  _queued.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ThreadPool::steal(size_t index, task& task)
+{
+  for (size_t i = 1; i < _workers.size(); ++i)
+  {
+    Worker& victim = *_workers[(index + i) % _workers.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+
+    if (!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      _queued.fetch_sub(1, std::memory_order_relaxed);
+      _steals.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::loop(size_t index)
+{
+  currentPool = this;
+  currentWorker = index;
+
+  task task;
+
+  for (;;)
+  {
+    if (pop(index, task) || steal(index, task))
+    {
+      task();
+      task = nullptr;
+
+      if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        std::lock_guard<std::mutex> guard(_lock);
+        _idle.notify_all();
+      }
+
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_running)
+      return;
+
+    _wake.wait(guard, [this]() { return !_running || _queued.load(std::memory_order_relaxed) > 0; });
+    if (!_running)
+      return;
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  fixed set of worker threads, each with its own task deque. A worker pushes and pops the tasks it
+  submits itself at the back of its deque (so a task re-submitting its continuation stays on the same
+  core while it's busy), idle workers steal from the front of the others. Tasks submitted from outside
+  the pool are spread round robin.
+*/
+class ThreadPool
+{
+public:
+  using task = std::function<void()>;
+
+private:
+  struct Worker
+  {
+    std::mutex lock;
+    std::deque<task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<std::thread> _threads;
+
+  /* idle workers sleep here until something is submitted */
+  std::mutex _lock;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+
+  /* submitted and not yet completed */
+  std::atomic<size_t> _pending;
+  /* sitting in some deque, can go transiently negative since it is decremented outside of _lock */
+  std::atomic<long> _queued;
+  std::atomic<size_t> _next;
+  std::atomic<size_t> _steals;
+  bool _running;
+
+  bool pop(size_t index, task& task);
+  bool steal(size_t index, task& task);
+  void loop(size_t index);
+
+public:
+  /* 0 means one worker per hardware thread */
+  ThreadPool(size_t threads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  void submit(task task);
+  /* blocks until every submitted task (including the ones submitted by tasks) has completed */
+  void wait();
+
+  size_t size() const { return _threads.size(); }
+  /* tasks taken from another worker's deque since start */
+  size_t steals() const { return _steals.load(std::memory_order_relaxed); }
+};
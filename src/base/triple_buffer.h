@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace structures
+{
+  /*
+    lock free triple buffer for one producer and one consumer thread (eg. emulation and UI thread).
+    The producer fills back() and publish()es it, the consumer acquire()s the most recent published
+    value into front(). Neither side ever waits: the producer always has a free buffer to write to,
+    frames published while the consumer isn't looking are simply replaced by newer ones.
+  */
+  template<typename T>
+  class TripleBuffer
+  {
+  private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    /* set in the shared slot when it holds something the consumer hasn't taken yet */
+    static constexpr uint8_t FRESH = 0x04;
+
+    std::array<T, 3> _buffers;
+
+    /* index of the buffer in the middle, owned by nobody */
+    std::atomic<uint8_t> _shared;
+    uint8_t _back;
+    uint8_t _front;
+
+  public:
+    template<typename... Args>
+    TripleBuffer(const Args&... args) : _buffers{ T(args...), T(args...), T(args...) }, _shared(1), _back(0), _front(2) { }
+
+    /* producer side */
+    T& back() { return _buffers[_back]; }
+
+    void publish()
+    {
+      uint8_t previous = _shared.exchange(_back | FRESH, std::memory_order_acq_rel);
+      _back = previous & INDEX_MASK;
+    }
+
+    /* consumer side, returns false if nothing newer than front() was published */
+    bool acquire()
+    {
+      if (!(_shared.load(std::memory_order_relaxed) & FRESH))
+        return false;
+
+      uint8_t previous = _shared.exchange(_front, std::memory_order_acq_rel);
+      _front = previous & INDEX_MASK;
+      return true;
+    }
+
+    const T& front() const { return _buffers[_front]; }
+  };
+}
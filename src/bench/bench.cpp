@@ -0,0 +1,49 @@
+#include "bench.h"
+
+#include <cstdio>
+
+namespace
+{
+  volatile u64 sink;
+}
+
+const std::vector<bench::Benchmark>& bench::benchmarks()
+{
+  static const std::vector<Benchmark> benchmarks = {
+    { "bus", "page table bus decoding against the linear mapping scan", bus },
+    { "mappers", "cartridge bank switching and no-op mapper writes through the mapper policies against the flag tests", mappers },
+    { "ring", "audio ring between the emulation and audio threads against the locked ring it replaced", ring },
+    { "generators", "block generate() of the wave generators against next() per sample", generators },
+    { "resampler", "polyphase resampling from the generator clock to the host rate against box averaging", resampler },
+    { "frames", "dirty row detection of FrameBuffer::seal against the row hashes", frames },
+    { "blocks", "CPU bound test ROM through the block cache against the interpreter", blocks },
+    { "ppu", "frames/sec of a scene using every PPU layer, with static and rewritten tiles", ppu },
+    { "filters", "per buffer cost of the biquads and filter chain against the one-pole low pass", filters },
+    { "romcache", "memory of 64 instances of a ROM through the shared image cache against private images", romcache },
+    { "blip", "band limited synthesis of host buffers through BlipBuffer against generate() and resampling", blip },
+  };
+
+  return benchmarks;
+}
+
+bool bench::run(const std::string& name)
+{
+  bool found = false;
+
+  for (const Benchmark& benchmark : benchmarks())
+  {
+    if (name != "all" && name != benchmark.name)
+      continue;
+
+    printf("%s: %s\n", benchmark.name, benchmark.description);
+    benchmark.run();
+    found = true;
+  }
+
+  return found;
+}
+
+void bench::keep(u64 value)
+{
+  sink = sink + value;
+}
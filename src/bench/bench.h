@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+  microbenchmarks behind headless --bench. Each one times a component against the implementation
+  it replaced, which is kept in its benchmark as a reference, or against its own slow path when
+  there is nothing to compare with, and prints one line per case.
+*/
+namespace bench
+{
+  struct Benchmark
+  {
+    const char* name;
+    const char* description;
+    void (*run)();
+  };
+
+  const std::vector<Benchmark>& benchmarks();
+  /* runs the benchmark called name, or every benchmark for "all", false if there is none */
+  bool run(const std::string& name);
+
+  /* stores value somewhere the optimizer can't see through, so computing it can't be dropped */
+  void keep(u64 value);
+
+  /* calls body until at least minimum milliseconds went by, returns the nanoseconds per call */
+  template<typename F> double measure(F&& body, double minimum = 250.0)
+  {
+    using clock_type = std::chrono::steady_clock;
+
+    /* warm up caches, lazily built tables and branch predictors */
+    body();
+
+    u64 calls = 0, batch = 1;
+    const auto start = clock_type::now();
+    clock_type::duration elapsed;
+
+    do
+    {
+      for (u64 i = 0; i < batch; ++i)
+        body();
+      calls += batch;
+      batch *= 2;
+      elapsed = clock_type::now() - start;
+    } while (std::chrono::duration<double, std::milli>(elapsed).count() < minimum);
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+  }
+
+  void bus();
+  void mappers();
+  void ring();
+  void generators();
+  void resampler();
+  void frames();
+  void blocks();
+  void ppu();
+  void filters();
+  void romcache();
+  void blip();
+}
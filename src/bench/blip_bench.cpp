@@ -0,0 +1,59 @@
+#include "bench.h"
+
+#include "sounds/blip_buffer.h"
+#include "sounds/generators.h"
+#include "sounds/resampler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace sounds;
+
+namespace
+{
+  /* one SDL callback worth of output */
+  constexpr size_t OUTPUT = 512;
+
+  /*
+    a host buffer produced the way machines did before BlipBuffer: every generator clock rendered by
+    generate() and filtered down by the Resampler, against synthesize() reporting just the edges
+  */
+  template<typename G> void compare(const char* name, G& generator, float rate)
+  {
+    Resampler resampler(1.0_mhz, rate);
+    BlipBuffer blip(1.0_mhz, rate);
+
+    std::vector<float> input(size_t(OUTPUT * 1.0_mhz / rate) + resampler.taps() + 64);
+    std::vector<float> out(OUTPUT);
+
+    const double before = bench::measure([&] {
+      const size_t needed = std::min(resampler.required(OUTPUT), input.size());
+      generator.generate(input.data(), needed);
+      resampler.write(input.data(), needed);
+      bench::keep(resampler.read(out.data(), OUTPUT));
+    });
+
+    const double after = bench::measure([&] {
+      const u32 clocks = blip.clocksNeeded(OUTPUT);
+      generator.synthesize(blip, clocks);
+      blip.endFrame(clocks);
+      bench::keep(blip.read(out.data(), OUTPUT));
+    });
+
+    printf("  %-6s 1MHz -> %.1fkHz %7.2f -> %7.2f ns/output (%.2fx)\n", name, rate / 1000.0f,
+      before / OUTPUT, after / OUTPUT, before / after);
+  }
+}
+
+/* 440Hz waves at a 1MHz generator clock, one host buffer at a time */
+void bench::blip()
+{
+  for (float rate : { 44.1_khz, 48.0_khz })
+  {
+    SquareWaveGenerator square(440.0_hz, 1.0_mhz);
+    compare("square", square, rate);
+
+    SimpleWaveGenerator saw(Waveform::Sawtooth, 440.0_hz, 1.0_mhz);
+    compare("saw", saw, rate);
+  }
+}
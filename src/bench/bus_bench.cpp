@@ -0,0 +1,103 @@
+#include "bench.h"
+
+#include "devices/component.h"
+
+#include <cstdio>
+#include <random>
+
+using namespace devices;
+
+namespace
+{
+  /* the bus before the page table: every access scans the mappings in order */
+  struct LinearBus : public Bus
+  {
+    u8 scanRead(addr_t address) const
+    {
+      const BusMapping* mapping = find(address);
+      return mapping ? mapping->device->read(address - mapping->base) : 0xFF;
+    }
+
+    void scanWrite(addr_t address, u8 value)
+    {
+      const BusMapping* mapping = find(address);
+      if (mapping)
+        mapping->device->write(address - mapping->base, value);
+    }
+  };
+
+  /* a register block, goes through read/write on both buses */
+  struct Registers : public Memory
+  {
+    u8 regs[0x100] = { };
+
+    u8 read(addr_t address) const override { return regs[address & 0xFF]; }
+    void write(addr_t address, u8 value) override { regs[address & 0xFF] = value; }
+  };
+
+  /* per access cost over 64K addresses, reads then writes, printed as millions of accesses per second */
+  void measure(const char* label, LinearBus& bus, const std::vector<addr_t>& addresses)
+  {
+    const double scanRead = bench::measure([&] {
+      u64 sum = 0;
+      for (addr_t address : addresses)
+        sum += bus.scanRead(address);
+      bench::keep(sum);
+    }) / addresses.size();
+
+    const double tableRead = bench::measure([&] {
+      u64 sum = 0;
+      for (addr_t address : addresses)
+        sum += bus.read(address);
+      bench::keep(sum);
+    }) / addresses.size();
+
+    const double scanWrite = bench::measure([&] {
+      for (addr_t address : addresses)
+        bus.scanWrite(address, u8(address));
+    }) / addresses.size();
+
+    const double tableWrite = bench::measure([&] {
+      for (addr_t address : addresses)
+        bus.write(address, u8(address));
+    }) / addresses.size();
+
+    printf("  %-12s read %7.1f -> %7.1f M/s (%.2fx), write %7.1f -> %7.1f M/s (%.2fx)\n", label,
+      1e3 / scanRead, 1e3 / tableRead, scanRead / tableRead, 1e3 / scanWrite, 1e3 / tableWrite, scanWrite / tableWrite);
+  }
+}
+
+/* the Game Boy layout: ROM, VRAM, cartridge RAM (mapped with an offset), WRAM, a register block */
+void bench::bus()
+{
+  Rom rom(32_kb);
+  Ram vram(8_kb), sram(8_kb), wram(8_kb);
+  Registers io;
+
+  LinearBus bus;
+  bus.map(&rom, 0x0000, 0x7FFF);
+  bus.map(&vram, 0x8000, 0x9FFF);
+  bus.map(&sram, 0xA000, 0xBFFF, 0xA000);
+  bus.map(&wram, 0xC000, 0xDFFF);
+  bus.map(&io, 0xFF00, 0xFFFF);
+
+  std::vector<addr_t> sequential(0x10000), random(0x10000), mapped;
+  std::mt19937 rng(1);
+
+  for (size_t i = 0; i < sequential.size(); ++i)
+  {
+    sequential[i] = addr_t(i);
+    random[i] = addr_t(rng());
+  }
+
+  /* what a CPU mostly touches: code and data in ROM and WRAM, now and then a register */
+  for (size_t i = 0; i < 0x10000; ++i)
+  {
+    const u32 kind = rng() % 16;
+    mapped.push_back(kind < 10 ? addr_t(rng() % 0x8000) : kind < 15 ? addr_t(0xC000 + rng() % 0x2000) : addr_t(0xFF00 + rng() % 0x100));
+  }
+
+  measure("sequential", bus, sequential);
+  measure("random", bus, random);
+  measure("rom/wram/io", bus, mapped);
+}
@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "roms.h"
+
+#include "platform/gameboy/gameboy.h"
+
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+  /* emulated MHz of a test ROM over frames, 0 if it can't be loaded */
+  double emulatedMHz(const path& fileName, u64 frames, bool blockCache)
+  {
+    gb::GameBoy machine;
+    if (!machine.load(fileName))
+      return 0.0;
+
+    machine.cpu().setBlockCache(blockCache);
+    gfx::FrameBuffer frame(gb::SCREEN_WIDTH, gb::SCREEN_HEIGHT);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (u64 i = 0; i < frames; ++i)
+      machine.runFrame(frame);
+    const double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    return elapsed > 0.0 ? machine.scheduler().now() / elapsed : 0.0;
+  }
+}
+
+/* the CPU bound test ROM through the block cache against the plain interpreter */
+void bench::blocks()
+{
+  constexpr u64 FRAMES = 1200;
+
+  const path fileName = std::filesystem::temp_directory_path() / "emumachina_bench_blocks.gb";
+  if (!writeRom(*findRom("bench"), fileName))
+  {
+    printf("  unable to write %s\n", fileName.c_str());
+    return;
+  }
+
+  const double before = emulatedMHz(fileName, FRAMES, false);
+  const double after = emulatedMHz(fileName, FRAMES, true);
+  printf("  bench.gb %8.1f -> %8.1f emulated MHz (%.2fx), %llu frames\n", before, after, before > 0.0 ? after / before : 0.0, (unsigned long long)FRAMES);
+}
@@ -0,0 +1,76 @@
+#include "bench.h"
+
+#include "sounds/filters.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace sounds::filters;
+
+namespace
+{
+  /* LowPassFilter as it was before the biquads: a one-pole IIR called once per sample, alpha set by hand */
+  class LegacyLowPass
+  {
+  protected:
+    float _alpha;
+    float _previous;
+
+  public:
+    LegacyLowPass(float cutoff, float sampleRate) : _previous(0.0f)
+    {
+      float dt = 1.0f / sampleRate;
+      float rc = 1.0f / (2.0f * float(M_PI) * cutoff);
+      _alpha = dt / (rc + dt);
+    }
+
+    float process(float input)
+    {
+      _previous += _alpha * (input - _previous);
+      return _previous;
+    }
+  };
+}
+
+/* cost of one host audio buffer through each filter, mono and interleaved stereo */
+void bench::filters()
+{
+  constexpr float RATE = 44100.0f;
+
+  for (size_t n : { size_t(512), size_t(1024) })
+  {
+    std::vector<float> mono(n), stereo(2 * n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      mono[i] = std::sin(i * 0.1f);
+      stereo[2 * i] = mono[i];
+      stereo[2 * i + 1] = -mono[i];
+    }
+
+    LegacyLowPass left(5000.0f, RATE), right(5000.0f, RATE);
+    const double onePole = measure([&] { for (size_t i = 0; i < n; ++i) mono[i] = left.process(mono[i]); keep(u64(mono[0] + 2.0f)); });
+    const double onePoleStereo = measure([&] {
+      for (size_t i = 0; i < n; ++i)
+      {
+        stereo[2 * i] = left.process(stereo[2 * i]);
+        stereo[2 * i + 1] = right.process(stereo[2 * i + 1]);
+      }
+      keep(u64(stereo[0] + 2.0f));
+    });
+
+    Biquad lowPass(Response::LowPass, 5000.0f, RATE);
+    const double biquad = measure([&] { lowPass.process(mono.data(), n); keep(u64(mono[0] + 2.0f)); });
+    const double biquadStereo = measure([&] { lowPass.processStereo(stereo.data(), n); keep(u64(stereo[0] + 2.0f)); });
+
+    /* output capacitor, speaker low pass and a rumble filter */
+    FilterChain chain;
+    chain.add(Response::DcBlock, 28.0f, RATE);
+    chain.add(Response::LowPass, 8000.0f, RATE);
+    chain.add(Response::HighPass, 40.0f, RATE);
+    const double chained = measure([&] { chain.process(mono.data(), n); keep(u64(mono[0] + 2.0f)); });
+    const double chainedStereo = measure([&] { chain.processStereo(stereo.data(), n); keep(u64(stereo[0] + 2.0f)); });
+
+    printf("  %4zu samples  one-pole %6.0f ns, stereo %6.0f ns | biquad %6.0f ns, stereo %6.0f ns | 3 stages %6.0f ns, stereo %6.0f ns\n",
+      n, onePole, onePoleStereo, biquad, biquadStereo, chained, chainedStereo);
+  }
+}
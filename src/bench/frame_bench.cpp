@@ -0,0 +1,63 @@
+#include "bench.h"
+
+#include "gfx/frame_buffer.h"
+
+#include <cstdio>
+
+using namespace gfx;
+
+namespace
+{
+  /* FrameBuffer::seal as it was: a serial FNV-1a hash of every row compared with the hash of the previous frame */
+  void legacySeal(const FrameBuffer& frame, std::vector<uint8_t>& dirtyRows, std::vector<uint64_t>& rowHashes)
+  {
+    const bool fresh = rowHashes.size() != size_t(frame.height());
+    if (fresh)
+      rowHashes.assign(frame.height(), 0);
+
+    for (int y = 0; y < frame.height(); ++y)
+    {
+      const Pixel* pixels = frame.row(y);
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      for (int x = 0; x < frame.width(); ++x)
+      {
+        hash ^= pixels[x].value;
+        hash *= 0x100000001b3ULL;
+      }
+
+      dirtyRows[y] = fresh || hash != rowHashes[y];
+      rowHashes[y] = hash;
+    }
+  }
+}
+
+/* a Game Boy frame where no row, one row or every row changes between two seals */
+void bench::frames()
+{
+  const struct { const char* name; int changed; } cases[] = {
+    { "static", 0 },
+    { "one row", 1 },
+    { "all rows", 144 },
+  };
+
+  for (const auto& test : cases)
+  {
+    FrameBuffer frame(160, 144);
+    std::vector<uint8_t> dirtyRows(frame.height());
+    std::vector<uint64_t> rowHashes;
+    std::vector<Pixel> previous;
+    u64 sequence = 0;
+    u8 shade = 0;
+
+    auto change = [&] {
+      ++shade;
+      for (int y = 0; y < test.changed; ++y)
+        frame.set((y * 7) % frame.width(), y, Pixel(shade, shade, shade));
+    };
+
+    const double before = measure([&] { change(); legacySeal(frame, dirtyRows, rowHashes); keep(dirtyRows[0]); });
+    const double after = measure([&] { change(); frame.seal(++sequence, previous); keep(frame.dirty(0)); });
+
+    printf("  %-8s %8.0f -> %8.0f ns/frame (%.2fx)\n", test.name, before, after, before / after);
+  }
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+
+#include "sounds/generators.h"
+
+#include <cstdio>
+
+using namespace sounds;
+
+namespace
+{
+  /* a 60Hz frame worth of 1MHz samples */
+  constexpr size_t BLOCK = 16384;
+
+  template<typename G> void compare(const char* name, G& generator)
+  {
+    std::vector<float> out(BLOCK);
+
+    const double before = bench::measure([&] {
+      for (size_t i = 0; i < BLOCK; ++i)
+        out[i] = generator.next();
+      bench::keep(u64(out[BLOCK - 1] + 2.0f));
+    });
+
+    const double after = bench::measure([&] {
+      generator.generate(out.data(), BLOCK);
+      bench::keep(u64(out[BLOCK - 1] + 2.0f));
+    });
+
+    printf("  %-14s %8.1f -> %8.1f Msamples/s (%.2fx)\n", name, BLOCK * 1e3 / before, BLOCK * 1e3 / after, before / after);
+  }
+}
+
+/* next() per sample is what the generators had before generate(), it is still there so it is the reference */
+void bench::generators()
+{
+  const struct { const char* name; Waveform waveform; } waveforms[] = {
+    { "simple square", Waveform::Square },
+    { "simple tri", Waveform::Triangle },
+    { "simple saw", Waveform::Sawtooth },
+    { "simple sine", Waveform::Sine },
+  };
+
+  for (const auto& waveform : waveforms)
+  {
+    SimpleWaveGenerator generator(waveform.waveform, 440.0_hz, 1.0_mhz);
+    compare(waveform.name, generator);
+  }
+
+  SquareWaveGenerator square(440.0_hz, 1.0_mhz);
+  square.setDuty(0.25f);
+  compare("square", square);
+
+  TriangleWaveGenerator triangle(440.0_hz);
+  compare("triangle", triangle);
+
+  NoiseGenerator noise(1.0_mhz);
+  compare("noise", noise);
+}
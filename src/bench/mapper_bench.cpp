@@ -0,0 +1,359 @@
+#include "bench.h"
+
+#include "platform/gameboy/cartridge.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+using namespace gb;
+
+namespace
+{
+  /*
+    Cartridge::write as it was before the mapper policies: one function testing status.flags for the
+    controller on every store, then comparing bank pointers to find out what to remap
+  */
+  class LegacyCartridge : public devices::Memory
+  {
+  private:
+    std::vector<u8> _rom, _ram;
+    GB_CART_STATUS status;
+    RTC rtc;
+
+  public:
+    LegacyCartridge(u32 flags, u32 romSize, u32 ramSize) : _rom(romSize), _ram(ramSize)
+    {
+      status.rom = _rom.data();
+      status.rom_bank_0 = status.rom;
+      status.rom_bank_1 = &status.rom[16_kb];
+      status.ram = _ram.data();
+      status.ram_bank = status.ram;
+      status.rtc = nullptr;
+      status.rtc_override = false;
+      status.ram_enabled = false;
+      status.rom_banking_mode = false;
+      status.flags = flags;
+      status.current_rom_bank = 1;
+      status.current_ram_bank = 0;
+    }
+
+    u8 read(u16 address) const override
+    {
+      if (address <= 0x3FFF)
+        return status.rom_bank_0[address];
+      else if (address <= 0x7FFF)
+        return status.rom_bank_1[address - 0x4000];
+      else if (address >= 0xA000 && address <= 0xBFFF)
+        return status.rtc_override ? rtc.read() : status.ram_bank[address - 0xA000];
+      return 0;
+    }
+
+    u8* page(u16 address, bool write) override
+    {
+      if (address <= 0x3FFF)
+        return write ? nullptr : &status.rom_bank_0[address];
+      else if (address <= 0x7FFF)
+        return write ? nullptr : &status.rom_bank_1[address - 0x4000];
+      else if (address >= 0xA000 && address <= 0xBFFF)
+      {
+        u32 offset = address - 0xA000;
+        if (status.ram_enabled && !status.rtc_override && (status.ram_bank - status.ram) + offset + devices::Bus::PAGE_SIZE <= _ram.size())
+          return &status.ram_bank[offset];
+      }
+      return nullptr;
+    }
+
+    void write(u16 address, u8 value) override
+    {
+      const u8* romBank = status.rom_bank_1;
+      const u8* ramBank = status.ram_bank;
+      const bool ramMapped = status.ram_enabled && !status.rtc_override;
+
+      if ((status.flags & MBC_MBC1) == MBC_MBC1)
+      {
+        if (address <= 0x1FFF)
+          status.ram_enabled = (value & 0x0A) == 0x0A;
+        else if (address <= 0x3FFF)
+        {
+          u8 romBank = value & 0x1F;
+          if (romBank == 0)
+            ++romBank;
+          if (status.rom_banking_mode)
+            status.current_rom_bank = (status.current_rom_bank & 0x60) | romBank;
+          else
+            status.current_rom_bank = romBank;
+          status.rom_bank_1 = &status.rom[16_kb*status.current_rom_bank];
+        }
+        else if (address <= 0x5FFF)
+        {
+          if (status.rom_banking_mode)
+          {
+            status.current_rom_bank = (status.current_rom_bank & 0x1F) | (value & 0x60);
+            status.rom_bank_1 = &status.rom[16_kb*status.current_rom_bank];
+          }
+          else
+          {
+            status.current_ram_bank = value & 0x03;
+            status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
+          }
+        }
+        else if (address <= 0x7FFF)
+        {
+          status.rom_banking_mode = value & 0x01;
+          if (status.rom_banking_mode)
+          {
+            status.ram_bank = status.ram;
+            status.current_ram_bank = 0;
+          }
+        }
+        else if (address >= 0xA000 && address <= 0xBFFF)
+        {
+          if (status.ram_enabled)
+            status.ram_bank[address - 0xA000] = value;
+        }
+      }
+      else if ((status.flags & MBC_MBC2) == MBC_MBC2)
+      {
+        if (address <= 0x1FFF)
+          status.ram_enabled = (value & 0x0A) == 0x0A;
+        else if (address <= 0x3FFF)
+        {
+          status.current_rom_bank = value & 0x0F;
+          status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
+        }
+        else if (address >= 0xA000 && address <= 0xA1FF)
+        {
+          if (status.ram_enabled)
+            status.ram_bank[address - 0xA000] = value;
+        }
+      }
+      else if ((status.flags & MBC_MBC3) == MBC_MBC3)
+      {
+        if (address <= 0x1FFF)
+          status.ram_enabled = (value & 0x0A) == 0x0A;
+        else if (address <= 0x3FFF)
+        {
+          u8 romBank = value & 0x7F;
+          if (romBank == 0) romBank = 1;
+          status.current_rom_bank = romBank;
+          status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
+        }
+        else if (address >= 0x4000 && address <= 0x5FFF)
+        {
+          if (value < 0x04)
+          {
+            status.current_ram_bank = value & 0x0F;
+            status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
+            status.rtc_override = false;
+          }
+          else if (value >= 0x08 && value <= 0x0C)
+          {
+            rtc.select(value);
+            status.rtc_override = true;
+          }
+        }
+        else if (address >= 0x6000 && address <= 0x7FFF)
+          rtc.writeLatch(value);
+        else if (address >= 0xA000 && address <= 0xBFFF)
+        {
+          if (status.ram_enabled)
+          {
+            if (status.rtc_override)
+              rtc.writeData(value);
+            else
+              status.ram_bank[address - 0xA000] = value;
+          }
+        }
+      }
+      else if ((status.flags & MBC_MBC5) == MBC_MBC5)
+      {
+        if (address <= 0x1FFF)
+          status.ram_enabled = (value & 0x0A) == 0x0A;
+        else if (address <= 0x2FFF)
+        {
+          status.current_rom_bank = (status.current_rom_bank & 0xFF00) | value;
+          status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
+        }
+        else if (address <= 0x3FFF)
+        {
+          status.current_rom_bank = (status.current_rom_bank & 0xFF) | ((((u16)value) & 0x01) << 8);
+          status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
+        }
+        else if (address >= 0x4000 && address <= 0x5FFF)
+        {
+          status.current_ram_bank = value & 0x0F;
+          status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
+        }
+        else if (address >= 0xA000 && address <= 0xBFFF)
+        {
+          if (status.ram_enabled)
+            status.ram_bank[address - 0xA000] = value;
+        }
+      }
+
+      if (romBank != status.rom_bank_1)
+        invalidate(0x4000, 0x7FFF);
+      if (ramBank != status.ram_bank || ramMapped != (status.ram_enabled && !status.rtc_override))
+        invalidate(0xA000, 0xBFFF);
+    }
+  };
+
+  struct Mapper
+  {
+    const char* name;
+    u32 flags;
+    u8 cartType;
+    /* header codes */
+    u8 romSize, ramSize;
+    u32 romBanks, ramBanks;
+  };
+
+  struct Write
+  {
+    u16 address;
+    u8 value;
+  };
+
+  /*
+    what a game streaming data out of banked ROM into banked RAM does: select a ROM bank, read it, select
+    a RAM bank and store a handful of bytes there. Every value selects a bank that exists.
+  */
+  std::vector<Write> trace(const Mapper& mapper, size_t length)
+  {
+    std::vector<Write> writes;
+    std::mt19937 rng(3);
+
+    writes.push_back({ 0x0000, 0x0A });
+
+    while (writes.size() < length)
+    {
+      const u32 romBank = 1 + rng() % (mapper.romBanks - 1);
+
+      if (mapper.flags & MBC_MBC5)
+      {
+        writes.push_back({ 0x2000, u8(romBank) });
+        writes.push_back({ 0x3000, u8(romBank >> 8) });
+      }
+      else
+        writes.push_back({ 0x2000, u8(romBank) });
+
+      if (mapper.ramBanks > 1)
+        writes.push_back({ 0x4000, u8(rng() % mapper.ramBanks) });
+
+      /* MBC2 only has 512 half bytes */
+      const u16 window = (mapper.flags & MBC_MBC2) ? 0x200 : 0x2000;
+      for (size_t i = 0; i < 6; ++i)
+        writes.push_back({ u16(0xA000 + rng() % window), u8(rng()) });
+
+      /* now and then the game closes RAM, as it should after saving */
+      if (rng() % 16 == 0)
+      {
+        writes.push_back({ 0x0000, 0x00 });
+        writes.push_back({ 0x0000, 0x0A });
+      }
+    }
+
+    return writes;
+  }
+
+  /*
+    mapper writes which change nothing, so no page is remapped and only the dispatch down to the controller
+    is timed: a game selecting again the bank it's already in, enabling RAM which is enabled and, on MBC3,
+    latching the clock and writing RTC registers. Stores to RAM are left out, they skip the cartridge
+    through the page table.
+  */
+  std::vector<Write> dispatchTrace(const Mapper& mapper, size_t length)
+  {
+    std::vector<Write> writes;
+    std::mt19937 rng(5);
+
+    const u32 romBank = 1 + rng() % (mapper.romBanks - 1);
+
+    /* puts the cartridge in the state the rest of the trace keeps selecting */
+    writes.push_back({ 0x0000, 0x0A });
+    writes.push_back({ 0x2000, u8(romBank) });
+    if (mapper.flags & MBC_MBC5)
+      writes.push_back({ 0x3000, u8(romBank >> 8) });
+    if (mapper.flags & MBC_MBC3)
+      writes.push_back({ 0x4000, 0x08 });
+
+    while (writes.size() < length)
+    {
+      writes.push_back({ 0x2000, u8(romBank) });
+      if (mapper.flags & MBC_MBC5)
+        writes.push_back({ 0x3000, u8(romBank >> 8) });
+
+      writes.push_back({ 0x0000, 0x0A });
+
+      if (mapper.flags & MBC_MBC3)
+      {
+        writes.push_back({ 0x6000, 0x00 });
+        writes.push_back({ 0x6000, 0x01 });
+        writes.push_back({ 0xA000, u8(rng() % 60) });
+      }
+    }
+
+    return writes;
+  }
+
+  std::filesystem::path writeRom(const Mapper& mapper)
+  {
+    std::vector<u8> rom(mapper.romBanks * 16_kb, 0);
+    rom[0x147] = mapper.cartType;
+    rom[0x148] = mapper.romSize;
+    rom[0x149] = mapper.ramSize;
+
+    const std::filesystem::path fileName = std::filesystem::temp_directory_path() / (std::string("emumachina_bench_") + mapper.name + ".gb");
+    path(fileName).writeAll(rom.data(), rom.size(), 1);
+    return fileName;
+  }
+
+  double run(devices::Bus& bus, const std::vector<Write>& writes)
+  {
+    return bench::measure([&] {
+      for (const Write& write : writes)
+        bus.write(write.address, write.value);
+      bench::keep(bus.read(0x4000));
+    }) / writes.size();
+  }
+}
+
+/*
+  bank switch heavy write trace through the bus, for every controller, then a trace of writes which
+  remap nothing to tell the cost of reaching the controller apart from the cost of invalidating pages
+*/
+void bench::mappers()
+{
+  const Mapper mappers[] = {
+    { "mbc1", MBC_MBC1 | MBC_RAM, 0x03, 0x04, 0x03, 32, 4 },
+    { "mbc2", MBC_MBC2 | MBC_RAM, 0x06, 0x03, 0x00, 16, 1 },
+    { "mbc3", MBC_MBC3 | MBC_RAM, 0x13, 0x05, 0x03, 64, 4 },
+    { "mbc5", MBC_MBC5 | MBC_RAM, 0x1B, 0x07, 0x03, 256, 4 },
+  };
+
+  for (const Mapper& mapper : mappers)
+  {
+    const std::vector<Write> writes = trace(mapper, 4096), dispatch = dispatchTrace(mapper, 4096);
+    const std::filesystem::path fileName = writeRom(mapper);
+
+    LegacyCartridge legacy(mapper.flags, mapper.romBanks * 16_kb, (mapper.flags & MBC_MBC2) ? 512 : mapper.ramBanks * 8_kb);
+    devices::Bus legacyBus;
+    legacyBus.map(&legacy, 0x0000, 0x7FFF);
+    legacyBus.map(&legacy, 0xA000, 0xBFFF, 0xA000);
+
+    Cartridge cartridge { path(fileName) };
+    devices::Bus bus;
+    cartridge.map(bus);
+
+    double before = run(legacyBus, writes), after = run(bus, writes);
+    printf("  %-5s remap    %6.2f -> %6.2f ns/write (%.2fx), %zu writes\n", mapper.name, before, after, before / after, writes.size());
+
+    before = run(legacyBus, dispatch);
+    after = run(bus, dispatch);
+    printf("  %-5s dispatch %6.2f -> %6.2f ns/write (%.2fx), %zu writes\n", mapper.name, before, after, before / after, dispatch.size());
+
+    std::error_code error;
+    std::filesystem::remove(fileName, error);
+  }
+}
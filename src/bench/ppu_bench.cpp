@@ -0,0 +1,71 @@
+#include "bench.h"
+
+#include "devices/machine.h"
+#include "platform/gameboy/interrupts.h"
+#include "platform/gameboy/ppu.h"
+
+#include <cstdio>
+
+namespace
+{
+  /* just the PPU on a scheduler, nothing else draws time from the frame */
+  struct Display : public devices::Machine
+  {
+    gb::Interrupts interrupts;
+    gb::PPU ppu { _scheduler, interrupts };
+  };
+
+  /* every tile and both maps filled, 40 sprites, window over the lower right part */
+  void fill(Display& display)
+  {
+    devices::Memory* vram = display.ppu.vram();
+    devices::Memory* oam = display.ppu.oam();
+
+    for (u16 i = 0; i < 0x1800; ++i)
+      vram->write(i, u8(i * 7));
+    for (u16 i = 0; i < 0x800; ++i)
+      vram->write(0x1800 + i, u8(i * 13));
+
+    for (u16 i = 0; i < 40; ++i)
+    {
+      oam->write(i * 4, u8(16 + i * 3));
+      oam->write(i * 4 + 1, u8(8 + i * 4));
+      oam->write(i * 4 + 2, u8(i));
+      oam->write(i * 4 + 3, (i & 1) ? 0xA0 : 0x10);
+    }
+
+    display.ppu.write(gb::PPU::LCDC, 0xF7);
+    display.ppu.write(gb::PPU::WY, 60);
+    display.ppu.write(gb::PPU::WX, 87);
+  }
+}
+
+/* frames/sec of a scene using every PPU layer, with the tile data left alone or rewritten every frame */
+void bench::ppu()
+{
+  const struct { const char* name; bool rewrite; } cases[] = {
+    { "static tiles", false },
+    { "all tiles rewritten", true },
+  };
+
+  for (const auto& test : cases)
+  {
+    Display display;
+    fill(display);
+    u8 frame = 0;
+
+    const double nanos = measure([&] {
+      if (test.rewrite)
+      {
+        /* 6KB of tile data, every decoded row of the cache goes stale */
+        for (u16 i = 0; i < 0x1800; ++i)
+          display.ppu.vram()->write(i, u8(i + frame));
+      }
+
+      display.ppu.write(gb::PPU::SCX, frame++);
+      display.runFor(gb::CYCLES_PER_FRAME);
+    });
+
+    printf("  %-20s %8.0f frames/s (%.1f us/frame)\n", test.name, 1e9 / nanos, nanos / 1000.0);
+  }
+}
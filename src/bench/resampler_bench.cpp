@@ -0,0 +1,128 @@
+#include "bench.h"
+
+#include "sounds/generators.h"
+#include "sounds/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace sounds;
+
+namespace
+{
+  /*
+    the downsampler the audio callback had before the resampler: averages a variable number of input
+    samples per output sample with a float cursor, then smooths with a one-pole low pass at 4kHz
+  */
+  class LegacyDownsampler
+  {
+  protected:
+    float _ratio;
+    float _alpha;
+    float _previous;
+
+  public:
+    LegacyDownsampler(float inputRate, float outputRate) : _ratio(inputRate / outputRate), _previous(0.0f)
+    {
+      float dt = 1.0f / outputRate;
+      float rc = 1.0f / (2.0f * float(M_PI) * 4.0_khz);
+      _alpha = dt / (rc + dt);
+    }
+
+    size_t required(size_t count) const { return size_t(count * _ratio) + 1; }
+
+    void process(const float* in, float* out, size_t count)
+    {
+      float cursor = 0.0f;
+      for (size_t i = 0; i < count; ++i)
+      {
+        float acc = 0.0f;
+        int samples = 0;
+
+        while (cursor < 1.0f)
+        {
+          acc += *in++;
+          samples++;
+          cursor += 1.0f / _ratio;
+        }
+
+        cursor -= 1.0f;
+        _previous += _alpha * (acc / float(samples) - _previous);
+        out[i] = _previous;
+      }
+    }
+  };
+
+  double decibels(const std::vector<float>& samples)
+  {
+    double power = 0.0;
+    for (float sample : samples)
+      power += double(sample) * sample;
+
+    /* relative to a full scale sine */
+    return 10.0 * std::log10(std::max(power / samples.size(), 1e-20) / 0.5);
+  }
+
+  /* level of what a sine at 3/4 of the output rate, which should be gone entirely, folds back to */
+  void aliasing(float rate, double& before, double& after)
+  {
+    constexpr size_t OUTPUT = 8192;
+
+    LegacyDownsampler legacy(1.0_mhz, rate);
+    Resampler resampler(1.0_mhz, rate);
+
+    SimpleWaveGenerator generator(Waveform::Sine, 0.75f * rate, 1.0_mhz);
+    std::vector<float> input(legacy.required(OUTPUT) + resampler.required(OUTPUT));
+    generator.generate(input.data(), input.size());
+
+    std::vector<float> out(OUTPUT);
+    legacy.process(input.data(), out.data(), OUTPUT);
+    /* past the filter settling */
+    out.erase(out.begin(), out.begin() + OUTPUT / 4);
+    before = decibels(out);
+
+    out.resize(OUTPUT);
+    resampler.write(input.data(), resampler.required(OUTPUT));
+    out.resize(resampler.read(out.data(), OUTPUT));
+    out.erase(out.begin(), out.begin() + OUTPUT / 4);
+    after = decibels(out);
+  }
+}
+
+/* one SDL callback worth of output at a time, from a square wave at the generator clock */
+void bench::resampler()
+{
+  constexpr size_t OUTPUT = 512;
+
+  for (float rate : { 44.1_khz, 48.0_khz })
+  {
+    LegacyDownsampler legacy(1.0_mhz, rate);
+    Resampler resampler(1.0_mhz, rate);
+
+    std::vector<float> input(legacy.required(OUTPUT) + resampler.taps() + 64);
+    SimpleWaveGenerator generator(Waveform::Square, 440.0_hz, 1.0_mhz);
+    generator.generate(input.data(), input.size());
+
+    std::vector<float> out(OUTPUT);
+
+    const double before = measure([&] {
+      legacy.process(input.data(), out.data(), OUTPUT);
+      keep(u64(out[OUTPUT - 1] + 2.0f));
+    });
+
+    const double after = measure([&] {
+      const size_t needed = std::min(resampler.required(OUTPUT), input.size());
+      resampler.write(input.data(), needed);
+      keep(resampler.read(out.data(), OUTPUT));
+    });
+
+    const double inputs = double(legacy.required(OUTPUT));
+    printf("  1MHz -> %.1fkHz %7.2f -> %7.2f ns/output (%.2fx), %.0f -> %.0f Minput/s, %zu taps\n", rate / 1000.0f,
+      before / OUTPUT, after / OUTPUT, before / after, inputs * 1e3 / before, inputs * 1e3 / after, resampler.taps());
+
+    double aliasBefore, aliasAfter;
+    aliasing(rate, aliasBefore, aliasAfter);
+    printf("  %-16s %7.1f -> %7.1f dB aliasing of a %.1fkHz sine\n", "", aliasBefore, aliasAfter, 0.75f * rate / 1000.0f);
+  }
+}
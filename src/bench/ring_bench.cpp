@@ -0,0 +1,247 @@
+#include "bench.h"
+
+#include "base/ring_buffer.h"
+
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace
+{
+  /*
+    the audio ring as it was before the SPSC one: plain head/tail masked on every step, one slot
+    lost to tell full from empty, callers must check size() first and lock around it across threads
+  */
+  template<typename T, size_t N>
+  struct LegacyRingBuffer
+  {
+  private:
+    std::array<T, N> buffer{};
+    size_t head = 0;
+    size_t tail = 0;
+
+    size_t mask() const { return N - 1; }
+
+  public:
+    bool empty() const { return head == tail; }
+    bool full() const { return ((head + 1) & mask()) == tail; }
+    size_t size() const { return (head - tail) & mask(); }
+    size_t capacity() const { return N - 1; }
+
+    void push(const T& value)
+    {
+      assert(!full());
+      buffer[head] = value;
+      head = (head + 1) & mask();
+    }
+
+    void push(const T* values, size_t count)
+    {
+      assert(count <= capacity() - size());
+
+      size_t space_to_end = N - head;
+      if (count <= space_to_end)
+        std::copy(values, values + count, buffer.begin() + head);
+      else
+      {
+        std::copy(values, values + space_to_end, buffer.begin() + head);
+        std::copy(values + space_to_end, values + count, buffer.begin());
+      }
+      head = (head + count) & mask();
+    }
+
+    T pop()
+    {
+      assert(!empty());
+      T value = std::move(buffer[tail]);
+      tail = (tail + 1) & mask();
+      return value;
+    }
+
+    void pop(T* out, size_t count)
+    {
+      assert(count <= size());
+
+      size_t space_to_end = N - tail;
+      if (count <= space_to_end)
+        std::copy(buffer.begin() + tail, buffer.begin() + tail + count, out);
+      else
+      {
+        std::copy(buffer.begin() + tail, buffer.end(), out);
+        std::copy(buffer.begin(), buffer.begin() + (count - space_to_end), out + space_to_end);
+      }
+      tail = (tail + count) & mask();
+    }
+  };
+
+  /* the audio ring of the runner and the sizes the emulation thread and SDL callback move at once */
+  constexpr size_t CAPACITY = 8192;
+  constexpr size_t PRODUCED = 735;
+  constexpr size_t CONSUMED = 512;
+  constexpr u64 TRANSFER = 1 << 24;
+
+  using Legacy = LegacyRingBuffer<float, CAPACITY>;
+  using Ring = structures::RingBuffer<float, CAPACITY>;
+
+  /* samples moved per second between two threads, the legacy ring under a mutex; both sides yield when they can't move anything */
+  double legacyThreads()
+  {
+    Legacy ring;
+    std::mutex mutex;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&] {
+      std::vector<float> block(PRODUCED, 1.0f);
+      for (u64 sent = 0; sent < TRANSFER; )
+      {
+        size_t count;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          count = std::min<u64>({ PRODUCED, ring.capacity() - ring.size(), TRANSFER - sent });
+          ring.push(block.data(), count);
+        }
+        sent += count;
+        if (!count)
+          std::this_thread::yield();
+      }
+    });
+
+    std::vector<float> out(CONSUMED);
+    u64 sum = 0;
+    for (u64 received = 0; received < TRANSFER; )
+    {
+      size_t count;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        count = std::min(CONSUMED, ring.size());
+        ring.pop(out.data(), count);
+      }
+      received += count;
+      sum += count ? u64(out[0]) : 0;
+      if (!count)
+        std::this_thread::yield();
+    }
+
+    producer.join();
+    bench::keep(sum);
+
+    return TRANSFER / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  double ringThreads()
+  {
+    Ring ring;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&] {
+      std::vector<float> block(PRODUCED, 1.0f);
+      for (u64 sent = 0; sent < TRANSFER; )
+      {
+        const size_t count = ring.push(block.data(), std::min<u64>(PRODUCED, TRANSFER - sent));
+        sent += count;
+        if (!count)
+          std::this_thread::yield();
+      }
+    });
+
+    std::vector<float> out(CONSUMED);
+    u64 sum = 0;
+    for (u64 received = 0; received < TRANSFER; )
+    {
+      const size_t count = ring.pop(out.data(), CONSUMED);
+      received += count;
+      sum += count ? u64(out[0]) : 0;
+      if (!count)
+        std::this_thread::yield();
+    }
+
+    producer.join();
+    bench::keep(sum);
+
+    return TRANSFER / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  /* a sequence pushed and popped in random sized pieces, single and bulk, must come out in order and whole */
+  bool stress()
+  {
+    structures::RingBuffer<u32, 256> ring;
+    constexpr u32 total = 1 << 22;
+
+    std::thread producer([&] {
+      std::mt19937 random(1);
+      std::vector<u32> block(300);
+      for (u32 next = 0; next < total; )
+      {
+        size_t count;
+        if (random() & 1)
+          count = ring.push(next) ? 1 : 0;
+        else
+        {
+          count = std::min<size_t>(random() % block.size(), total - next);
+          for (size_t i = 0; i < count; ++i)
+            block[i] = next + u32(i);
+          count = ring.push(block.data(), count);
+        }
+        next += u32(count);
+        if (!count)
+          std::this_thread::yield();
+      }
+    });
+
+    std::mt19937 random(2);
+    std::vector<u32> block(300);
+    bool ok = true;
+    for (u32 expected = 0; expected < total; )
+    {
+      size_t count;
+      if (random() & 1)
+      {
+        u32 value;
+        count = ring.pop(value) ? 1 : 0;
+        if (count)
+          ok &= value == expected++;
+      }
+      else
+      {
+        count = ring.pop(block.data(), random() % block.size());
+        for (size_t i = 0; i < count; ++i)
+          ok &= block[i] == expected++;
+      }
+      if (!count)
+        std::this_thread::yield();
+    }
+
+    producer.join();
+    return ok && ring.empty();
+  }
+}
+
+void bench::ring()
+{
+  /* one thread filling and draining, which is all the old ring could do without a lock */
+  {
+    Legacy legacy;
+    Ring ring;
+    std::vector<float> in(PRODUCED, 1.0f), out(PRODUCED);
+
+    const double before = measure([&] { legacy.push(in.data(), PRODUCED); legacy.pop(out.data(), PRODUCED); keep(u64(out[0])); });
+    const double after = measure([&] { ring.push(in.data(), PRODUCED); ring.pop(out.data(), PRODUCED); keep(u64(out[0])); });
+    printf("  bulk   %6.3f -> %6.3f ns/sample (%.2fx), blocks of %zu\n", before / PRODUCED, after / PRODUCED, before / after, PRODUCED);
+
+    const double singleBefore = measure([&] { for (size_t i = 0; i < PRODUCED; ++i) legacy.push(in[i]); for (size_t i = 0; i < PRODUCED; ++i) out[i] = legacy.pop(); keep(u64(out[0])); });
+    const double singleAfter = measure([&] { for (size_t i = 0; i < PRODUCED; ++i) ring.push(in[i]); for (size_t i = 0; i < PRODUCED; ++i) ring.pop(out[i]); keep(u64(out[0])); });
+    printf("  single %6.3f -> %6.3f ns/sample (%.2fx)\n", singleBefore / PRODUCED, singleAfter / PRODUCED, singleBefore / singleAfter);
+  }
+
+  /* producer and consumer threads, the way the runner and the SDL callback share it */
+  const double before = legacyThreads();
+  const double after = ringThreads();
+  printf("  threads %.1f -> %.1f Msamples/s (%.2fx), %llu samples, %zu in / %zu out\n", before / 1e6, after / 1e6, after / before, (unsigned long long)TRANSFER, PRODUCED, CONSUMED);
+
+  printf("  stress %s\n", stress() ? "ok" : "FAILED");
+}
@@ -0,0 +1,127 @@
+#include "bench.h"
+
+#include "platform/gameboy/cartridge.h"
+#include "platform/gameboy/rom_cache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace gb;
+
+namespace
+{
+  constexpr size_t INSTANCES = 64;
+  constexpr double MB = 1024.0 * 1024.0;
+  /* MBC1, 1MB */
+  constexpr u32 BANKS = 64;
+
+  /* pages of the process actually in memory, 0 where we can't tell */
+  size_t residentBytes()
+  {
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(__linux__)
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+      return 0;
+
+    unsigned long size = 0, resident = 0;
+    const bool read = fscanf(statm, "%lu %lu", &size, &resident) == 2;
+    fclose(statm);
+    return read ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+  }
+
+  std::filesystem::path writeRom()
+  {
+    std::vector<u8> rom(BANKS * 16_kb);
+    std::mt19937 rng(5);
+    for (u8& byte : rom)
+      byte = u8(rng());
+
+    rom[0x147] = 0x01;
+    rom[0x148] = 0x05;
+    rom[0x149] = 0x00;
+
+    const std::filesystem::path fileName = std::filesystem::temp_directory_path() / "emumachina_bench_romcache.gb";
+    path(fileName).writeAll(rom.data(), rom.size(), 1);
+    return fileName;
+  }
+
+  void report(const char* name, size_t before, size_t after)
+  {
+    if (before && after)
+      printf("  %-8s RSS %7.1f -> %7.1f MB (+%.1f MB)\n", name, before / MB, after / MB, (after - before) / MB);
+    else
+      printf("  %-8s RSS unavailable on this platform\n", name);
+  }
+}
+
+/*
+  64 instances of a 1MB ROM which each read every bank, as the running games would, loaded as
+  cartridges through the shared cache and as private images
+*/
+void bench::romcache()
+{
+  const std::filesystem::path fileName = writeRom();
+  u64 sum = 0;
+
+  {
+    const size_t before = residentBytes();
+
+    std::vector<std::unique_ptr<Cartridge>> cartridges;
+    for (size_t i = 0; i < INSTANCES; ++i)
+    {
+      cartridges.push_back(std::make_unique<Cartridge>(path(fileName)));
+
+      for (u32 bank = 1; bank < BANKS; ++bank)
+      {
+        cartridges.back()->write(0x2000, u8(bank));
+        const u8* memory = cartridges.back()->page(0x4000, false);
+        for (size_t offset = 0; offset < 16_kb; offset += 64)
+          sum += memory[offset];
+      }
+    }
+
+    const size_t after = residentBytes();
+    const RomCache::Stats stats = RomCache::i().stats();
+
+    printf("  shared   %zu images, %zu references, %.1f MB held for %.1f MB requested\n", stats.images, stats.references,
+      stats.held / MB, stats.requested / MB);
+    report("shared", before, after);
+  }
+
+  {
+    const size_t before = residentBytes();
+
+    std::vector<std::unique_ptr<RomImage>> images;
+    for (size_t i = 0; i < INSTANCES; ++i)
+    {
+      images.push_back(RomImage::load(path(fileName), map_mode::PRIVATE));
+      if (!images.back())
+        return;
+
+      for (size_t offset = 0; offset < images.back()->length(); offset += 64)
+        sum += images.back()->data()[offset];
+    }
+
+    const size_t after = residentBytes();
+    printf("  private  %zu images, %.1f MB held\n", images.size(), images.size() * images.front()->length() / MB);
+    report("private", before, after);
+  }
+
+  keep(sum);
+}
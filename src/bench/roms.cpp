@@ -0,0 +1,284 @@
+#include "roms.h"
+
+#include <initializer_list>
+
+namespace
+{
+  /* 32KB ROM only cartridge, the entry point jumps to 0x150 */
+  class Assembler
+  {
+  private:
+    std::vector<u8> _rom;
+    u16 _address;
+
+  public:
+    Assembler() : _rom(32_kb, 0x00), _address(0x150)
+    {
+      at(0x100).emit({ 0xC3, 0x50, 0x01 });
+      at(0x150);
+    }
+
+    Assembler& at(u16 address) { _address = address; return *this; }
+    u16 here() const { return _address; }
+
+    Assembler& emit(std::initializer_list<u8> bytes)
+    {
+      for (u8 byte : bytes)
+        _rom[_address++] = byte;
+      return *this;
+    }
+
+    Assembler& call(u16 address) { return emit({ 0xCD, u8(address), u8(address >> 8) }); }
+
+    /* LD A,value; LD (address),A */
+    Assembler& store(u16 address, u8 value) { return emit({ 0x3E, value, 0xEA, u8(address), u8(address >> 8) }); }
+
+    /* JR back to target, which must be within reach */
+    Assembler& jr(u8 opcode, u16 target) { return emit({ opcode, u8(target - (_address + 2)) }); }
+
+    std::vector<u8> rom() const { return _rom; }
+  };
+
+  /* SEND is a routine sending A through the serial port */
+  constexpr u16 SEND = 0x0200;
+
+  void serialRoutine(Assembler& a)
+  {
+    /* LD (SB),A; LD A,$81; LD (SC),A; RET */
+    a.at(SEND).emit({ 0xEA, 0x01, 0xFF, 0x3E, 0x81, 0xEA, 0x02, 0xFF, 0xC9 });
+  }
+
+  /*
+    results of the flag corner cases, one byte each: DAA after an add, F after a SUB with half
+    borrow, F after LD HL,SP+e, RLA of the carry, SWAP, DAA wrapping to zero. Then the timer
+    interrupt wakes a HALT, its handler sends 'T' once and disables it, the main program sends 'D'
+  */
+  std::vector<u8> cpuRom()
+  {
+    Assembler a;
+    serialRoutine(a);
+
+    /* timer handler: send 'T', IE = 0, RETI */
+    a.at(0x50).emit({ 0x3E, 'T' }).call(SEND).emit({ 0xAF, 0xE0, 0xFF, 0xD9 });
+
+    a.at(0x150).emit({ 0x31, 0xFE, 0xFF });
+    a.emit({ 0x3E, 0x15, 0xC6, 0x27, 0x27 }).call(SEND);
+    a.emit({ 0x3E, 0x10, 0xD6, 0x01, 0xF5, 0xC1, 0x79 }).call(SEND);
+    a.emit({ 0xF8, 0x02, 0xF5, 0xC1, 0x79 }).call(SEND);
+    a.emit({ 0x37, 0x3E, 0x80, 0x17 }).call(SEND);
+    a.emit({ 0x3E, 0x01, 0xCB, 0x37 }).call(SEND);
+    a.emit({ 0x3E, 0x99, 0xC6, 0x01, 0x27, 0xF5, 0xC1, 0x79 }).call(SEND);
+
+    /* TIMA = $F0, TMA = 5, TAC = 4096Hz on, IE = timer, EI; HALT; NOP */
+    a.emit({ 0x3E, 0xF0, 0xE0, 0x05, 0x3E, 0x05, 0xE0, 0x07, 0x3E, 0x04, 0xE0, 0xFF, 0xFB, 0x76, 0x00 });
+    a.emit({ 0x3E, 'D' }).call(SEND);
+    a.jr(0x18, a.here());
+
+    return a.rom();
+  }
+
+  /*
+    CPU bound loop for throughput runs: sums, shifts and complements 256 bytes of WRAM in place and
+    calls a subroutine, forever. It never halts or polls, so every cycle is executed
+  */
+  std::vector<u8> benchRom()
+  {
+    Assembler a;
+
+    /* subroutine: PUSH BC; INC C; POP BC; RET */
+    a.at(0x200).emit({ 0xC5, 0x0C, 0xC1, 0xC9 });
+
+    const u16 start = 0x150;
+    /* LD HL,$C000; LD B,0; LD A,B */
+    a.at(start).emit({ 0x21, 0x00, 0xC0, 0x06, 0x00, 0x78 });
+    const u16 loop = a.here();
+    /* ADD (HL); LD (HL),A; INC HL; SLA A; CPL; XOR C; DEC B */
+    a.emit({ 0x86, 0x77, 0x23, 0xCB, 0x27, 0x2F, 0xA9, 0x05 });
+    a.jr(0x20, loop);
+    a.call(0x200);
+    a.emit({ 0xC3, u8(start), u8(start >> 8) });
+
+    return a.rom();
+  }
+
+  /*
+    code copied to WRAM and patched while cached: a routine returning '1' whose immediate is rewritten
+    to '2', a routine which rewrites its own immediate further down the running block (returns '4'
+    both times) and a patch through echo RAM (E001 mirrors C001) to '5'. Expected "12445"
+  */
+  std::vector<u8> smcRom()
+  {
+    Assembler a;
+    serialRoutine(a);
+
+    auto run = [&](u16 address) { a.call(address).call(SEND); };
+
+    a.at(0x150).emit({ 0x31, 0xFE, 0xFF });
+
+    /* C000: LD A,'1'; RET */
+    a.store(0xC000, 0x3E).store(0xC001, '1').store(0xC002, 0xC9);
+    run(0xC000);
+    a.store(0xC001, '2');
+    run(0xC000);
+
+    /* C010: LD A,'4'; LD (C016),A; LD A,'3'; RET, C016 is the immediate of the second load */
+    const u8 patcher[] = { 0x3E, '4', 0xEA, 0x16, 0xC0, 0x3E, '3', 0xC9 };
+    for (u16 i = 0; i < sizeof(patcher); ++i)
+      a.store(0xC010 + i, patcher[i]);
+    run(0xC010);
+    run(0xC010);
+
+    a.store(0xE001, '5');
+    run(0xC000);
+
+    a.jr(0x18, a.here());
+
+    return a.rom();
+  }
+
+  /*
+    polling loops the CPU fast forwards: wait for LY = 144 and send 'V', wait for LY to move on, wait
+    for DIV = $80 and send LY, forever
+  */
+  std::vector<u8> pollRom()
+  {
+    Assembler a;
+    serialRoutine(a);
+
+    a.at(0x150).emit({ 0x31, 0xFE, 0xFF });
+    const u16 start = a.here();
+
+    u16 loop = a.here();
+    a.emit({ 0xF0, 0x44, 0xFE, 0x90 }).jr(0x20, loop);
+    a.emit({ 0x3E, 'V' }).call(SEND);
+
+    loop = a.here();
+    a.emit({ 0xF0, 0x44, 0xFE, 0x90 }).jr(0x28, loop);
+
+    loop = a.here();
+    a.emit({ 0xF0, 0x04, 0xFE, 0x80 }).jr(0x20, loop);
+    a.emit({ 0xF0, 0x44 }).call(SEND);
+
+    a.emit({ 0xC3, u8(start), u8(start >> 8) });
+
+    return a.rom();
+  }
+
+  /*
+    polling loops which read LY through a register they load inside the loop and restore before
+    jumping back, so the address they read is not the one the register holds when the loop starts:
+    LD HL,$FF44; LD A,(HL); CP 144; LD HL,$C000; JR NZ, and the same through DE and C. LY is sent
+    after each of them: 144 (or 145 after waiting for it to change), twice
+  */
+  std::vector<u8> reloadRom()
+  {
+    Assembler a;
+    serialRoutine(a);
+
+    a.at(0x150).emit({ 0x31, 0xFE, 0xFF });
+
+    for (int i = 0; i < 2; ++i)
+    {
+      u16 loop = a.here();
+      a.emit({ 0x21, 0x44, 0xFF, 0x7E, 0xFE, 0x90, 0x21, 0x00, 0xC0 }).jr(0x20, loop);
+      a.emit({ 0xF0, 0x44 }).call(SEND);
+
+      loop = a.here();
+      a.emit({ 0x11, 0x44, 0xFF, 0x1A, 0xFE, 0x90, 0x11, 0x00, 0xC0 }).jr(0x28, loop);
+      a.emit({ 0xF0, 0x44 }).call(SEND);
+
+      loop = a.here();
+      a.emit({ 0x0E, 0x44, 0xF2, 0xFE, 0x90, 0x0E, 0x00 }).jr(0x20, loop);
+      a.emit({ 0xF0, 0x44 }).call(SEND);
+    }
+
+    a.jr(0x18, a.here());
+
+    return a.rom();
+  }
+
+  /*
+    a background of three tiles (checker, solid, outline) over the whole 9800 map scrolled by one
+    pixel every VBLANK, a window of solid tiles from line 100, two overlapping sprites with
+    different palettes. Only its frame is checked
+  */
+  std::vector<u8> ppuRom()
+  {
+    Assembler a;
+
+    /* VBLANK handler: LDH A,(SCX); INC A; LDH (SCX),A; RETI */
+    a.at(0x40).emit({ 0xF0, 0x43, 0x3C, 0xE0, 0x43, 0xD9 });
+
+    a.at(0x150).emit({ 0x31, 0xFE, 0xFF });
+
+    for (u16 row = 0; row < 8; ++row)
+      a.store(0x8010 + 2 * row, row % 2 ? 0xAA : 0x55).store(0x8011 + 2 * row, 0x0F);
+    for (u16 i = 0; i < 16; ++i)
+      a.store(0x8020 + i, 0xFF);
+    for (u16 row = 0; row < 8; ++row)
+      a.store(0x8030 + 2 * row, row == 0 || row == 7 ? 0xFF : 0x81).store(0x8031 + 2 * row, 0x00);
+
+    /* 9800-9BFF = L & 3: LD HL,$9800; LD A,L; AND 3; LD (HL+),A; LD A,H; CP $9C; JR NZ */
+    a.emit({ 0x21, 0x00, 0x98 });
+    u16 loop = a.here();
+    a.emit({ 0x7D, 0xE6, 0x03, 0x22, 0x7C, 0xFE, 0x9C }).jr(0x20, loop);
+
+    a.store(0xFE00, 96).store(0xFE01, 88).store(0xFE02, 3).store(0xFE03, 0x00);
+    a.store(0xFE04, 100).store(0xFE05, 92).store(0xFE06, 2).store(0xFE07, 0x10);
+    a.store(0xFF48, 0xE4).store(0xFF49, 0x1B).store(0xFF47, 0xE4);
+
+    /* 9C00-9FFF = 2 for the window */
+    a.emit({ 0x21, 0x00, 0x9C });
+    loop = a.here();
+    a.emit({ 0x3E, 0x02, 0x22, 0x7C, 0xFE, 0xA0 }).jr(0x20, loop);
+    a.store(0xFF4A, 100).store(0xFF4B, 107);
+
+    /* LCD on, window map 9C00 on, tiles at 8000, sprites on, background on, IE = VBLANK, EI */
+    a.store(0xFF40, 0xF3).store(0xFFFF, 0x01).emit({ 0xFB });
+
+    /* HALT; NOP; JR */
+    loop = a.here();
+    a.emit({ 0x76, 0x00 }).jr(0x18, loop);
+
+    return a.rom();
+  }
+}
+
+const std::vector<bench::TestRom>& bench::testRoms()
+{
+  static const std::vector<TestRom> roms = {
+    { "cpu", "flag corner cases and a timer interrupt out of HALT", cpuRom, 60, "B`0\x01\x10\x90TD", 0 },
+    { "bench", "CPU bound loop without halts or polling, for headless throughput runs", benchRom, 60, nullptr, 0 },
+    { "smc", "code in WRAM rewritten while cached, by itself and through echo RAM", smcRom, 10, "12445", 0 },
+    { "poll", "LY and DIV polling loops the CPU fast forwards", pollRom, 6, "V=V3V)V\x1e" "V\x14V", 0 },
+    { "reload", "polling loops reading through registers they reload before jumping back", reloadRom, 8, "\x90\x91\x90\x90\x91\x90", 0 },
+    { "ppu", "scrolling background, window and sprites drawn from VBLANK interrupts", ppuRom, 100, nullptr, 0xb2e1c5eb348d1125ULL },
+  };
+
+  return roms;
+}
+
+const bench::TestRom* bench::findRom(const std::string& name)
+{
+  for (const TestRom& rom : testRoms())
+    if (name == rom.name)
+      return &rom;
+  return nullptr;
+}
+
+bool bench::writeRom(const TestRom& rom, const path& fileName)
+{
+  const std::vector<u8> data = rom.build();
+  return fileName.writeAll(data.data(), data.size(), 1) == data.size();
+}
+
+u64 bench::frameHash(const u32* pixels, size_t count)
+{
+  u64 hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < count; ++i)
+  {
+    hash ^= pixels[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+#include "base/path.h"
+
+#include <string>
+#include <vector>
+
+/*
+  small Game Boy programs assembled in place, the headless checks run them and compare what they
+  send through the serial port or what they draw. headless --roms <dir> writes them out to run them by hand, eg.
+  "headless cpu.gb --frames 60 --serial".
+*/
+namespace bench
+{
+  struct TestRom
+  {
+    const char* name;
+    const char* description;
+    std::vector<u8> (*build)();
+    /* frames the check runs it for */
+    u64 frames;
+    /* bytes expected on the serial port after those frames, nullptr if it only sends ad hoc output */
+    const char* serial;
+    /* frameHash() of the last of those frames, 0 if it doesn't matter */
+    u64 frame;
+  };
+
+  const std::vector<TestRom>& testRoms();
+  const TestRom* findRom(const std::string& name);
+
+  bool writeRom(const TestRom& rom, const path& fileName);
+
+  /* FNV-1a over the pixels */
+  u64 frameHash(const u32* pixels, size_t count);
+}
@@ -0,0 +1,44 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace devices;
+
+void Batch::add(std::unique_ptr<Machine> machine, int width, int height)
+{
+  _instances.push_back(std::make_unique<Instance>(std::move(machine), width, height));
+}
+
+void Batch::step(ThreadPool& pool, Instance& instance, uint32_t quantum)
+{
+  using clock = std::chrono::steady_clock;
+
+  const uint64_t count = std::min<uint64_t>(quantum, instance.remaining);
+  const auto start = clock::now();
+
+  for (uint64_t i = 0; i < count; ++i)
+    instance.machine->runFrame(instance.frame);
+
+  instance.stats.hostNanos += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+  instance.stats.frames += count;
+  instance.remaining -= count;
+
+  /* continuation goes to the back of this worker's deque, others may steal it meanwhile */
+  if (instance.remaining)
+    pool.submit([&pool, &instance, quantum]() { step(pool, instance, quantum); });
+}
+
+void Batch::run(ThreadPool& pool, uint64_t frames, uint32_t quantum)
+{
+  quantum = std::max<uint32_t>(quantum, 1);
+
+  for (auto& instance : _instances)
+  {
+    instance->remaining = frames;
+    Instance* raw = instance.get();
+    pool.submit([&pool, raw, quantum]() { step(pool, *raw, quantum); });
+  }
+
+  pool.wait();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "machine.h"
+#include "base/thread_pool.h"
+#include "gfx/frame_buffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace devices
+{
+  /*
+    many independent machines run on a ThreadPool. Each task runs a quantum of frames on one
+    instance and then resubmits itself, so instances interleave on every core and idle workers
+    steal whatever is left; an instance is only ever touched by one task at a time.
+  */
+  class Batch
+  {
+  public:
+    struct Stats
+    {
+      uint64_t frames = 0;
+      /* host time spent inside runFrame */
+      uint64_t hostNanos = 0;
+
+      double fps() const { return hostNanos ? frames * 1e9 / hostNanos : 0.0; }
+      double nanosPerFrame() const { return frames ? double(hostNanos) / frames : 0.0; }
+    };
+
+  protected:
+    struct Instance
+    {
+      std::unique_ptr<Machine> machine;
+      gfx::FrameBuffer frame;
+      Stats stats;
+      uint64_t remaining;
+
+      Instance(std::unique_ptr<Machine> machine, int width, int height) : machine(std::move(machine)), frame(width, height), remaining(0) { }
+    };
+
+    std::vector<std::unique_ptr<Instance>> _instances;
+
+    static void step(ThreadPool& pool, Instance& instance, uint32_t quantum);
+
+  public:
+    void add(std::unique_ptr<Machine> machine, int width, int height);
+
+    /* runs frames more frames on every instance, returns when all of them are done */
+    void run(ThreadPool& pool, uint64_t frames, uint32_t quantum = 1);
+
+    size_t size() const { return _instances.size(); }
+    Machine& machine(size_t index) { return *_instances[index]->machine; }
+    const gfx::FrameBuffer& frame(size_t index) const { return _instances[index]->frame; }
+    const Stats& stats(size_t index) const { return _instances[index]->stats; }
+  };
+}
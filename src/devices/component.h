@@ -1,11 +1,21 @@
 #pragma once
 
+#include "scheduler.h"
+
 #include <cstdint>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
 
 namespace devices
 {
   using addr_t = uint16_t;
 
+  struct Bus;
+
   struct Component
   {
     virtual ~Component() = default;
@@ -14,9 +24,26 @@ namespace devices
 
   struct Memory
   {
+  protected:
+    Bus* _bus = nullptr;
+
+    /* tells the bus that pages returned for [start, end] are stale (eg. after a bank switch) */
+    void invalidate(addr_t start, addr_t end);
+
+    friend struct Bus;
+
+  public:
     virtual ~Memory() = default;
     virtual uint8_t read(addr_t address) const = 0;
     virtual void write(addr_t address, uint8_t value) = 0;
+
+    /* host memory backing the page that starts at address, it must stay valid for
+       at least Bus::PAGE_SIZE bytes. Returning nullptr makes the bus go through read/write */
+    virtual uint8_t* page(addr_t address, bool write) { return nullptr; }
+
+    /* cycle until which reading address keeps returning the same value unless it is written or a
+       scheduler event fires in between, registers derived from the clock must override it */
+    virtual cycle_t stableUntil(addr_t address) const { return Scheduler::NEVER; }
   };
 
   struct Rom : public Memory, public Component
@@ -39,6 +66,8 @@ namespace devices
       /* ROMs are typically read - only, so we ignore writes. */
     }
 
+    uint8_t* page(addr_t address, bool write) override;
+
     void load(const std::vector<uint8_t>& data)
     {
       if (data.size() <= _data.size())
@@ -66,53 +95,292 @@ namespace devices
       if (address < _data.size())
         _data[address] = value;
     }
+
+    uint8_t* page(addr_t address, bool write) override;
   };
 
   struct CPU : public Component
   {
   public:
+    struct Stats
+    {
+      uint64_t instructions = 0;
+      /* cycles jumped over instead of being executed */
+      uint64_t haltedCycles = 0;
+      uint64_t idleCycles = 0;
+    };
+
     virtual void reset() = 0;
-    virtual void execute() = 0;
+    /* executes a single instruction, returns the cycles it took */
+    virtual uint32_t execute() = 0;
+
+    /* executes instructions until the scheduler clock reaches deadline, an implementation can
+       override this to keep its state in locals for the whole run */
+    virtual void run(Scheduler& scheduler, cycle_t deadline)
+    {
+      while (scheduler.now() < deadline)
+        scheduler.advance(execute());
+    }
+
+    virtual Stats stats() const { return Stats(); }
   };
 
   struct Bus
   {
+  public:
+    static constexpr size_t PAGE_BITS = 8;
+    static constexpr size_t PAGE_SIZE = 1 << PAGE_BITS;
+    static constexpr size_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr size_t PAGE_COUNT = 0x10000 >> PAGE_BITS;
+
   protected:
     struct BusMapping
     {
       addr_t start, end;
+      /* bus address which corresponds to device address 0 */
+      addr_t base;
       Memory* device;
     };
 
+    /* decoded view of PAGE_SIZE bytes of the address space, built when mappings change:
+       plain memory is accessed through host pointers, everything else through its device */
+    struct Page
+    {
+      uint8_t* read;
+      uint8_t* write;
+      Memory* device;
+      addr_t base;
+      /* more than one mapping falls inside the page, resolve it by scanning */
+      bool shared;
+      /* write pointer of a watched page, moved here so that writes take the slow path and get reported */
+      uint8_t* watched;
+    };
+
     std::vector<BusMapping> _mappings;
+    std::array<Page, PAGE_COUNT> _pages;
+
+    /* told the host memory of a watched page which was written or remapped */
+    std::function<void(const uint8_t*)> _watcher;
+
+    const BusMapping* find(addr_t address) const
+    {
+      for (const auto& mapping : _mappings)
+      {
+        if (address >= mapping.start && address <= mapping.end)
+          return &mapping;
+      }
+      return nullptr;
+    }
+
+    void decode(size_t index)
+    {
+      Page& page = _pages[index];
+
+      /* whatever was derived from the old contents can't be trusted after a remap */
+      if (page.watched && _watcher)
+        _watcher(page.watched);
+
+      page = { nullptr, nullptr, nullptr, 0, false, nullptr };
+
+      const size_t first = index << PAGE_BITS, last = first + PAGE_MASK;
+
+      /* first mapping which overlaps the page wins, as it would with a linear scan */
+      const BusMapping* owner = nullptr;
+      for (const auto& mapping : _mappings)
+      {
+        if (mapping.start <= last && mapping.end >= first)
+        {
+          owner = &mapping;
+          break;
+        }
+      }
+
+      if (!owner)
+        return;
+
+      if (owner->start > first || owner->end < last)
+      {
+        page.shared = true;
+        return;
+      }
+
+      page.device = owner->device;
+      page.base = owner->base;
+      page.read = owner->device->page(addr_t(first - owner->base), false);
+      page.write = owner->device->page(addr_t(first - owner->base), true);
+    }
+
+    friend struct Memory;
+
+    void remap(Memory* device, addr_t start, addr_t end)
+    {
+      for (const auto& mapping : _mappings)
+      {
+        if (mapping.device != device)
+          continue;
+
+        /* intersect in device space, where the mapping covers [offset, offset + end - start], without
+           narrowing so that offsets near the top of the address space can't wrap the range */
+        const size_t offset = addr_t(mapping.start - mapping.base);
+        const size_t low = std::max<size_t>(start, offset);
+        const size_t high = std::min<size_t>(end, offset + (mapping.end - mapping.start));
+
+        if (low > high)
+          continue;
+
+        const size_t from = mapping.start + (low - offset), to = mapping.start + (high - offset);
+
+        for (size_t i = from >> PAGE_BITS; i <= (to >> PAGE_BITS); ++i)
+          decode(i);
+      }
+    }
 
   public:
-    void map(Memory* device, addr_t start, addr_t end)
+    Bus() { _pages.fill({ nullptr, nullptr, nullptr, 0, false, nullptr }); }
+
+    /* maps device on [start, end], the device sees addresses starting from offset */
+    void map(Memory* device, addr_t start, addr_t end, addr_t offset = 0)
     {
       assert(end > start);
-      _mappings.push_back({ start, end, device });
+      _mappings.push_back({ start, end, addr_t(start - offset), device });
+      device->_bus = this;
+
+      for (size_t i = start >> PAGE_BITS; i <= size_t(end >> PAGE_BITS); ++i)
+        decode(i);
+    }
+
+    /* removes every mapping of device, eg. before destroying it */
+    void unmap(Memory* device)
+    {
+      _mappings.erase(std::remove_if(_mappings.begin(), _mappings.end(), [device](const BusMapping& mapping) { return mapping.device == device; }), _mappings.end());
+      device->_bus = nullptr;
+
+      for (size_t i = 0; i < PAGE_COUNT; ++i)
+        decode(i);
+    }
+
+    /* host memory behind address if it is plain memory, reads through it are the same as read() */
+    const uint8_t* memory(addr_t address) const
+    {
+      const Page& page = _pages[address >> PAGE_BITS];
+      return page.read ? page.read + (address & PAGE_MASK) : nullptr;
+    }
+
+    /* see Memory::stableUntil(), plain memory only changes when written */
+    cycle_t stableUntil(addr_t address) const
+    {
+      const Page& page = _pages[address >> PAGE_BITS];
+
+      if (page.read)
+        return Scheduler::NEVER;
+      else if (page.device)
+        return page.device->stableUntil(address - page.base);
+      else if (page.shared)
+      {
+        const BusMapping* mapping = find(address);
+        if (mapping)
+          return mapping->device->stableUntil(address - mapping->base);
+      }
+
+      return Scheduler::NEVER;
+    }
+
+    void setWatcher(std::function<void(const uint8_t*)> watcher) { _watcher = std::move(watcher); }
+
+    /* for devices which give the bus read only host memory and change it in write() */
+    void modified(const uint8_t* memory)
+    {
+      if (_watcher)
+        _watcher(memory);
+    }
+
+    /* reports the next write to the memory behind the page of address, through any mirror of it (a single
+       one, watch again to keep watching). Read only pages can't change and are never reported */
+    void watch(addr_t address)
+    {
+      uint8_t* memory = _pages[address >> PAGE_BITS].write;
+      if (!memory || memory != _pages[address >> PAGE_BITS].read)
+        return;
+
+      for (Page& page : _pages)
+      {
+        if (page.write == memory)
+        {
+          page.watched = memory;
+          page.write = nullptr;
+        }
+      }
     }
 
     uint8_t read(addr_t address) const
     {
-      for (const auto& mapping : _mappings)
+      const Page& page = _pages[address >> PAGE_BITS];
+
+      if (page.read)
+        return page.read[address & PAGE_MASK];
+      else if (page.device)
+        return page.device->read(address - page.base);
+      else if (page.shared)
       {
-        if (address >= mapping.start && address <= mapping.end)
-          return mapping.device->read(address - mapping.start);
+        const BusMapping* mapping = find(address);
+        if (mapping)
+          return mapping->device->read(address - mapping->base);
       }
+
       return 0xFF;
     }
 
     void write(addr_t address, uint8_t value)
     {
-      for (const auto& mapping : _mappings)
+      Page& page = _pages[address >> PAGE_BITS];
+
+      if (page.write)
+        page.write[address & PAGE_MASK] = value;
+      else if (page.watched)
       {
-        if (address >= mapping.start && address <= mapping.end)
+        uint8_t* memory = page.watched;
+        memory[address & PAGE_MASK] = value;
+
+        for (Page& mirror : _pages)
         {
-          mapping.device->write(address - mapping.start, value);
-          return;
+          if (mirror.watched == memory)
+          {
+            mirror.write = memory;
+            mirror.watched = nullptr;
+          }
         }
+
+        if (_watcher)
+          _watcher(memory);
+      }
+      else if (page.device)
+        page.device->write(address - page.base, value);
+      else if (page.shared)
+      {
+        const BusMapping* mapping = find(address);
+        if (mapping)
+          mapping->device->write(address - mapping->base, value);
       }
     }
   };
+
+  inline void Memory::invalidate(addr_t start, addr_t end)
+  {
+    if (_bus)
+      _bus->remap(this, start, end);
+  }
+
+  inline uint8_t* Rom::page(addr_t address, bool write)
+  {
+    if (!write && size_t(address) + Bus::PAGE_SIZE <= _data.size())
+      return &_data[address];
+    return nullptr;
+  }
+
+  inline uint8_t* Ram::page(addr_t address, bool)
+  {
+    if (size_t(address) + Bus::PAGE_SIZE <= _data.size())
+      return &_data[address];
+    return nullptr;
+  }
 }
\ No newline at end of file
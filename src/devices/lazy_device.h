@@ -0,0 +1,41 @@
+#pragma once
+
+#include "scheduler.h"
+
+namespace devices
+{
+  /*
+    base of devices which are emulated lazily: instead of being ticked they remember up to which
+    cycle they are accurate and catch up only when their state is observed or about to change
+    (a register access through the bus, a frame or audio block boundary). Nothing they depend on
+    changes between two syncs, so a whole span is produced at once.
+  */
+  struct LazyDevice
+  {
+  protected:
+    Scheduler& _scheduler;
+    cycle_t _synced;
+
+    /* brings the device from cycle from up to cycle to */
+    virtual void catchUp(cycle_t from, cycle_t to) = 0;
+
+  public:
+    LazyDevice(Scheduler& scheduler) : _scheduler(scheduler), _synced(scheduler.now()) { }
+    virtual ~LazyDevice() = default;
+
+    void sync()
+    {
+      const cycle_t now = _scheduler.now();
+      if (now > _synced)
+      {
+        catchUp(_synced, now);
+        _synced = now;
+      }
+    }
+
+    /* drops the span since the last sync, eg. after a reset */
+    void restart() { _synced = _scheduler.now(); }
+
+    cycle_t synced() const { return _synced; }
+  };
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "component.h"
+#include "gfx/frame_buffer.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace devices
+{
+  struct Machine
+  {
+  protected:
+    Bus _bus;
+    Scheduler _scheduler;
+    std::vector<std::unique_ptr<Component>> _devices;
+
+    /* drives the timeline between events, without one time just jumps from event to event */
+    CPU* _cpu = nullptr;
+
+  public:
+    virtual ~Machine() = default;
+
+    template<typename T, typename... Args>
+    T* add(Args&&... args) {
+      auto device = std::make_unique<T>(std::forward<Args>(args)...);
+      T* raw = device.get();
+      _devices.push_back(std::move(device));
+      return raw;
+    }
+
+    auto& bus() { return _bus; }
+    auto& scheduler() { return _scheduler; }
+
+    /* runs the CPU uninterrupted up to the next event deadline, fires the events due and repeats until target */
+    void runUntil(cycle_t target)
+    {
+      while (_scheduler.now() < target)
+      {
+        const cycle_t deadline = std::min(target, _scheduler.nextDeadline());
+
+        if (_cpu)
+          _cpu->run(_scheduler, deadline);
+        else
+          _scheduler.advanceTo(deadline);
+
+        _scheduler.dispatch();
+      }
+    }
+
+    void runFor(cycle_t cycles) { runUntil(_scheduler.now() + cycles); }
+
+    CPU::Stats cpuStats() const { return _cpu ? _cpu->stats() : CPU::Stats(); }
+
+    /* emulates a whole video frame, drawing it into frame */
+    virtual void runFrame(gfx::FrameBuffer& frame) { }
+    /* frames per second of the emulated hardware at normal speed */
+    virtual float frameRate() const { return 60.0f; }
+
+    /* mono samples at audioRate() produced since the last call, up to count */
+    virtual size_t readAudio(float* out, size_t count) { return 0; }
+    virtual float audioRate() const { return 44100.0f; }
+  };
+}
@@ -0,0 +1,77 @@
+#include "runner.h"
+
+#include <chrono>
+
+using namespace devices;
+
+Runner::Runner(Machine& machine, int width, int height) : _machine(machine), _frames(width, height),
+  _samples(1024), _running(false), _paused(false), _speed(1.0f), _fastForward(false), _frameCount(0), _sequence(0)
+{
+
+}
+
+void Runner::start()
+{
+  if (_running)
+    return;
+
+  _running = true;
+  _thread = std::thread([this]() { loop(); });
+}
+
+void Runner::stop()
+{
+  _running = false;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void Runner::drainAudio()
+{
+  size_t count;
+  while ((count = _machine.readAudio(_samples.data(), _samples.size())) > 0)
+    _audio.push(_samples.data(), count);
+}
+
+void Runner::loop()
+{
+  using clock = std::chrono::steady_clock;
+
+  /* if emulation falls behind by more than this it just restarts pacing from now instead of rushing to catch up */
+  constexpr int MAX_LAG_FRAMES = 4;
+
+  auto deadline = clock::now();
+
+  while (_running)
+  {
+    if (_paused)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      deadline = clock::now();
+      continue;
+    }
+
+    gfx::FrameBuffer& frame = _frames.back();
+    _machine.runFrame(frame);
+    frame.seal(++_sequence, _previous);
+    _frames.publish();
+    _frameCount.fetch_add(1, std::memory_order_relaxed);
+
+    drainAudio();
+
+    if (_fastForward)
+    {
+      deadline = clock::now();
+      continue;
+    }
+
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / (_machine.frameRate() * _speed)));
+    deadline += period;
+
+    const auto now = clock::now();
+    if (now > deadline + period * MAX_LAG_FRAMES)
+      deadline = now;
+    else
+      std::this_thread::sleep_until(deadline);
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "machine.h"
+#include "base/ring_buffer.h"
+#include "base/triple_buffer.h"
+#include "gfx/frame_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace devices
+{
+  /*
+    runs a Machine on its own thread at the machine frame rate (times speed), completed frames are
+    handed to the UI through a triple buffer so that a vsync stall on the render side never blocks
+    emulation. The samples the machine produces during a frame are pushed into a lock free ring
+    right after it, the audio device thread pops them. Everything else in the machine must be
+    considered owned by the emulation thread while the runner is started.
+  */
+  class Runner
+  {
+  public:
+    using Frames = structures::TripleBuffer<gfx::FrameBuffer>;
+    /* ~185ms at 44.1kHz, a frame is ~735 samples */
+    using Audio = structures::RingBuffer<float, 8192>;
+
+  protected:
+    Machine& _machine;
+    Frames _frames;
+    Audio _audio;
+    /* emulation thread only, samples read from the machine on their way to _audio */
+    std::vector<float> _samples;
+
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<bool> _paused;
+    /* multiplier of the machine frame rate, fast forward runs as fast as possible */
+    std::atomic<float> _speed;
+    std::atomic<bool> _fastForward;
+
+    std::atomic<uint64_t> _frameCount;
+
+    /* emulation thread only, history used to find the rows that changed between frames */
+    uint64_t _sequence;
+    std::vector<gfx::Pixel> _previous;
+
+    void loop();
+    void drainAudio();
+
+  public:
+    Runner(Machine& machine, int width, int height);
+    Runner(const Runner&) = delete;
+    ~Runner() { stop(); }
+
+    void start();
+    void stop();
+
+    void pause(bool paused) { _paused = paused; }
+    bool paused() const { return _paused; }
+
+    void setSpeed(float speed) { _speed = std::max(speed, 0.1f); }
+    float speed() const { return _speed; }
+    void fastForward(bool enabled) { _fastForward = enabled; }
+    bool fastForward() const { return _fastForward; }
+
+    /* frames emulated since start, UI can derive the emulated fps from it */
+    uint64_t frameCount() const { return _frameCount.load(std::memory_order_relaxed); }
+
+    Frames& frames() { return _frames; }
+
+    /* mono samples at audioRate(), whatever doesn't fit when the consumer is late is dropped */
+    Audio& audio() { return _audio; }
+    float audioRate() const { return _machine.audioRate(); }
+  };
+}
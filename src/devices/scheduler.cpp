@@ -0,0 +1,104 @@
+#include "scheduler.h"
+
+using namespace devices;
+
+Scheduler::Event* Scheduler::add(std::string_view name, std::function<void(cycle_t)> handler)
+{
+  _events.push_back(std::make_unique<Event>(name, std::move(handler)));
+  return _events.back().get();
+}
+
+void Scheduler::up(size_t index)
+{
+  Event* event = _heap[index];
+
+  while (index > 0)
+  {
+    size_t parent = (index - 1) / 2;
+    if (!before(event, _heap[parent]))
+      break;
+
+    place(index, _heap[parent]);
+    index = parent;
+  }
+
+  place(index, event);
+}
+
+void Scheduler::down(size_t index)
+{
+  Event* event = _heap[index];
+  const size_t size = _heap.size();
+
+  for (;;)
+  {
+    size_t child = index * 2 + 1;
+    if (child >= size)
+      break;
+
+    if (child + 1 < size && before(_heap[child + 1], _heap[child]))
+      ++child;
+
+    if (!before(_heap[child], event))
+      break;
+
+    place(index, _heap[child]);
+    index = child;
+  }
+
+  place(index, event);
+}
+
+void Scheduler::remove(Event* event)
+{
+  const size_t index = event->_index;
+  Event* last = _heap.back();
+  _heap.pop_back();
+  event->_index = Event::NONE;
+
+  if (last != event)
+  {
+    place(index, last);
+    up(index);
+    down(last->_index);
+  }
+}
+
+void Scheduler::schedule(Event* event, cycle_t when)
+{
+  event->_when = when;
+  event->_order = _order++;
+
+  if (event->scheduled())
+  {
+    up(event->_index);
+    down(event->_index);
+  }
+  else
+  {
+    _heap.push_back(event);
+    event->_index = _heap.size() - 1;
+    up(event->_index);
+  }
+}
+
+void Scheduler::cancel(Event* event)
+{
+  if (event->scheduled())
+    remove(event);
+
+  event->_when = NEVER;
+}
+
+void Scheduler::dispatch()
+{
+  while (!_heap.empty() && _heap.front()->_when <= _now)
+  {
+    Event* event = _heap.front();
+    const cycle_t when = event->_when;
+
+    remove(event);
+    ++_dispatched;
+    event->_handler(when);
+  }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace devices
+{
+  using cycle_t = uint64_t;
+
+  /*
+    machine wide timeline in master clock cycles. Devices register an Event once and then (re)schedule
+    it at the absolute cycle of their next state change, the CPU runs uninterrupted until
+    nextDeadline() and dispatch() fires whatever became due. Events live in an indexed binary
+    min-heap so rescheduling and cancelling are O(log n); events due at the same cycle fire in the
+    order they were scheduled.
+  */
+  class Scheduler
+  {
+  public:
+    static constexpr cycle_t NEVER = std::numeric_limits<cycle_t>::max();
+
+    struct Event
+    {
+    private:
+      std::string _name;
+      /* receives the cycle the event was due at, which can be earlier than now() */
+      std::function<void(cycle_t)> _handler;
+
+      cycle_t _when;
+      uint64_t _order;
+      /* position in the heap, NONE when not scheduled */
+      size_t _index;
+
+      static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+      friend class Scheduler;
+
+    public:
+      Event(std::string_view name, std::function<void(cycle_t)> handler) : _name(name), _handler(std::move(handler)), _when(NEVER), _order(0), _index(NONE) { }
+
+      const std::string& name() const { return _name; }
+      bool scheduled() const { return _index != NONE; }
+      cycle_t when() const { return _when; }
+    };
+
+  protected:
+    cycle_t _now;
+    uint64_t _order;
+
+    std::vector<std::unique_ptr<Event>> _events;
+    std::vector<Event*> _heap;
+
+    uint64_t _dispatched;
+
+    static bool before(const Event* a, const Event* b) { return a->_when < b->_when || (a->_when == b->_when && a->_order < b->_order); }
+
+    void place(size_t index, Event* event) { _heap[index] = event; event->_index = index; }
+    void up(size_t index);
+    void down(size_t index);
+    void remove(Event* event);
+
+  public:
+    Scheduler() : _now(0), _order(0), _dispatched(0) { }
+
+    /* events are owned by the scheduler and stay valid for its whole lifetime */
+    Event* add(std::string_view name, std::function<void(cycle_t)> handler);
+
+    void schedule(Event* event, cycle_t when);
+    void scheduleIn(Event* event, cycle_t delay) { schedule(event, _now + delay); }
+    void cancel(Event* event);
+
+    cycle_t now() const { return _now; }
+    cycle_t nextDeadline() const { return _heap.empty() ? NEVER : _heap.front()->_when; }
+
+    /* moves the clock forward, nothing fires until dispatch() */
+    void advance(cycle_t cycles) { _now += cycles; }
+    void advanceTo(cycle_t when) { if (when > _now) _now = when; }
+
+    /* fires every event due at or before now(), handlers may schedule again */
+    void dispatch();
+
+    uint64_t dispatched() const { return _dispatched; }
+  };
+}
@@ -0,0 +1,26 @@
+#include "frame_buffer.h"
+
+#include <cstring>
+
+using namespace gfx;
+
+void FrameBuffer::seal(uint64_t sequence, std::vector<Pixel>& previous)
+{
+  /* no history (first frame or size change) means everything is dirty */
+  const bool fresh = previous.size() != _data.size();
+  if (fresh)
+    previous = _data;
+
+  const size_t bytes = _width * sizeof(Pixel);
+
+  for (int y = 0; y < _height; ++y)
+  {
+    Pixel* last = &previous[y * _width];
+    _dirtyRows[y] = fresh || memcmp(row(y), last, bytes) != 0;
+
+    if (_dirtyRows[y] && !fresh)
+      memcpy(last, row(y), bytes);
+  }
+
+  _sequence = sequence;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace gfx
+{
+  union Pixel
+  {
+    uint32_t value;
+    struct { uint8_t a, b, g, r; };
+
+    Pixel(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0, uint8_t alpha = 255)
+      : r(red), g(green), b(blue), a(alpha) {}
+  };
+
+  struct FrameBuffer
+  {
+  protected:
+    int _width;
+    int _height;
+    std::vector<Pixel> _data;
+
+    /* set by seal(), ordinal of the produced frame and rows which differ from the frame before it */
+    uint64_t _sequence;
+    std::vector<uint8_t> _dirtyRows;
+
+  public:
+    FrameBuffer(int width, int height)
+      : _width(width), _height(height), _data(width * height), _sequence(0), _dirtyRows(height, 1) {}
+
+    Pixel& pixel(int x, int y) { return _data[y * _width + x]; }
+    const Pixel& pixel(int x, int y) const { return _data[y * _width + x]; }
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    Pixel* data() { return _data.data(); }
+    const Pixel* data() const { return _data.data(); }
+
+    Pixel* row(int y) { return &_data[y * _width]; }
+    const Pixel* row(int y) const { return &_data[y * _width]; }
+
+    void fill(Pixel color) { std::fill(_data.begin(), _data.end(), color); }
+    void set(int x, int y, Pixel color) { pixel(x, y) = color; }
+
+    /*
+      marks the frame as complete: compares each row with previous, which holds the pixels of the
+      previous frame whatever buffer it was drawn into, and copies the rows which changed into it.
+      A consumer which has shown frame sequence - 1 only needs to upload the dirty rows
+    */
+    void seal(uint64_t sequence, std::vector<Pixel>& previous);
+
+    uint64_t sequence() const { return _sequence; }
+    bool dirty(int y) const { return _dirtyRows[y] != 0; }
+  };
+}
@@ -0,0 +1,121 @@
+#include "indexed_frame_buffer.h"
+
+#include "base/simd.h"
+
+#include <cassert>
+
+using namespace gfx;
+
+namespace
+{
+  void expandScalar(const uint8_t* in, Pixel* out, size_t count, const Pixel* palette)
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = palette[in[i]];
+  }
+
+  /*
+    small palettes fit a 16 byte table lookup: the palette is split in four byte planes, each 16 indices
+    are looked up once per plane and the planes are interleaved back into pixels. Returns the amount of
+    pixels done, the caller finishes the tail. Plain SSE2 has no byte shuffle and a compare/select
+    version measured slower than the scalar loop, so it is left to the scalar path.
+  */
+  size_t expandShuffle(const uint8_t* in, Pixel* out, size_t count, const Pixel* palette)
+  {
+    size_t i = 0;
+
+#if SIMD_SSSE3
+    alignas(16) uint8_t planes[4][16] = { };
+    for (size_t c = 0; c < 16; ++c)
+      for (size_t p = 0; p < 4; ++p)
+        planes[p][c] = uint8_t(palette[c].value >> (p * 8));
+
+    const __m128i plane0 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[0]));
+    const __m128i plane1 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[1]));
+    const __m128i plane2 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[2]));
+    const __m128i plane3 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[3]));
+
+    for (; i + 16 <= count; i += 16)
+    {
+      const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+      const __m128i b0 = _mm_shuffle_epi8(plane0, indices);
+      const __m128i b1 = _mm_shuffle_epi8(plane1, indices);
+      const __m128i b2 = _mm_shuffle_epi8(plane2, indices);
+      const __m128i b3 = _mm_shuffle_epi8(plane3, indices);
+
+      const __m128i lo01 = _mm_unpacklo_epi8(b0, b1), hi01 = _mm_unpackhi_epi8(b0, b1);
+      const __m128i lo23 = _mm_unpacklo_epi8(b2, b3), hi23 = _mm_unpackhi_epi8(b2, b3);
+
+      __m128i* dest = reinterpret_cast<__m128i*>(out + i);
+      _mm_storeu_si128(dest + 0, _mm_unpacklo_epi16(lo01, lo23));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(lo01, lo23));
+      _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(hi01, hi23));
+      _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(hi01, hi23));
+    }
+#elif SIMD_NEON
+    uint8_t planes[4][16] = { };
+    for (size_t c = 0; c < 16; ++c)
+      for (size_t p = 0; p < 4; ++p)
+        planes[p][c] = uint8_t(palette[c].value >> (p * 8));
+
+    const uint8x16_t plane0 = vld1q_u8(planes[0]), plane1 = vld1q_u8(planes[1]);
+    const uint8x16_t plane2 = vld1q_u8(planes[2]), plane3 = vld1q_u8(planes[3]);
+
+    for (; i + 16 <= count; i += 16)
+    {
+      const uint8x16_t indices = vld1q_u8(in + i);
+
+      uint8x16x4_t pixels;
+      pixels.val[0] = vqtbl1q_u8(plane0, indices);
+      pixels.val[1] = vqtbl1q_u8(plane1, indices);
+      pixels.val[2] = vqtbl1q_u8(plane2, indices);
+      pixels.val[3] = vqtbl1q_u8(plane3, indices);
+
+      /* interleaving store puts the four planes back together */
+      vst4q_u8(reinterpret_cast<uint8_t*>(out + i), pixels);
+    }
+#endif
+
+    return i;
+  }
+
+  /* any palette, 8 lanes gathered from the palette at once */
+  size_t expandGather(const uint8_t* in, Pixel* out, size_t count, const Pixel* palette)
+  {
+    size_t i = 0;
+
+#if SIMD_AVX2
+    const int* table = reinterpret_cast<const int*>(palette);
+
+    for (; i + 8 <= count; i += 8)
+    {
+      const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(table, indices, 4));
+    }
+#endif
+
+    return i;
+  }
+}
+
+void IndexedFrameBuffer::expandRow(int y, Pixel* out) const
+{
+  const uint8_t* in = row(y);
+  const size_t count = size_t(_width);
+
+  size_t done = _colors <= 16 ? expandShuffle(in, out, count, _palette.data()) : expandGather(in, out, count, _palette.data());
+  expandScalar(in + done, out + done, count - done, _palette.data());
+}
+
+void IndexedFrameBuffer::expand(FrameBuffer& out) const
+{
+  assert(out.width() == _width && out.height() == _height);
+
+  /* rows are contiguous in both buffers, so the whole frame is a single run */
+  const uint8_t* in = _data.data();
+  const size_t count = _data.size();
+
+  size_t done = _colors <= 16 ? expandShuffle(in, out.data(), count, _palette.data()) : expandGather(in, out.data(), count, _palette.data());
+  expandScalar(in + done, out.data() + done, count - done, _palette.data());
+}
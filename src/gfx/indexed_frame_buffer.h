@@ -0,0 +1,57 @@
+#pragma once
+
+#include "frame_buffer.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gfx
+{
+  /*
+    framebuffer holding one palette index per pixel, a quarter of the memory traffic of FrameBuffer for
+    the PPU side. expand() converts it to RGBA through the palette, with a shuffle based kernel for
+    palettes of up to 16 entries (DMG shades) and a gather one for bigger palettes (CGB colors).
+    Every index written must be below colors().
+  */
+  struct IndexedFrameBuffer
+  {
+  protected:
+    int _width;
+    int _height;
+    std::vector<uint8_t> _data;
+
+    std::array<Pixel, 256> _palette;
+    /* entries in use, the expansion kernel is chosen on this */
+    size_t _colors;
+
+  public:
+    IndexedFrameBuffer(int width, int height)
+      : _width(width), _height(height), _data(width * height), _palette(), _colors(1) {}
+
+    uint8_t& index(int x, int y) { return _data[y * _width + x]; }
+    uint8_t index(int x, int y) const { return _data[y * _width + x]; }
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    uint8_t* data() { return _data.data(); }
+    const uint8_t* data() const { return _data.data(); }
+
+    uint8_t* row(int y) { return &_data[y * _width]; }
+    const uint8_t* row(int y) const { return &_data[y * _width]; }
+
+    void fill(uint8_t index) { std::fill(_data.begin(), _data.end(), index); }
+    void set(int x, int y, uint8_t index) { this->index(x, y) = index; }
+
+    void setColor(uint8_t index, Pixel color) { _palette[index] = color; _colors = std::max(_colors, size_t(index) + 1); }
+    void setPalette(const Pixel* colors, size_t count) { std::copy(colors, colors + count, _palette.begin()); _colors = count; }
+
+    const Pixel& color(uint8_t index) const { return _palette[index]; }
+    size_t colors() const { return _colors; }
+
+    /* writes the RGBA image to out, which must have the same size */
+    void expand(FrameBuffer& out) const;
+    void expandRow(int y, Pixel* out) const;
+  };
+}
@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "base/path.h"
+#include "base/thread_pool.h"
+#include "bench/bench.h"
+#include "bench/roms.h"
+#include "devices/batch.h"
+#include "gfx/frame_buffer.h"
+#include "platform/gameboy/gameboy.h"
+
+/*
+  runs a machine without any SDL/ImGui dependency, as fast as possible, for batch jobs and
+  throughput measurements:
+
+    headless <rom> [--frames N] [--screenshot out.ppm] [--dump-every K] [--dump-prefix prefix] [--audio out.raw] [--serial] [--no-block-cache]
+
+  or many instances of the same ROM in parallel, optionally repeating the run for 1, 2, 4.. threads
+  to report scaling efficiency:
+
+    headless <rom> --batch N [--threads T] [--quantum Q] [--frames N] [--scaling]
+
+  or the microbenchmarks of src/bench, one of them by name or all of them:
+
+    headless --bench <name|all|list>
+
+  or the test ROMs of src/bench/roms.cpp, written out as <dir>/<name>.gb or run with and without
+  the block cache, comparing their serial output, WRAM and last frame against each other and against
+  what they are expected to send:
+
+    headless --roms <dir>
+    headless --check
+
+  emulated MHz of the CPU bound one, for throughput comparisons between builds:
+
+    headless --roms . && headless bench.gb --frames 3000
+*/
+
+namespace
+{
+  using clock_type = std::chrono::steady_clock;
+
+  struct Options
+  {
+    std::string rom;
+    u64 frames = 600;
+    std::string screenshot;
+    u64 dumpEvery = 0;
+    std::string dumpPrefix = "frame";
+    std::string audio;
+
+    size_t batch = 0;
+    size_t threads = 0;
+    u32 quantum = 1;
+    bool scaling = false;
+
+    bool serial = false;
+    bool blockCache = true;
+
+    std::string bench;
+    std::string roms;
+    bool check = false;
+  };
+
+  void usage()
+  {
+    printf("usage: headless <rom> [--frames N] [--screenshot out.ppm] [--dump-every K] [--dump-prefix prefix] [--audio out.raw] [--serial] [--no-block-cache]\n");
+    printf("       headless <rom> --batch N [--threads T] [--quantum Q] [--frames N] [--scaling]\n");
+    printf("       headless --bench <name|all|list>\n");
+    printf("       headless --roms <dir>\n");
+    printf("       headless --check\n");
+  }
+
+  bool parse(int argc, char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const char* arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+
+      if (!strcmp(arg, "--frames") && hasValue)
+        options.frames = strtoull(argv[++i], nullptr, 10);
+      else if (!strcmp(arg, "--screenshot") && hasValue)
+        options.screenshot = argv[++i];
+      else if (!strcmp(arg, "--dump-every") && hasValue)
+        options.dumpEvery = strtoull(argv[++i], nullptr, 10);
+      else if (!strcmp(arg, "--dump-prefix") && hasValue)
+        options.dumpPrefix = argv[++i];
+      else if (!strcmp(arg, "--audio") && hasValue)
+        options.audio = argv[++i];
+      else if (!strcmp(arg, "--batch") && hasValue)
+        options.batch = strtoull(argv[++i], nullptr, 10);
+      else if (!strcmp(arg, "--threads") && hasValue)
+        options.threads = strtoull(argv[++i], nullptr, 10);
+      else if (!strcmp(arg, "--quantum") && hasValue)
+        options.quantum = u32(strtoul(argv[++i], nullptr, 10));
+      else if (!strcmp(arg, "--scaling"))
+        options.scaling = true;
+      else if (!strcmp(arg, "--serial"))
+        options.serial = true;
+      else if (!strcmp(arg, "--no-block-cache"))
+        options.blockCache = false;
+      else if (!strcmp(arg, "--bench") && hasValue)
+        options.bench = argv[++i];
+      else if (!strcmp(arg, "--roms") && hasValue)
+        options.roms = argv[++i];
+      else if (!strcmp(arg, "--check"))
+        options.check = true;
+      else if (arg[0] != '-' && options.rom.empty())
+        options.rom = arg;
+      else
+        return false;
+    }
+
+    return !options.rom.empty() || !options.bench.empty() || !options.roms.empty() || options.check;
+  }
+
+  /* binary PPM, alpha is dropped */
+  bool writePPM(const std::string& fileName, const gfx::FrameBuffer& frame)
+  {
+    FILE* out = fopen(fileName.c_str(), "wb");
+    if (!out)
+      return false;
+
+    fprintf(out, "P6\n%d %d\n255\n", frame.width(), frame.height());
+
+    std::vector<u8> row(frame.width() * 3);
+    for (int y = 0; y < frame.height(); ++y)
+    {
+      const gfx::Pixel* pixels = frame.row(y);
+      for (int x = 0; x < frame.width(); ++x)
+      {
+        row[x * 3 + 0] = pixels[x].r;
+        row[x * 3 + 1] = pixels[x].g;
+        row[x * 3 + 2] = pixels[x].b;
+      }
+      fwrite(row.data(), 1, row.size(), out);
+    }
+
+    fclose(out);
+    return true;
+  }
+
+  double millis(clock_type::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+  struct BatchResult
+  {
+    double elapsed;
+    double fps;
+  };
+
+  /* runs options.batch instances of the ROM on threads workers, returns aggregate throughput */
+  bool runBatch(const Options& options, size_t threads, bool report, BatchResult& result)
+  {
+    devices::Batch batch;
+
+    for (size_t i = 0; i < options.batch; ++i)
+    {
+      auto machine = std::make_unique<gb::GameBoy>();
+      if (!machine->load(options.rom))
+      {
+        fprintf(stderr, "Unable to load %s\n", options.rom.c_str());
+        return false;
+      }
+
+      batch.add(std::move(machine), gb::SCREEN_WIDTH, gb::SCREEN_HEIGHT);
+    }
+
+    ThreadPool pool(threads);
+
+    const auto start = clock_type::now();
+    batch.run(pool, options.frames, options.quantum);
+    const auto end = clock_type::now();
+
+    result.elapsed = millis(end - start);
+    result.fps = result.elapsed > 0.0 ? options.batch * options.frames * 1000.0 / result.elapsed : 0.0;
+
+    if (report)
+    {
+      double minimum = 0.0, maximum = 0.0, total = 0.0;
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        const double fps = batch.stats(i).fps();
+        minimum = i ? std::min(minimum, fps) : fps;
+        maximum = std::max(maximum, fps);
+        total += fps;
+
+        /* a handful of instances is still readable one per line */
+        if (batch.size() <= 16)
+          printf("  #%zu: %llu frames, %.1f fps, %.0f ns/frame\n", i, (unsigned long long)batch.stats(i).frames, fps, batch.stats(i).nanosPerFrame());
+      }
+
+      printf("instances: %zu on %zu threads, quantum %u frames, %zu steals\n", batch.size(), pool.size(), options.quantum, pool.steals());
+      printf("per instance: %.1f fps mean, %.1f min, %.1f max\n", batch.size() ? total / batch.size() : 0.0, minimum, maximum);
+      printf("aggregate: %llu frames in %.2f ms, %.1f fps\n", (unsigned long long)(options.batch * options.frames), result.elapsed, result.fps);
+    }
+
+    return true;
+  }
+
+  int benchMain(const Options& options)
+  {
+    if (options.bench == "list")
+    {
+      for (const bench::Benchmark& benchmark : bench::benchmarks())
+        printf("%-12s %s\n", benchmark.name, benchmark.description);
+      return 0;
+    }
+
+    if (!bench::run(options.bench))
+    {
+      fprintf(stderr, "Unknown benchmark %s, see --bench list\n", options.bench.c_str());
+      return 1;
+    }
+
+    return 0;
+  }
+
+  int romsMain(const Options& options)
+  {
+    for (const bench::TestRom& rom : bench::testRoms())
+    {
+      const path fileName = std::filesystem::path(options.roms) / (std::string(rom.name) + ".gb");
+      if (!bench::writeRom(rom, fileName))
+      {
+        fprintf(stderr, "Unable to write %s\n", fileName.c_str());
+        return 1;
+      }
+
+      printf("%s: %s\n", fileName.c_str(), rom.description);
+    }
+
+    return 0;
+  }
+
+  /* what a test ROM left behind after its frames */
+  struct Outcome
+  {
+    std::string serial;
+    std::vector<u8> wram;
+    std::vector<u32> frame;
+  };
+
+  bool runRom(const path& fileName, u64 frames, bool blockCache, Outcome& outcome)
+  {
+    gb::GameBoy machine;
+    if (!machine.load(fileName))
+      return false;
+
+    machine.cpu().setBlockCache(blockCache);
+
+    gfx::FrameBuffer frame(gb::SCREEN_WIDTH, gb::SCREEN_HEIGHT);
+    for (u64 i = 0; i < frames; ++i)
+      machine.runFrame(frame);
+
+    outcome.serial = machine.io().serial();
+    outcome.wram.resize(8_kb);
+    for (size_t i = 0; i < outcome.wram.size(); ++i)
+      outcome.wram[i] = machine.bus().read(devices::addr_t(0xC000 + i));
+    outcome.frame.clear();
+    for (int i = 0; i < frame.width() * frame.height(); ++i)
+      outcome.frame.push_back(frame.data()[i].value);
+
+    return true;
+  }
+
+  int checkMain()
+  {
+    int failures = 0;
+
+    for (const bench::TestRom& rom : bench::testRoms())
+    {
+      const path fileName = std::filesystem::temp_directory_path() / (std::string("emumachina_check_") + rom.name + ".gb");
+
+      Outcome cached, interpreted;
+      const char* error = nullptr;
+
+      if (!bench::writeRom(rom, fileName) || !runRom(fileName, rom.frames, true, cached) || !runRom(fileName, rom.frames, false, interpreted))
+        error = "unable to run";
+      else if (rom.serial && cached.serial != rom.serial)
+        error = "unexpected serial output";
+      else if (rom.frame && bench::frameHash(cached.frame.data(), cached.frame.size()) != rom.frame)
+        error = "unexpected frame";
+      else if (cached.serial != interpreted.serial)
+        error = "serial output differs without the block cache";
+      else if (cached.wram != interpreted.wram)
+        error = "WRAM differs without the block cache";
+      else if (cached.frame != interpreted.frame)
+        error = "frame differs without the block cache";
+
+      printf("%-8s %s\n", rom.name, error ? error : "ok");
+
+      if (error)
+      {
+        /* the ROMs send raw values too */
+        printf("  serial: ");
+        for (char c : cached.serial)
+          printf(c >= 0x20 && c < 0x7F && c != '\\' ? "%c" : "\\x%02x", u8(c));
+        printf("\n  frame: %016llx\n", (unsigned long long)bench::frameHash(cached.frame.data(), cached.frame.size()));
+        ++failures;
+      }
+    }
+
+    return failures ? 1 : 0;
+  }
+
+  int batchMain(const Options& options)
+  {
+    BatchResult result;
+
+    if (!options.scaling)
+      return runBatch(options, options.threads, true, result) ? 0 : 1;
+
+    const size_t maximum = options.threads ? options.threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    std::vector<size_t> counts;
+    for (size_t threads = 1; threads < maximum; threads *= 2)
+      counts.push_back(threads);
+    counts.push_back(maximum);
+
+    printf("%8s %14s %10s %11s\n", "threads", "fps", "speedup", "efficiency");
+
+    double baseline = 0.0;
+    for (size_t threads : counts)
+    {
+      if (!runBatch(options, threads, false, result))
+        return 1;
+
+      if (threads == 1)
+        baseline = result.fps;
+
+      const double speedup = baseline > 0.0 ? result.fps / baseline : 0.0;
+      printf("%8zu %14.1f %9.2fx %10.1f%%\n", threads, result.fps, speedup, speedup * 100.0 / threads);
+    }
+
+    return 0;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const auto start = clock_type::now();
+
+  Options options;
+  if (!parse(argc, argv, options))
+  {
+    usage();
+    return 1;
+  }
+
+  if (!options.bench.empty())
+    return benchMain(options);
+
+  if (!options.roms.empty())
+    return romsMain(options);
+
+  if (options.check)
+    return checkMain();
+
+  if (options.batch)
+    return batchMain(options);
+
+  gb::GameBoy machine;
+  if (!machine.load(options.rom))
+  {
+    fprintf(stderr, "Unable to load %s\n", options.rom.c_str());
+    return 1;
+  }
+
+  machine.cpu().setBlockCache(options.blockCache);
+
+  gfx::FrameBuffer frame(gb::SCREEN_WIDTH, gb::SCREEN_HEIGHT);
+
+  FILE* audio = nullptr;
+  if (!options.audio.empty() && !(audio = fopen(options.audio.c_str(), "wb")))
+  {
+    fprintf(stderr, "Unable to open %s\n", options.audio.c_str());
+    return 1;
+  }
+
+  std::vector<float> samples(4096);
+  u64 audioSamples = 0;
+
+  const auto ready = clock_type::now();
+
+  for (u64 i = 0; i < options.frames; ++i)
+  {
+    machine.runFrame(frame);
+
+    if (audio)
+    {
+      size_t count;
+      while ((count = machine.readAudio(samples.data(), samples.size())) > 0)
+      {
+        fwrite(samples.data(), sizeof(float), count, audio);
+        audioSamples += count;
+      }
+    }
+
+    if (options.dumpEvery && (i + 1) % options.dumpEvery == 0)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "_%06llu.ppm", (unsigned long long)(i + 1));
+      writePPM(options.dumpPrefix + name, frame);
+    }
+  }
+
+  const auto end = clock_type::now();
+
+  if (audio)
+    fclose(audio);
+
+  if (!options.screenshot.empty() && !writePPM(options.screenshot, frame))
+    fprintf(stderr, "Unable to write %s\n", options.screenshot.c_str());
+
+  const double elapsed = millis(end - ready);
+  const double fps = elapsed > 0.0 ? options.frames * 1000.0 / elapsed : 0.0;
+
+  printf("startup: %.2f ms\n", millis(ready - start));
+  printf("frames: %llu in %.2f ms, %.1f fps (%.2fx realtime)\n", (unsigned long long)options.frames, elapsed, fps, fps / machine.frameRate());
+  printf("cpu: %llu instructions, %.2f emulated MHz\n", (unsigned long long)machine.cpu().instructions(), elapsed > 0.0 ? machine.scheduler().now() / (elapsed * 1000.0) : 0.0);
+  const auto cpu = machine.cpuStats();
+  if (machine.scheduler().now())
+    printf("skipped: %.2f%% of cycles (%llu halted, %llu idle loop)\n", (cpu.haltedCycles + cpu.idleCycles) * 100.0 / machine.scheduler().now(),
+      (unsigned long long)cpu.haltedCycles, (unsigned long long)cpu.idleCycles);
+  if (options.blockCache)
+  {
+    const auto& cache = machine.cpu().blockCache().stats();
+    const u64 instructions = machine.cpu().instructions();
+    printf("block cache: %.2f%% hit rate (%llu hits, %llu misses), %.2f%% of instructions cached, %llu invalidations\n",
+      cache.hitRate() * 100.0, (unsigned long long)cache.hits, (unsigned long long)cache.misses,
+      instructions ? machine.cpu().cachedInstructions() * 100.0 / instructions : 0.0, (unsigned long long)cache.invalidations);
+  }
+  if (options.serial)
+    printf("serial: %s\n", machine.io().serial().c_str());
+  if (audio)
+    printf("audio: %llu samples at %.0f Hz (raw f32 mono)\n", (unsigned long long)audioSamples, machine.audioRate());
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "SDL.h"
 
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <string>
@@ -13,272 +14,172 @@
 #include <algorithm>
 
 #include "common.h"
-#include "devices/component.h"
+#include "devices/machine.h"
+#include "devices/runner.h"
+#include "gfx/indexed_frame_buffer.h"
+#include "sounds/blip_buffer.h"
+#include "sounds/generators.h"
+#include "sounds/resampler.h"
 
 #include "ui/window.h"
 #include "ui/frame_window.h"
 
-namespace devices
+/* test tone of the demo machine, written by the UI thread and read by the emulation thread once per frame */
+struct ToneSettings
 {
-  struct Machine
-  {
-  protected:
-    Bus _bus;
-    std::vector<std::unique_ptr<Component>> _devices;
-
-  public:
-    template<typename T, typename... Args>
-    T* add(Args&&... args) {
-      auto device = std::make_unique<T>(std::forward<Args>(args)...);
-      T* raw = device.get();
-      _devices.push_back(std::move(device));
-      return raw;
-    }
-
-    auto& bus() { return _bus; }
-  };
-}
+  std::atomic<sounds::Waveform> waveform { sounds::Waveform::Square };
+  std::atomic<float> frequency { 440.0_hz };
+  std::atomic<bool> bandLimited { true };
+};
 
-namespace structures
+/* placeholder machine until a real one is wired in, scrolls a star field and plays a test tone */
+struct DemoMachine : public devices::Machine
 {
-  template<typename T, size_t N>
-  struct RingBuffer
-  {
-    static_assert((N& (N - 1)) == 0, "N must be power of two");
-
-  private:
-    std::array<T, N> buffer{};
-    size_t head = 0;
-    size_t tail = 0;
+public:
+  static constexpr float AUDIO_RATE = 44100.0f;
 
-    size_t mask() const { return N - 1; }
+protected:
+  struct Star { int x; int y; int layer; };
+  std::vector<Star> _stars;
 
-  public:
+  /* black plus a shade for each star layer */
+  gfx::IndexedFrameBuffer _screen;
 
-    bool empty() const { return head == tail; }
-    bool full() const { return ((head + 1) & mask()) == tail; }
-    size_t size() const { return (head - tail) & mask(); }
-    size_t capacity() const { return N - 1; }
+  ToneSettings _tone;
+  sounds::SimpleWaveGenerator _generator;
+  sounds::Resampler _resampler;
+  sounds::BlipBuffer _blip;
+  /* host rate samples of the last frame not read yet, and what's owed to the next frame */
+  std::vector<float> _audio;
+  size_t _audioRead;
+  double _audioDebt;
 
-    void push(const T& value)
-    {
-      assert(!full());
-      buffer[head] = value;
-      head = (head + 1) & mask();
-    }
+  void produceAudio();
 
-    void push(T&& value)
-    {
-      assert(!full());
-      buffer[head] = std::move(value);
-      head = (head + 1) & mask();
-    }
+public:
+  DemoMachine(int width, int height) : _screen(width, height), _generator(sounds::Waveform::Square, 440.0_hz, 1.0_mhz),
+    _resampler(1.0_mhz, AUDIO_RATE), _blip(1.0_mhz, AUDIO_RATE), _audioRead(0), _audioDebt(0.0)
+  {
+    auto* ram = add<devices::Ram>(0x10000); // 64KB RAM
+    _bus.map(ram, 0x0000, 0xFFFF);
 
-    void push(const T* values, size_t count) {
-      assert(count <= capacity() - size());
+    _screen.setColor(0, gfx::Pixel(0, 0, 0, 255));
+    for (int layer = 0; layer < 3; ++layer)
+      _screen.setColor(uint8_t(layer + 1), gfx::Pixel(255 - layer * 80, 255 - layer * 80, 255 - layer * 80, 255));
+  }
 
-      size_t space_to_end = N - head;
-      if (count <= space_to_end) {
-        std::copy(values, values + count, buffer.begin() + head);
-      }
-      else {
-        std::copy(values, values + space_to_end, buffer.begin() + head);
-        std::copy(values + space_to_end, values + count, buffer.begin());
-      }
-      head = (head + count) & mask();
-    }
+  void runFrame(gfx::FrameBuffer& frame) override
+  {
+    _screen.fill(0);
 
-    T pop()
+    if (_stars.empty())
     {
-      assert(!empty());
-      T value = std::move(buffer[tail]);
-      tail = (tail + 1) & mask();
-      return value;
+      for (size_t i = 0; i < 100; ++i)
+        _stars.push_back({ rand() % _screen.width(), rand() % _screen.height(), rand() % 3 });
     }
 
-    void pop(T* out, size_t count)
+    /* update stars */
+    for (auto& star : _stars)
     {
-      assert(count <= size());
-
-      size_t space_to_end = N - tail;
-      if (count <= space_to_end) {
-        std::copy(buffer.begin() + tail, buffer.begin() + tail + count, out);
-      }
-      else {
-        std::copy(buffer.begin() + tail, buffer.end(), out);
-        std::copy(buffer.begin(), buffer.begin() + (count - space_to_end), out + space_to_end);
+      star.x -= star.layer + 1;
+      if (star.x < 0)
+      {
+        star.x = _screen.width() - 1;
+        star.y = rand() % _screen.height();
       }
-      tail = (tail + count) & mask();
     }
 
-    void clear()
-    {
-      head = tail = 0;
-    }
-  };
-}
-
-namespace sounds
-{
-  struct WaveGenerator
-  {
-  protected:
-    float _frequency;
-    float _clock;
-    float _phase;
-
-  public:
-    WaveGenerator(float frequency = 440.0_hz, float clock = 1.0_mhz) : _frequency(frequency), _clock(clock), _phase(0.0f) { }
-    float clock() const { return _clock; }
-  };
-  
-  struct SquareWaveGenerator : public WaveGenerator
-  {
-  protected:
-    float _duty;
-
-  public:
-    SquareWaveGenerator(float frequency = 440.0f) : WaveGenerator(frequency), _duty(0.5f) { }
-
-    void setDuty(float duty) { _duty = std::clamp(duty, 0.0f, 1.0f); }
+    /* draw stars */
+    for (const auto& star : _stars)
+      _screen.set(star.x, star.y, uint8_t(star.layer + 1));
 
-    float next()
-    {
-      /* increment by a clock cycle */
-      _phase += _frequency / _clock;
-      if (_phase >= 1.0f)
-        _phase -= 1.0f;
+    _screen.expand(frame);
 
-      return _phase < _duty ? 1.0f : -1.0f; // Return high or low based on phase
-    }
-  };
+    produceAudio();
+  }
 
-  struct TriangleWaveGenerator : public WaveGenerator
+  size_t readAudio(float* out, size_t count) override
   {
-  public:
-    TriangleWaveGenerator(float frequency = 440.0f) : WaveGenerator(frequency) { }
-
-    float next()
-    {
-      /* increment by a clock cycle */
-      _phase += _frequency / _clock;
-      if (_phase >= 1.0f)
-        _phase -= 1.0f;
-
-      return 2.0f * std::abs(_phase - 0.5f) - 1.0f; // Return triangle wave value
-    }
-  };
+    count = std::min(count, _audio.size() - _audioRead);
+    std::copy(_audio.begin() + _audioRead, _audio.begin() + _audioRead + count, out);
+    _audioRead += count;
+    return count;
+  }
 
-  enum class Waveform { Square, Triangle, Sawtooth, Sine };
+  float audioRate() const override { return AUDIO_RATE; }
 
-  class SimpleWaveGenerator : public WaveGenerator
-  {
-    Waveform _type;
-
-  public:
-    SimpleWaveGenerator(Waveform type, float frequency, float clock = 1.0_mhz) 
-      : WaveGenerator(frequency, clock), _type(type) { }
+  ToneSettings& tone() { return _tone; }
+};
 
-    void waveform(Waveform type) { _type = type; }
-    void frequency(float frequency) { _frequency = frequency; }
+/* one frame worth of samples, carrying the fraction over */
+void DemoMachine::produceAudio()
+{
+  _audioDebt += AUDIO_RATE / frameRate();
+  const size_t samples = size_t(_audioDebt);
+  _audioDebt -= samples;
 
-    float next()
-    {
-      _phase += _frequency / _clock;
-      if (_phase >= 1.0f) _phase -= 1.0f;
+  _audio.resize(samples);
+  _audioRead = 0;
 
-      switch (_type)
-      {
-        case Waveform::Square: return (_phase < 0.5f) ? 1.0f : -1.0f;
-        case Waveform::Sawtooth: return 2.0f * _phase - 1.0f;
-        case Waveform::Triangle: return (_phase < 0.5f) ? (4.0f * _phase - 1.0f) : (3.0f - 4.0f * _phase);
-        case Waveform::Sine: return std::sinf(2.0f * M_PI * _phase);
-      }
+  _generator.waveform(_tone.waveform.load(std::memory_order_relaxed));
+  _generator.frequency(_tone.frequency.load(std::memory_order_relaxed));
+  _resampler.setRates(_generator.clock(), AUDIO_RATE);
+  _blip.setRates(_generator.clock(), AUDIO_RATE);
 
-      return 0.0f;
-    }
-  };
+  size_t count = 0;
 
-  struct NoiseGenerator : public WaveGenerator
+  if (_tone.bandLimited.load(std::memory_order_relaxed))
   {
-  protected:
-    uint32_t lfsr = 0x7FFFFF;
-
-  public:
-    NoiseGenerator(float clock = 1.0_mhz) : WaveGenerator(0.0f, clock) { }
-
-    float next()
-    {
-      // XOR taps at bit 22 and 17
-      uint32_t new_bit = ((lfsr >> 22) ^ (lfsr >> 17)) & 1;
-      lfsr = ((lfsr << 1) | new_bit) & 0x7FFFFF;
-      uint8_t value = (lfsr >> 15) & 0xFF;
-
-      return (value / 2.0f) - 1.0f;
-    }
-  };
+    /* only the edges over the clocks covering the frame, synthesized directly at the host rate */
+    u32 clocks = _blip.clocksNeeded(samples);
+    _generator.synthesize(_blip, clocks);
+    _blip.endFrame(clocks);
 
-  namespace filters
+    count = _blip.read(_audio.data(), samples);
+  }
+  else
   {
-    class LowPassFilter
-    {
-    protected:
-      float _cutoff;
-      float _sampleRate;
-      float _alpha;
-      float _prevOutput;
-
-    public:
-      LowPassFilter(float cutoff, float sampleRate) :
-        _cutoff(cutoff), _sampleRate(sampleRate), _prevOutput(0.0f)
-      {
-        updateAlpha();
-      }
-
-      void updateAlpha()
-      {
-        float dt = 1.0f / _sampleRate;
-        float rc = 1.0f / (2.0f * M_PI * _cutoff);
-        _alpha = dt / (rc + dt);
-      }
+    /* generator clock samples for the whole frame, the resampler takes care of band limiting */
+    std::vector<float> input(_resampler.required(samples));
+    _generator.generate(input.data(), input.size());
+    _resampler.write(input.data(), input.size());
 
-      float process(float input)
-      {
-        float output = _prevOutput + (_alpha * (input - _prevOutput));
-        _prevOutput = output;
-        return output;
-      }
-    };
+    count = _resampler.read(_audio.data(), samples);
   }
-  
+
+  _audio.resize(count);
+  for (float& sample : _audio)
+    sample *= 0.05f;
 }
 
 struct Platform
 {
 protected:
   SDL_AudioDeviceID _audioDevice;
+
 public:
   Platform();
 
-  bool initAudio();
+  /* the device plays what the runner's emulation thread produced, at the machine rate */
+  bool initAudio(devices::Runner& runner);
   void closeAudio();
 
-  bool init();
+  bool init(devices::Runner& runner);
 
   static void audioCallback(void* userdata, uint8_t* stream, int len);
 };
 
 Platform::Platform() : _audioDevice(0) { }
 
-bool Platform::initAudio()
+bool Platform::initAudio(devices::Runner& runner)
 {
   SDL_AudioSpec want{}, have{};
-  want.freq = 44100;
+  want.freq = int(runner.audioRate());
   want.format = AUDIO_F32SYS;
   want.channels = 1;
   want.samples = 512;
   want.callback = audioCallback;
-  want.userdata = this;
+  want.userdata = &runner.audio();
 
   _audioDevice = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
   if (!_audioDevice)
@@ -298,7 +199,7 @@ void Platform::closeAudio()
     SDL_CloseAudioDevice(_audioDevice);
 }
 
-bool Platform::init()
+bool Platform::init(devices::Runner& runner)
 {
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO) != 0)
   {
@@ -310,7 +211,7 @@ bool Platform::init()
   SDL_SetHint(SDL_HINT_IME_SHOW_UI, "1");
 #endif
 
-  return true || initAudio();
+  return true || initAudio(runner);
 }
 
 Platform platform;
@@ -332,21 +233,39 @@ namespace ui::windows
   class WaveGeneratorWindow
   {
   protected:
-    sounds::SimpleWaveGenerator _generator;    
     sounds::Waveform _waveform;
     float _frequency;
     float _volume;
+    bool _bandLimited;
 
   public:
-    WaveGeneratorWindow() : _generator(sounds::Waveform::Square, 440.0_hz, 1.0_mhz),
-      _waveform(sounds::Waveform::Square), _frequency(440.0_hz), _volume(0.5f)
+    WaveGeneratorWindow() : _waveform(sounds::Waveform::Square), _frequency(440.0_hz), _volume(0.5f), _bandLimited(true)
     {
     
     }
 
-    void render();
-    float clock() const { return _generator.clock(); }
-    float next() { return _generator.next(); }
+    /* the tone itself is synthesized by the machine on the emulation thread */
+    void render(ToneSettings& tone);
+  };
+}
+
+namespace ui::windows
+{
+  class EmulationWindow
+  {
+  protected:
+    float _speed;
+    bool _fastForward;
+    bool _paused;
+
+    uint64_t _lastFrameCount;
+    double _lastTime;
+    float _fps;
+
+  public:
+    EmulationWindow() : _speed(1.0f), _fastForward(false), _paused(false), _lastFrameCount(0), _lastTime(0.0), _fps(0.0f) { }
+
+    void render(devices::Runner& runner);
   };
 }
 
@@ -357,13 +276,14 @@ namespace ui
     struct
     {
       ui::windows::WaveGeneratorWindow waveGenerator;
+      ui::windows::EmulationWindow emulation;
     } windows;
 
     ui::WindowManager manager;
   };
 }
 
-void ui::windows::WaveGeneratorWindow::render()
+void ui::windows::WaveGeneratorWindow::render(ToneSettings& tone)
 {
   ImGui::Begin("Waveform Controls");
 
@@ -373,7 +293,6 @@ void ui::windows::WaveGeneratorWindow::render()
   ImGui::RadioButton("Triangle", _waveform, sounds::Waveform::Triangle);
   ImGui::RadioButton("Sawtooth", _waveform, sounds::Waveform::Sawtooth);
   ImGui::RadioButton("Sine", _waveform, sounds::Waveform::Sine);
-  _generator.waveform(_waveform);
 
   ImGui::Spacing();
   ImGui::Text("Frequency(Hz)");
@@ -382,52 +301,54 @@ void ui::windows::WaveGeneratorWindow::render()
   ImGui::InputFloat("##freqText", &_frequency, 20.0f, 20000.0f, "%.1f");
 
   ImGui::SliderFloat("Volume", &_volume, 0.0f, 1.0f, "%.2f");
-  _generator.frequency(_frequency);
+  ImGui::Checkbox("Band limited steps", &_bandLimited);
+
+  tone.waveform.store(_waveform, std::memory_order_relaxed);
+  tone.frequency.store(_frequency, std::memory_order_relaxed);
+  tone.bandLimited.store(_bandLimited, std::memory_order_relaxed);
 
   ImGui::End();
 }
 
-ui::UI gui;
+void ui::windows::EmulationWindow::render(devices::Runner& runner)
+{
+  /* emulated frames per second, refreshed twice a second */
+  const double now = ImGui::GetTime();
+  if (now - _lastTime >= 0.5)
+  {
+    uint64_t frames = runner.frameCount();
+    _fps = float((frames - _lastFrameCount) / (now - _lastTime));
+    _lastFrameCount = frames;
+    _lastTime = now;
+  }
 
+  ImGui::Begin("Emulation");
 
-structures::RingBuffer<float, 1024 * 1024> buffer;
-sounds::filters::LowPassFilter filter(4.0_khz, 44100.0f); // Low-pass filter with 1kHz cutoff
+  ImGui::Text("Emulated: %.1f fps", _fps);
+  ImGui::Text("UI: %.1f fps", ImGui::GetIO().Framerate);
 
-void Platform::audioCallback(void* userdata, uint8_t* data, int len)
-{
-  memset(data, 0, len);
-  return;
-  
-  float* stream = reinterpret_cast<float*>(data);
-  len /= sizeof(float);
+  if (ImGui::Checkbox("Pause", &_paused))
+    runner.pause(_paused);
+  if (ImGui::Checkbox("Fast forward", &_fastForward))
+    runner.fastForward(_fastForward);
+  if (ImGui::SliderFloat("Speed", &_speed, 0.25f, 8.0f, "%.2fx"))
+    runner.setSpeed(_speed);
 
-  float downsampleRatio = gui.windows.waveGenerator.clock() / 44100.0f;
-  const size_t requiredSamples = static_cast<size_t>(len * downsampleRatio) + 1;
+  ImGui::End();
+}
 
-  /* generate samples */
-  for (size_t i = 0; i < requiredSamples; ++i)
-  {
-    float sample = gui.windows.waveGenerator.next();
-    buffer.push(sample);
-  }
+ui::UI gui;
 
-  float cursor = 0.0f;
-  for (int i = 0; i < len; ++i)
-  {
-    float acc = 0.0f;
-    int count = 0;
 
-    while (cursor < 1.0f)
-    {
-      acc += buffer.pop();
-      count++;
-      cursor += 1.0f / downsampleRatio;
-    }
+void Platform::audioCallback(void* userdata, uint8_t* data, int len)
+{
+  auto& audio = *static_cast<devices::Runner::Audio*>(userdata);
+  float* stream = reinterpret_cast<float*>(data);
+  len /= sizeof(float);
 
-    cursor -= 1.0f;
-    stream[i] = (acc / static_cast<float>(count)) * 0.05f;
-    stream[i] = filter.process(stream[i]);
-  }
+  /* only copies out, anything missing means the emulation thread is late */
+  size_t count = audio.pop(stream, len);
+  std::fill(stream + count, stream + len, 0.0f);
 }
 
 SDL_Renderer* renderer = nullptr;
@@ -435,11 +356,10 @@ SDL_Renderer* renderer = nullptr;
 // Main code
 int main(int, char**)
 {
-  devices::Machine machine;
-  auto* ram = machine.add<devices::Ram>(0x10000); // 64KB RAM
-  machine.bus().map(ram, 0x0000, 0xFFFF);
+  DemoMachine machine(256, 256);
+  devices::Runner runner(machine, 256, 256);
   
-  platform.init();
+  platform.init(runner);
 
   // Create window with SDL_Renderer graphics context
   SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
@@ -496,10 +416,12 @@ int main(int, char**)
 
   SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 256, 256);
   
-  auto* frameWindow = new ui::FrameWindow("Framebuffer", 256, 256);
-  frameWindow->frameBuffer()->fill(gfx::Pixel(255, 255, 0));
+  auto* frameWindow = new ui::FrameWindow("Framebuffer", runner.frames());
   gui.manager.add(frameWindow);
 
+  /* from here on the machine belongs to the emulation thread */
+  runner.start();
+
   // Main loop
   bool done = false;
   while (!done)
@@ -615,7 +537,8 @@ int main(int, char**)
       ImGui::End();
     }
 
-    gui.windows.waveGenerator.render();
+    gui.windows.waveGenerator.render(machine.tone());
+    gui.windows.emulation.render(runner);
 
     gui.manager.render();
 
@@ -628,6 +551,7 @@ int main(int, char**)
     SDL_RenderPresent(renderer);
   }
   
+  runner.stop();
   gui.manager.close();
 
   // Cleanup
@@ -0,0 +1,452 @@
+#include "apu.h"
+
+#include "base/simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace gb;
+
+namespace
+{
+  /* OR'ed to the value read back, write only and unused bits read as 1 */
+  constexpr u8 READ_MASKS[] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF,
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+    0xFF, 0xFF, 0x00, 0x00, 0xBF,
+    0x00, 0x00, 0x70
+  };
+
+  constexpr float DUTIES[] = { 0.125f, 0.25f, 0.5f, 0.75f };
+  constexpr u32 NOISE_DIVISORS[] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+
+  /* the output capacitor keeps 0.999958 of its charge each clock, a ~28Hz high pass */
+  float capacitorCutoff(float clockRate) { return float(-std::log(0.999958) * clockRate / (2.0 * 3.14159265358979323846)); }
+
+  /* ~185ms at 44.1kHz */
+  constexpr size_t MAX_BUFFERED = 8192;
+
+  /* out[i] = sum of gains[c] * channels[c][i] */
+  void mixChannels(float* out, const std::array<const float*, APU::CHANNELS>& channels, const std::array<float, APU::CHANNELS>& gains, size_t n)
+  {
+    size_t i = 0;
+
+#if SIMD_SSE2
+    const __m128 g0 = _mm_set1_ps(gains[0]), g1 = _mm_set1_ps(gains[1]), g2 = _mm_set1_ps(gains[2]), g3 = _mm_set1_ps(gains[3]);
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128 a = _mm_add_ps(_mm_mul_ps(g0, _mm_loadu_ps(channels[0] + i)), _mm_mul_ps(g1, _mm_loadu_ps(channels[1] + i)));
+      const __m128 b = _mm_add_ps(_mm_mul_ps(g2, _mm_loadu_ps(channels[2] + i)), _mm_mul_ps(g3, _mm_loadu_ps(channels[3] + i)));
+      _mm_storeu_ps(out + i, _mm_add_ps(a, b));
+    }
+#elif SIMD_NEON
+    for (; i + 4 <= n; i += 4)
+    {
+      float32x4_t acc = vmulq_n_f32(vld1q_f32(channels[0] + i), gains[0]);
+      acc = vmlaq_n_f32(acc, vld1q_f32(channels[1] + i), gains[1]);
+      acc = vmlaq_n_f32(acc, vld1q_f32(channels[2] + i), gains[2]);
+      acc = vmlaq_n_f32(acc, vld1q_f32(channels[3] + i), gains[3]);
+      vst1q_f32(out + i, acc);
+    }
+#endif
+
+    for (; i < n; ++i)
+      out[i] = gains[0] * channels[0][i] + gains[1] * channels[1][i] + gains[2] * channels[2][i] + gains[3] * channels[3][i];
+  }
+}
+
+void APU::Envelope::clock()
+{
+  if (!period || --timer)
+    return;
+
+  timer = period;
+  if (increase && volume < 15)
+    ++volume;
+  else if (!increase && volume > 0)
+    --volume;
+}
+
+APU::APU(devices::Scheduler& scheduler, float clockRate, float sampleRate) :
+  LazyDevice(scheduler), _clockRate(clockRate), _sampleRate(sampleRate),
+  _square{ Square(clockRate), Square(clockRate) }, _wave(clockRate), _noise(clockRate),
+  _blips{ sounds::BlipBuffer(clockRate, sampleRate), sounds::BlipBuffer(clockRate, sampleRate), sounds::BlipBuffer(clockRate, sampleRate), sounds::BlipBuffer(clockRate, sampleRate) },
+  _highPass(sounds::filters::Response::DcBlock, capacitorCutoff(clockRate), sampleRate)
+{
+  reset();
+}
+
+void APU::reset()
+{
+  restart();
+
+  _regs.fill(0);
+  _square = { Square(_clockRate), Square(_clockRate) };
+  _sweep = Sweep();
+  _wave = Wave(_clockRate);
+  _noise = Noise(_clockRate);
+
+  for (auto& blip : _blips)
+    blip.clear();
+  _highPass.reset();
+  _samples.clear();
+
+  /* state left by the boot ROM, minus its chime */
+  power(true);
+  write(NR50, 0x77);
+  write(NR51, 0xF3);
+  write(NR11, 0xBF);
+  write(NR12, 0xF3);
+}
+
+void APU::power(bool on)
+{
+  if (on == powered())
+    return;
+
+  if (on)
+  {
+    _regs[NR52] = 0x80;
+    _nextStep = _scheduler.now() + CYCLES_PER_STEP;
+    _step = 0;
+    return;
+  }
+
+  /* everything but wave RAM is cleared and can't be written until power comes back */
+  std::fill(_regs.begin() + NR10, _regs.begin() + WAVE_RAM, u8(0));
+  for (Square& square : _square)
+    static_cast<Channel&>(square) = Channel();
+  static_cast<Channel&>(_wave) = Channel();
+  static_cast<Channel&>(_noise) = Channel();
+  _sweep = Sweep();
+  decodeWave();
+}
+
+u8 APU::read(u8 reg)
+{
+  if (reg >= WAVE_RAM)
+    return _regs[reg];
+  else if (reg > NR52)
+    return 0xFF;
+
+  if (reg == NR52)
+  {
+    sync();
+    return _regs[NR52] | READ_MASKS[NR52 - NR10] |
+      (_square[0].active() ? 0x01 : 0) | (_square[1].active() ? 0x02 : 0) | (_wave.active() ? 0x04 : 0) | (_noise.active() ? 0x08 : 0);
+  }
+
+  return _regs[reg] | READ_MASKS[reg - NR10];
+}
+
+devices::cycle_t APU::stableUntil(u8 reg) const
+{
+  auto counting = [](const Channel& channel) { return channel.enabled && channel.lengthEnabled; };
+
+  if (reg != NR52 || !(counting(_square[0]) || counting(_square[1]) || counting(_wave) || counting(_noise) || (_square[0].enabled && _sweep.enabled)))
+    return devices::Scheduler::NEVER;
+
+  /* the first sequencer step after now, _nextStep may be behind if nothing synced for a while */
+  const devices::cycle_t now = _scheduler.now();
+  return now < _nextStep ? _nextStep : _nextStep + ((now - _nextStep) / CYCLES_PER_STEP + 1) * CYCLES_PER_STEP;
+}
+
+void APU::write(u8 reg, u8 value)
+{
+  /* the span so far plays with the old values */
+  sync();
+
+  if (reg >= WAVE_RAM)
+  {
+    _regs[reg] = value;
+    decodeWave();
+    return;
+  }
+  else if (reg == NR52)
+  {
+    power((value & 0x80) != 0);
+    return;
+  }
+  else if (!powered() || reg > NR52)
+    return;
+
+  _regs[reg] = value;
+
+  if (reg < NR30)
+    writeSquare(reg < NR21 - 1 ? 0 : 1, u8((reg - NR10) % 5), value);
+  else if (reg <= NR34)
+    writeWave(u8(reg - NR30), value);
+  else if (reg <= NR44)
+    writeNoise(u8(reg - NR41 + 1), value);
+}
+
+void APU::setFrequency(Square& square, u16 frequency)
+{
+  square.frequency = frequency;
+  square.generator.frequency(_clockRate / (32.0f * (2048 - frequency)));
+}
+
+/* reg is the offset in the channel registers, NRx0-NRx4 */
+void APU::writeSquare(size_t index, u8 reg, u8 value)
+{
+  Square& square = _square[index];
+
+  switch (reg)
+  {
+    case 1:
+      square.generator.setDuty(DUTIES[value >> 6]);
+      square.length = 64 - (value & 0x3F);
+      break;
+    case 2:
+      square.dac = (value & 0xF8) != 0;
+      square.enabled &= square.dac;
+      break;
+    case 3:
+      setFrequency(square, u16((square.frequency & 0x700) | value));
+      break;
+    case 4:
+    {
+      setFrequency(square, u16((square.frequency & 0xFF) | ((value & 0x07) << 8)));
+      square.lengthEnabled = (value & 0x40) != 0;
+
+      if (value & 0x80)
+      {
+        square.enabled = square.dac;
+        if (!square.length)
+          square.length = 64;
+        square.envelope.trigger(_regs[NR12 + index * 5]);
+
+        if (index == 0)
+        {
+          const u8 period = (_regs[NR10] >> 4) & 0x07, shift = _regs[NR10] & 0x07;
+          _sweep.shadow = square.frequency;
+          _sweep.timer = period ? period : 8;
+          _sweep.enabled = period || shift;
+
+          if (shift && sweepTarget() > 2047)
+            square.enabled = false;
+        }
+      }
+      break;
+    }
+    default: break;
+  }
+}
+
+void APU::writeWave(u8 reg, u8 value)
+{
+  switch (reg)
+  {
+    case 0:
+      _wave.dac = (value & 0x80) != 0;
+      _wave.enabled &= _wave.dac;
+      break;
+    case 1: _wave.length = 256 - value; break;
+    case 2: decodeWave(); break;
+    case 3: case 4:
+    {
+      _wave.frequency = u16(((_regs[NR34] & 0x07) << 8) | _regs[NR33]);
+      /* 2 cycles per sample, 32 samples */
+      _wave.generator.frequency(_clockRate / (64.0f * (2048 - _wave.frequency)));
+
+      if (reg == 4)
+      {
+        _wave.lengthEnabled = (value & 0x40) != 0;
+
+        if (value & 0x80)
+        {
+          _wave.enabled = _wave.dac;
+          if (!_wave.length)
+            _wave.length = 256;
+          _wave.generator.resetPhase();
+        }
+      }
+      break;
+    }
+    default: break;
+  }
+}
+
+void APU::writeNoise(u8 reg, u8 value)
+{
+  switch (reg)
+  {
+    case 1: _noise.length = 64 - (value & 0x3F); break;
+    case 2:
+      _noise.dac = (value & 0xF8) != 0;
+      _noise.enabled &= _noise.dac;
+      break;
+    case 3:
+    {
+      /* shifts 14 and 15 don't clock the register at all */
+      const u8 shift = value >> 4;
+      _noise.generator.frequency(shift >= 14 ? 0.0f : _clockRate / float(NOISE_DIVISORS[value & 0x07] << shift));
+      _noise.generator.setWidth((value & 0x08) ? 7 : 15);
+      break;
+    }
+    case 4:
+      _noise.lengthEnabled = (value & 0x40) != 0;
+
+      if (value & 0x80)
+      {
+        _noise.enabled = _noise.dac;
+        if (!_noise.length)
+          _noise.length = 64;
+        _noise.envelope.trigger(_regs[NR42]);
+        _noise.generator.restart();
+      }
+      break;
+    default: break;
+  }
+}
+
+void APU::decodeWave()
+{
+  /* NR32 shifts the 4 bit samples right by 0-2 (or mutes them), kept centered on the range left */
+  const u8 code = (_regs[NR32] >> 5) & 0x03;
+
+  for (size_t i = 0; i < 32; ++i)
+  {
+    const u8 byte = _regs[WAVE_RAM + i / 2];
+    const u8 sample = (i & 1) ? (byte & 0x0F) : (byte >> 4);
+
+    _wave.generator.set(i, code ? ((sample >> (code - 1)) - (15 >> (code - 1)) / 2.0f) / 7.5f : 0.0f);
+  }
+}
+
+u16 APU::sweepTarget() const
+{
+  const u16 delta = _sweep.shadow >> (_regs[NR10] & 0x07);
+  return (_regs[NR10] & 0x08) ? u16(_sweep.shadow - delta) : u16(_sweep.shadow + delta);
+}
+
+void APU::clockSweep()
+{
+  if (!_sweep.timer || --_sweep.timer)
+    return;
+
+  const u8 period = (_regs[NR10] >> 4) & 0x07, shift = _regs[NR10] & 0x07;
+  _sweep.timer = period ? period : 8;
+
+  if (!_sweep.enabled || !period)
+    return;
+
+  const u16 target = sweepTarget();
+  if (target > 2047)
+    _square[0].enabled = false;
+  else if (shift)
+  {
+    /* the new frequency is written back to NR13/NR14 and checked once more */
+    _sweep.shadow = target;
+    setFrequency(_square[0], target);
+    _regs[NR13] = u8(target);
+    _regs[NR14] = u8((_regs[NR14] & ~0x07) | (target >> 8));
+
+    if (sweepTarget() > 2047)
+      _square[0].enabled = false;
+  }
+}
+
+void APU::stepSequencer()
+{
+  /* lengths on even steps, sweep on 2 and 6, envelopes on 7 */
+  if (!(_step & 1))
+  {
+    _square[0].clockLength();
+    _square[1].clockLength();
+    _wave.clockLength();
+    _noise.clockLength();
+  }
+
+  if (_step == 2 || _step == 6)
+    clockSweep();
+
+  if (_step == 7)
+  {
+    _square[0].envelope.clock();
+    _square[1].envelope.clock();
+    _noise.envelope.clock();
+  }
+
+  _step = (_step + 1) & 7;
+}
+
+void APU::catchUp(devices::cycle_t from, devices::cycle_t to)
+{
+  /* envelopes, lengths and the sweep only change at sequencer steps, the spans between are synthesized at once */
+  for (devices::cycle_t time = from; time < to; )
+  {
+    const devices::cycle_t end = std::min(to, _nextStep);
+    synthesize(u32(end - time));
+    time = end;
+
+    if (time == _nextStep)
+    {
+      stepSequencer();
+      _nextStep += CYCLES_PER_STEP;
+    }
+  }
+
+  mix();
+}
+
+void APU::synthesize(u32 clocks)
+{
+  _square[0].generator.setAmplitude(_square[0].active() ? _square[0].envelope.volume / 15.0f : 0.0f);
+  _square[1].generator.setAmplitude(_square[1].active() ? _square[1].envelope.volume / 15.0f : 0.0f);
+  _wave.generator.setAmplitude(_wave.active() ? 1.0f : 0.0f);
+  _noise.generator.setAmplitude(_noise.active() ? _noise.envelope.volume / 15.0f : 0.0f);
+
+  _square[0].generator.synthesize(_blips[0], clocks);
+  _square[1].generator.synthesize(_blips[1], clocks);
+  _wave.generator.synthesize(_blips[2], clocks);
+  _noise.generator.synthesize(_blips[3], clocks);
+
+  for (auto& blip : _blips)
+    blip.endFrame(clocks);
+}
+
+void APU::mix()
+{
+  /* every blip went through the same frames, they have the same number of samples ready */
+  const size_t count = _blips[0].samplesAvailable();
+  if (!count)
+    return;
+
+  std::array<const float*, CHANNELS> channels;
+  for (size_t c = 0; c < CHANNELS; ++c)
+  {
+    _blocks[c].resize(count);
+    _blips[c].read(_blocks[c].data(), count);
+    channels[c] = _blocks[c].data();
+  }
+
+  /* NR51 routes each channel to the left (high nibble) and right terminals, NR50 sets their volume (1-8) */
+  std::array<float, CHANNELS> gains;
+  const u8 left = ((_regs[NR50] >> 4) & 0x07) + 1, right = (_regs[NR50] & 0x07) + 1;
+  for (size_t c = 0; c < CHANNELS; ++c)
+  {
+    const u8 level = ((_regs[NR51] >> (c + 4)) & 1) * left + ((_regs[NR51] >> c) & 1) * right;
+    gains[c] = powered() ? level / (16.0f * CHANNELS) : 0.0f;
+  }
+
+  const size_t offset = _samples.size();
+  _samples.resize(offset + count);
+  mixChannels(&_samples[offset], channels, gains, count);
+  _highPass.process(&_samples[offset], count);
+
+  if (_samples.size() > MAX_BUFFERED)
+    _samples.erase(_samples.begin(), _samples.end() - MAX_BUFFERED);
+}
+
+size_t APU::readAudio(float* out, size_t count)
+{
+  sync();
+
+  count = std::min(count, _samples.size());
+  std::copy(_samples.begin(), _samples.begin() + count, out);
+  _samples.erase(_samples.begin(), _samples.begin() + count);
+
+  return count;
+}
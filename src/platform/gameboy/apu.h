@@ -0,0 +1,175 @@
+#pragma once
+
+#include "common.h"
+#include "devices/component.h"
+#include "devices/lazy_device.h"
+#include "sounds/blip_buffer.h"
+#include "sounds/filters.h"
+#include "sounds/generators.h"
+
+#include <array>
+#include <vector>
+
+namespace gb
+{
+  /*
+    DMG APU: two pulse channels (the first one with a frequency sweep), a wave channel playing the 32
+    samples of wave RAM and a noise channel, with their length counters and volume envelopes clocked
+    by the 512Hz frame sequencer.
+
+    Nothing is ticked per cycle: the channels are sounds:: generators which report their edges to a
+    BlipBuffer each, and they are brought up to date when a register is about to change or samples
+    are requested. A catch up is split at frame sequencer steps, then the four channel blocks are read
+    at the host rate and mixed with the NR50/NR51 gains in a single pass, then go through the high
+    pass of the output capacitor.
+
+    Output is mono. Obscure behaviors (zombie mode, extra length clocks on trigger, wave RAM access
+    while playing) are not emulated.
+  */
+  class APU : public devices::Component, public devices::LazyDevice
+  {
+  public:
+    enum : u8
+    {
+      NR10 = 0x10,
+      NR11 = 0x11,
+      NR12 = 0x12,
+      NR13 = 0x13,
+      NR14 = 0x14,
+      NR21 = 0x16,
+      NR22 = 0x17,
+      NR23 = 0x18,
+      NR24 = 0x19,
+      NR30 = 0x1A,
+      NR31 = 0x1B,
+      NR32 = 0x1C,
+      NR33 = 0x1D,
+      NR34 = 0x1E,
+      NR41 = 0x20,
+      NR42 = 0x21,
+      NR43 = 0x22,
+      NR44 = 0x23,
+      NR50 = 0x24,
+      NR51 = 0x25,
+      NR52 = 0x26,
+
+      WAVE_RAM = 0x30,
+      WAVE_RAM_END = 0x3F
+    };
+
+    static constexpr size_t CHANNELS = 4;
+    /* frame sequencer period, 512Hz */
+    static constexpr u32 CYCLES_PER_STEP = 8192;
+
+  protected:
+    struct Envelope
+    {
+      u8 volume = 0;
+      u8 period = 0;
+      u8 timer = 0;
+      bool increase = false;
+
+      void trigger(u8 nrx2) { volume = nrx2 >> 4; increase = (nrx2 & 0x08) != 0; period = timer = nrx2 & 0x07; }
+      void clock();
+    };
+
+    struct Channel
+    {
+      bool enabled = false;
+      bool dac = false;
+      bool lengthEnabled = false;
+      u16 length = 0;
+
+      bool active() const { return enabled && dac; }
+      void clockLength() { if (lengthEnabled && length && !--length) enabled = false; }
+    };
+
+    struct Square : public Channel
+    {
+      sounds::SquareWaveGenerator generator;
+      Envelope envelope;
+      u16 frequency = 0;
+
+      Square(float clockRate) : generator(0.0f, clockRate) { }
+    };
+
+    struct Wave : public Channel
+    {
+      sounds::TableWaveGenerator generator;
+      u16 frequency = 0;
+
+      Wave(float clockRate) : generator(32, clockRate) { }
+    };
+
+    struct Noise : public Channel
+    {
+      sounds::NoiseGenerator generator;
+      Envelope envelope;
+
+      Noise(float clockRate) : generator(clockRate) { }
+    };
+
+    /* channel 1 only, period/direction/shift are read from NR10 */
+    struct Sweep
+    {
+      u16 shadow = 0;
+      u8 timer = 0;
+      bool enabled = false;
+    };
+
+    float _clockRate;
+    float _sampleRate;
+
+    /* 0x10-0x3F as last written, indexed by register */
+    std::array<u8, 0x40> _regs;
+
+    std::array<Square, 2> _square;
+    Sweep _sweep;
+    Wave _wave;
+    Noise _noise;
+
+    /* next frame sequencer step and its index (0-7) */
+    devices::cycle_t _nextStep;
+    u8 _step;
+
+    std::array<sounds::BlipBuffer, CHANNELS> _blips;
+    std::array<std::vector<float>, CHANNELS> _blocks;
+    sounds::filters::Biquad _highPass;
+    /* mixed samples not read yet, the oldest are dropped when nobody reads them */
+    std::vector<float> _samples;
+
+    bool powered() const { return (_regs[NR52] & 0x80) != 0; }
+
+    void catchUp(devices::cycle_t from, devices::cycle_t to) override;
+    void synthesize(u32 clocks);
+    void mix();
+
+    void stepSequencer();
+    void clockSweep();
+    u16 sweepTarget() const;
+
+    void setFrequency(Square& square, u16 frequency);
+    void writeSquare(size_t index, u8 reg, u8 value);
+    void writeWave(u8 reg, u8 value);
+    void writeNoise(u8 reg, u8 value);
+    void decodeWave();
+    void power(bool on);
+
+  public:
+    APU(devices::Scheduler& scheduler, float clockRate, float sampleRate);
+
+    std::string name() const override { return "APU"; }
+
+    void reset();
+
+    /* NR52 reports the channels still playing, so reads catch up first */
+    u8 read(u8 reg);
+    void write(u8 reg, u8 value);
+    /* see devices::Memory::stableUntil(), NR52 changes when a length counter or the sweep stops a channel */
+    devices::cycle_t stableUntil(u8 reg) const;
+
+    float sampleRate() const { return _sampleRate; }
+    /* mono samples at sampleRate() up to the current cycle, returns how many were copied */
+    size_t readAudio(float* out, size_t count);
+  };
+}
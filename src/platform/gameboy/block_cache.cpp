@@ -0,0 +1,219 @@
+#include "block_cache.h"
+
+#include "cpu.h"
+
+#include <algorithm>
+
+using namespace gb;
+
+namespace
+{
+  /* instructions which only touch registers or read memory */
+  constexpr bool pure(u8 opcode, u8 next)
+  {
+    const u8 x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7, p = y >> 1, q = y & 1;
+    
+    if (x == 0)
+    {
+      switch (z)
+      {
+        case 0: return y == 0;
+        case 1: return true;
+        case 2: return q == 1 && p < 2;
+        case 3: return true;
+        case 4: case 5: case 6: return y != 6;
+        default: return true;
+      }
+    }
+    else if (x == 1)
+      return y != 6;
+    else if (x == 2)
+      return true;
+    else if (opcode == 0xCB)
+      return (next >> 6) == 1 || (next & 7) != 6;
+    
+    return opcode == 0xF0 || opcode == 0xF2 || opcode == 0xFA || z == 6;
+  }
+  
+  /*
+    fills block.reads for the ops of a block made of pure() ones, following which of B, C, D, E, H, L
+    (in opcode order) still hold their value from the block start, hold a constant loaded in the
+    block or something computed. False if a read goes through a computed register.
+  */
+  bool resolveReads(BlockCache::Block& block)
+  {
+    using Read = BlockCache::Read;
+    enum class Value : u8 { Entry, Known, Unknown };
+    
+    std::array<Value, 6> state;
+    std::array<u8, 6> value = { };
+    state.fill(Value::Entry);
+    
+    /* a read through the pair hi:lo, or just lo for the high page when hi is not a register */
+    auto through = [&](Read::Source source, int hi, int lo) {
+      const bool entry = state[lo] == Value::Entry && (hi < 0 || state[hi] == Value::Entry);
+      const bool known = state[lo] == Value::Known && (hi < 0 || state[hi] == Value::Known);
+      
+      if (entry)
+        block.reads.push_back({ source, 0 });
+      else if (known)
+        block.reads.push_back({ Read::Source::Fixed, u16((hi < 0 ? 0xFF : value[hi]) << 8 | value[lo]) });
+      
+      return entry || known;
+    };
+    
+    block.reads.clear();
+    
+    for (auto op = block.ops.begin(); op != block.ops.end() - 1; ++op)
+    {
+      const u8 opcode = op->opcode, next = op->operand[0];
+      const u8 x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7, p = y >> 1, q = y & 1;
+      
+      /* the read happens before the op writes anything */
+      bool resolved = true;
+      if (opcode == 0xF0) block.reads.push_back({ Read::Source::Fixed, u16(0xFF00 | next) });
+      else if (opcode == 0xFA) block.reads.push_back({ Read::Source::Fixed, u16(op->operand[1] << 8 | next) });
+      else if (opcode == 0xF2) resolved = through(Read::Source::C, -1, 1);
+      else if (opcode == 0x0A) resolved = through(Read::Source::BC, 0, 1);
+      else if (opcode == 0x1A) resolved = through(Read::Source::DE, 2, 3);
+      else if ((x == 1 && z == 6) || (x == 2 && z == 6) || (opcode == 0xCB && (next & 7) == 6)) resolved = through(Read::Source::HL, 4, 5);
+      
+      if (!resolved)
+        return false;
+      
+      if (x == 0 && z == 1 && q == 0 && p < 3)
+      {
+        /* LD rr,nn */
+        state[2 * p] = state[2 * p + 1] = Value::Known;
+        value[2 * p] = op->operand[1];
+        value[2 * p + 1] = next;
+      }
+      else if (x == 0 && z == 6 && y < 6)
+      {
+        /* LD r,n */
+        state[y] = Value::Known;
+        value[y] = next;
+      }
+      else if (x == 0 && z == 1 && q == 1)
+        state[4] = state[5] = Value::Unknown;
+      else if (x == 0 && z == 3 && p < 3)
+        state[2 * p] = state[2 * p + 1] = Value::Unknown;
+      else if ((x == 0 && (z == 4 || z == 5) && y < 6) || (x == 1 && y < 6))
+        state[y] = Value::Unknown;
+      else if (opcode == 0xCB && (next >> 6) != 1 && (next & 7) < 6)
+        state[next & 7] = Value::Unknown;
+    }
+    
+    return true;
+  }
+}
+
+BlockCache::BlockCache(devices::Bus& bus) : _bus(bus), _dirty(false), _stats({ 0, 0, 0, 0 })
+{
+  _recent.fill({ nullptr, nullptr });
+}
+
+void BlockCache::clear()
+{
+  _pages.clear();
+  _recent.fill({ nullptr, nullptr });
+  _dirty = true;
+}
+
+void BlockCache::invalidate(const u8* memory)
+{
+  auto it = _pages.find(memory);
+  if (it != _pages.end() && !it->second->stale)
+  {
+    it->second->stale = true;
+    ++_stats.invalidations;
+    _dirty = true;
+  }
+}
+
+const BlockCache::Block* BlockCache::lookup(u16 address)
+{
+  const u16 start = u16(address & ~devices::Bus::PAGE_MASK);
+  const u8* memory = _bus.memory(start);
+  
+  if (!memory)
+  {
+    ++_stats.uncached;
+    return nullptr;
+  }
+  
+  auto& recent = _recent[address >> devices::Bus::PAGE_BITS];
+  if (recent.first != memory)
+  {
+    auto& page = _pages[memory];
+    if (!page)
+      page = std::make_unique<Page>();
+    recent = { memory, page.get() };
+  }
+  
+  Page& page = *recent.second;
+  if (page.stale)
+  {
+    for (auto& block : page.blocks)
+      block.reset();
+    page.stale = false;
+  }
+  
+  auto& block = page.blocks[address & devices::Bus::PAGE_MASK];
+  if (block)
+    ++_stats.hits;
+  else
+  {
+    ++_stats.misses;
+    block = std::make_unique<Block>();
+    decode(*block, address, memory);
+    
+    /* code in RAM, any write to the page must drop its blocks */
+    _bus.watch(start);
+  }
+  
+  /* an instruction straddling the page end, left to the interpreter */
+  return block->ops.empty() ? nullptr : block.get();
+}
+
+void BlockCache::decode(Block& block, u16 address, const u8* memory)
+{
+  size_t offset = address & devices::Bus::PAGE_MASK;
+  
+  while (block.ops.size() < MAX_LENGTH)
+  {
+    const u8 opcode = memory[offset];
+    const u32 length = CPU::instructionLength(opcode);
+    
+    if (offset + length > devices::Bus::PAGE_SIZE)
+      break;
+    
+    Op op = { nullptr, { 0, 0 }, u8(length), opcode };
+    for (u32 i = 1; i < length; ++i)
+      op.operand[i - 1] = memory[offset + i];
+    
+    op.handler = CPU::handler(opcode, op.operand[0]);
+    block.ops.push_back(op);
+    
+    offset += length;
+    if (CPU::endsBlock(opcode))
+      break;
+  }
+  
+  if (block.ops.empty())
+    return;
+  
+  /* JR/JP (conditional or not) back to the start of the block */
+  const Op& last = block.ops.back();
+  const u16 next = u16((address & ~devices::Bus::PAGE_MASK) + offset);
+  
+  bool loops = false;
+  if (last.opcode == 0x18 || (last.opcode & 0xE7) == 0x20)
+    loops = u16(next + s8(last.operand[0])) == address;
+  else if (last.opcode == 0xC3 || (last.opcode & 0xE7) == 0xC2)
+    loops = u16(last.operand[1] << 8 | last.operand[0]) == address;
+  
+  block.idle = loops && std::all_of(block.ops.begin(), block.ops.end() - 1, [](const Op& op) { return pure(op.opcode, op.operand[0]); }) && resolveReads(block);
+  if (!block.idle)
+    block.reads.clear();
+}
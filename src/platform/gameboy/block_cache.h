@@ -0,0 +1,111 @@
+#pragma once
+
+#include "common.h"
+#include "devices/component.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace gb
+{
+  class CPU;
+  
+  /*
+    basic blocks of guest code decoded once into arrays of (handler, operands, length) so that
+    executing them skips fetching and decoding. Blocks are keyed by the host memory they were decoded
+    from, which for ROM is the (bank, address) pair: a bank switch just makes different blocks
+    visible and nothing has to be flushed. Code in RAM is watched on the bus and its blocks are
+    dropped when the page is written.
+    
+    A block never crosses a bus page and ends at the first instruction which can change PC
+    (or IME), at HALT/STOP, or after MAX_LENGTH instructions.
+    
+    Blocks made only of register operations and reads which end with a jump back to their own start
+    are marked idle: polling loops like "LDH A,(LY); CP 144; JR NZ" which the CPU can fast forward.
+    The addresses they read are resolved at decode: constant, loaded as a constant earlier in the
+    block, or taken from a register pair the block doesn't touch before the read. A block reading
+    through a register it computed is never idle.
+  */
+  class BlockCache
+  {
+  public:
+    static constexpr size_t MAX_LENGTH = 64;
+    
+    using Handler = u32(*)(CPU&);
+    
+    struct Op
+    {
+      Handler handler;
+      u8 operand[2];
+      u8 length;
+      u8 opcode;
+    };
+    
+    /* memory read by an idle block, at address or at the value a register pair has when the block starts */
+    struct Read
+    {
+      enum class Source : u8 { Fixed, BC, DE, HL, C };
+      
+      Source source;
+      u16 address;
+    };
+    
+    struct Block
+    {
+      std::vector<Op> ops;
+      /* no writes, no stack, no IME changes, last op branches back to the first */
+      bool idle = false;
+      /* only for idle blocks */
+      std::vector<Read> reads;
+    };
+    
+    struct Stats
+    {
+      u64 hits;
+      u64 misses;
+      /* lookups at addresses which are not plain memory, the interpreter runs them */
+      u64 uncached;
+      /* pages of blocks dropped because their memory was written or remapped */
+      u64 invalidations;
+      
+      double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+    };
+    
+  protected:
+    struct Page
+    {
+      std::array<std::unique_ptr<Block>, devices::Bus::PAGE_SIZE> blocks;
+      /* blocks are dropped on the next lookup, the CPU may still be running one of them */
+      bool stale = false;
+    };
+    
+    devices::Bus& _bus;
+    
+    /* by host memory of the page start */
+    std::unordered_map<const u8*, std::unique_ptr<Page>> _pages;
+    /* last page seen at each bus page, spares the hash lookup while execution stays around */
+    std::array<std::pair<const u8*, Page*>, devices::Bus::PAGE_COUNT> _recent;
+    
+    /* set when a page with blocks got invalidated, lets the CPU leave the block it is running */
+    bool _dirty;
+    
+    Stats _stats;
+    
+    void decode(Block& block, u16 address, const u8* memory);
+    
+  public:
+    BlockCache(devices::Bus& bus);
+    
+    /* block starting at address, nullptr if it can't be cached */
+    const Block* lookup(u16 address);
+    void invalidate(const u8* memory);
+    void clear();
+    
+    bool dirty() const { return _dirty; }
+    void clean() { _dirty = false; }
+    
+    const Stats& stats() const { return _stats; }
+  };
+}
@@ -1,8 +1,14 @@
 #include "cartridge.h"
+#include "mbc.h"
+
+#include "base/file_system.h"
+
+#include <algorithm>
+#include <bit>
 
 using namespace gb;
 
-Cartridge::Cartridge()
+Cartridge::Cartridge() : saveMode(SaveMode::MANUAL)
 {
   status.rom = nullptr;
   status.rom_bank_0 = nullptr;
@@ -13,239 +19,118 @@ Cartridge::Cartridge()
   
   status.rtc_override = false;
   status.ram_enabled = false;
+  status.rom_banking_mode = false;
   status.flags = 0;
   
   status.current_rom_bank = 1;
   status.current_ram_bank = 0;
+  
+  status.rom_banks = 2;
+  status.rom_bank_mask = 1;
+  status.ram_banks = 1;
+  status.ram_size = 0;
+  
+  bind<mbc::RomOnly>();
 }
 
-Cartridge::Cartridge(const path& fileName) : Cartridge()
+Cartridge::Cartridge(const path& fileName, SaveMode saveMode) : Cartridge()
 {
+  this->saveMode = saveMode;
   load(fileName);
 }
 
 Cartridge::~Cartridge()
 {
-  delete [] status.ram;
-  delete [] status.rom;
+  if (saveWriter)
+  {
+    SaveSync::i().remove(saveWriter.get());
+    saveWriter->flush();
+  }
+  
+  /* a mapped save is unmapped together with saveFile */
+  if (saveFile)
+  {
+    SaveSync::i().remove(&saveFile);
+    saveFile.sync(false);
+  }
+  else
+    free(status.ram);
+
+  /* a loaded ROM is owned by romImage */
+  if (!romImage)
+    free(status.rom);
   delete [] status.rtc;
 }
 
 /* scrive un byte nella ROM */
 void Cartridge::write(u16 address, u8 value)
 {
-#ifdef DEBUGGER
-	if ((status.flags & MBC_SIMPLE) == MBC_SIMPLE)
-    status.rom[address] = value;
-#endif
-  
-  if ((status.flags & MBC_MBC1) == MBC_MBC1)
-	{
-		/* this enables or less the RAM */
-		if (address <= 0x1FFF)
-		{	
-			if ((value & 0x0A) == 0x0A)
-				status.ram_enabled = true;
-			else
-				status.ram_enabled = false;
-		}
-    /* this switches ROM bank using 5 lower bits of data */
-		else if (address <= 0x3FFF)
-		{
-      // we select 5 lower bits of the value to set the lower part of the bank
-      u8 romBank = value & 0x1F;
-				
-			// if it's zero we should increment by one
-			if (romBank == 0)
-				++romBank;
-      
-      // if we are in ROM banking mode we should keep bit 5-6 from current bank
-      // because they are set by writing at 0x4000-0x5FFF
-      if (status.rom_banking_mode)
-        status.current_rom_bank = (status.current_rom_bank & 0x60) | romBank;
-      else
-        status.current_rom_bank = romBank;
-        
-			status.rom_bank_1 = &status.rom[16_kb*status.current_rom_bank];
-		}
-		// in this address space we can either select bit 5-6 for ROM banks or bank 0-3 for RAM
-    // according to current banking mode
-		else if (address <= 0x5FFF)
-		{
-			if (status.rom_banking_mode)
-			{
-        // we mix lower 5 bits of current rom bank with bit 5-6 of the value provided to select rom bank
-        status.current_rom_bank = (status.current_rom_bank & 0x1F) | (value & 0x60);
-        status.rom_bank_1 = &status.rom[16_kb*status.current_rom_bank];
-			}
-      else
-      {
-        status.current_ram_bank = value & 0x03;
-        status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
-      }
-		}
-		// switching from ROM banking to RAM banking
-		else if (address <= 0x7FFF)
-		{
-      status.rom_banking_mode = value & 0x01;
-			
-      // if we entered ROM banking mode we should restore
-      // ram bank to 0 since you cannot address anyone other
-			if (status.rom_banking_mode)
-      {
-        status.ram_bank = status.ram;
-        status.current_ram_bank = 0;
-      }
-		}
-    // RAM nella cart (più banchi switchabili nel caso, da 8kb l'uno)
-    else if (address >= 0xA000 && address <= 0xBFFF)
-    {
-      // scrive basandosi sull'offset nel banco di RAM selezionato
-      if (status.ram_enabled)
-        status.ram_bank[address - 0xA000] = value;
-    }
-	}
-  
-  
-  else if ((status.flags & MBC_MBC2) == MBC_MBC2)
-  {
-    /* this enables or less the RAM */
-		if (address <= 0x1FFF)
-		{	
-			if ((value & 0x0A) == 0x0A)
-				status.ram_enabled = true;
-			else
-				status.ram_enabled = false;
-		}
-    else if (address <= 0x3FFF)
-		{
-      u8 romBank = value & 0x0F;
-      
-      status.current_rom_bank = romBank;
-      status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
-    }
-    else if (address >= 0xA000 && address <= 0xA1FF)
-    {
-      // scrive basandosi sull'offset nel banco di RAM selezionato
-      if (status.ram_enabled)
-        status.ram_bank[address - 0xA000] = value;
-    }
-  }
-  
-  else if ((status.flags & MBC_MBC3) == MBC_MBC3)
-  {
-    /* this enables or less the RAM and the RTC */
-    if (address <= 0x1FFF)
-    {
-      if ((value & 0x0A) == 0x0A)
-        status.ram_enabled = true;
-      else
-        status.ram_enabled = false;
-    }
-    /* selects rom bank 01h to 7fh (7 bits) */
-    else if (address <= 0x3FFF)
-    {
-      u8 romBank = value & 0x7F;
-      
-      if (romBank == 0) romBank = 1;
-      
-      status.current_rom_bank = romBank;
-      status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
-    }
-    /* select RAM bank or RTC register */
-    else if (address >= 0x4000 && address <= 0x5FFF)
-    {
-      if (value < 0x04)
-      {
-        status.current_ram_bank = value & 0x0F;
-        status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
-        status.rtc_override = false;
-      }
-      else if (value >= 0x08 && value <= 0x0C)
-      {
-        /* selects RTC register and mark that writes/read will occur there */
-        rtc.select(value);
-        status.rtc_override = true;
-      }
-    }
-    /* RCT latch, this will freeze RTC registers until latched again */
-    else if (address >= 0x6000 && address <= 0x7FFF)
-    {
-      rtc.writeLatch(value);
-    }
-    else if (address >= 0xA000 && address <= 0xBFFF)
-    {
-      // scrive basandosi sull'offset nel banco di RAM selezionato
-      if (status.ram_enabled)
-      {
-        if (status.rtc_override)
-          rtc.writeData(value);
-        else
-          status.ram_bank[address - 0xA000] = value;
-      }
-    }
-    
-  }
+  (this->*_write)(address, value);
+}
+
+// reads a byte from rom
+u8 Cartridge::read(u16 address) const
+{
+  return (this->*_read)(address);
+}
+
+template<typename MBC>
+void Cartridge::writeMBC(u16 address, u8 value)
+{
+  u8 remap = MBC::write(status, rtc, address, value);
   
+  if (saveWriter && address >= 0xA000 && address <= 0xBFFF && status.ram_enabled && !status.rtc_override &&
+      mbc::Base::ramOffset(status, address) < status.ram_size)
+    saveWriter->touch(mbc::Base::ramOffset(status, address));
   
-  else if ((status.flags & MBC_MBC5) == MBC_MBC5)
-  {
-    /* this enables or less the RAM */
-		if (address <= 0x1FFF)
-		{	
-			if ((value & 0x0A) == 0x0A)
-				status.ram_enabled = true;
-			else
-				status.ram_enabled = false;
-		}
-    // this sets 8 lower bits of 9bits for rom bank choose
-    else if (address <= 0x2FFF)
-    {
-      status.current_rom_bank = (status.current_rom_bank & 0xFF00) | value;
-      status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
-    }
-    else if (address <= 0x3FFF)
-    {
-      status.current_rom_bank = (status.current_rom_bank & 0xFF) | ((((u16)value) & 0x01) << 8);
-      status.rom_bank_1 = &status.rom[status.current_rom_bank*16_kb];
-    }
-    else if (address >= 0x4000 && address <= 0x5FFF)
-    {
-      status.current_ram_bank = value & 0x0F;
-      status.ram_bank = &status.ram[status.current_ram_bank*8_kb];
-    }
-    else if (address >= 0xA000 && address <= 0xBFFF)
-    {
-      // scrive basandosi sull'offset nel banco di RAM selezionato
-      if (status.ram_enabled)
-        status.ram_bank[address - 0xA000] = value;
-    }
-  }
+  /* bank switches just repoint the pages published on the bus */
+  if (remap & mbc::REMAP_ROM)
+    invalidate(0x4000, 0x7FFF);
+  if (remap & mbc::REMAP_RAM)
+    invalidate(0xA000, 0xBFFF);
+}
 
+template<typename MBC>
+u8 Cartridge::readMBC(u16 address) const
+{
+  return MBC::read(status, rtc, address);
 }
 
-// reads a byte from rom
-u8 Cartridge::read(u16 address) const
+template<typename MBC>
+void Cartridge::bind()
+{
+  _write = &Cartridge::writeMBC<MBC>;
+  _read = &Cartridge::readMBC<MBC>;
+}
+
+u8* Cartridge::page(u16 address, bool write)
 {
-  // first 16kb -> rom_bank_0
   if (address <= 0x3FFF)
-    return status.rom_bank_0[address];
-  // second 16k -> rom_bank_1
-  else if (address >= 0x4000 && address <= 0x7FFF)
-    return status.rom_bank_1[address-0x4000];
-  // external ram 8k -> ram_bank
+    return write ? nullptr : &status.rom_bank_0[address];
+  else if (address <= 0x7FFF)
+    return write ? nullptr : &status.rom_bank_1[address - 0x4000];
   else if (address >= 0xA000 && address <= 0xBFFF)
   {
-    if (status.rtc_override)
-      return rtc.read();
-    else
-      return status.ram_bank[address-0xA000];
+    u32 offset = address - 0xA000;
+    
+    /* RTC registers and disabled RAM keep going through read/write, as do stores tracked by saveWriter */
+    if (write && saveWriter)
+      return nullptr;
+    else if (status.ram_enabled && !status.rtc_override && status.ram_bank &&
+        (status.ram_bank - status.ram) + offset + devices::Bus::PAGE_SIZE <= status.ram_size)
+      return &status.ram_bank[offset];
   }
+  
+  return nullptr;
+}
 
-	return 0;
+void Cartridge::map(devices::Bus& bus)
+{
+  bus.map(this, 0x0000, 0x7FFF);
+  bus.map(this, 0xA000, 0xBFFF, 0xA000);
 }
 
-u32 Cartridge::romSize()
+u32 Cartridge::romSize() const
 {
 	if (header.rom_size <= 0x07)
 		return 0x8000 << header.rom_size;
@@ -257,7 +142,7 @@ u32 Cartridge::romSize()
 	return 0;
 }
 
-u32 Cartridge::ramSize()
+u32 Cartridge::ramSize() const
 {
 	if ((status.flags & MBC_MBC2) == MBC_MBC2)
     return 512;
@@ -279,14 +164,25 @@ void Cartridge::init(void)
 
 void Cartridge::load(const path& rom_name)
 {
-	FILE *in = fopen(rom_name.c_str(), "rb");
-  long length = rom_name.length();
-  
   status.fileName = rom_name;
-	
-	fseek(in, 0x100, SEEK_SET);
-	fread(&header, sizeof(GB_CART_HEADER), 1, in);
-  fseek(in, 0, SEEK_SET);
+  
+#ifdef DEBUGGER
+  /* debugger can patch the ROM, keep a private copy on write image out of the cache */
+  romImage = RomImage::load(rom_name, map_mode::PRIVATE);
+#else
+  romImage = RomCache::i().acquire(rom_name);
+#endif
+  
+  if (romImage)
+    status.rom = romImage->data();
+  
+  if (!status.rom)
+  {
+    printf("Unable to open ROM %s\n", rom_name.c_str());
+    return;
+  }
+  
+  memcpy(&header, &status.rom[0x100], sizeof(GB_CART_HEADER));
 	
 	status.flags = 0x00;
   
@@ -321,6 +217,18 @@ void Cartridge::load(const path& rom_name)
 		
 	if (header.cart_type == 0x0F || header.cart_type == 0x10)
 		status.flags |= MBC_TIMER;
+  
+  /* mapper is chosen once here, read/write never test the flags again */
+  if ((status.flags & MBC_MBC1) == MBC_MBC1)
+    bind<mbc::MBC1>();
+  else if ((status.flags & MBC_MBC2) == MBC_MBC2)
+    bind<mbc::MBC2>();
+  else if ((status.flags & MBC_MBC3) == MBC_MBC3)
+    bind<mbc::MBC3>();
+  else if ((status.flags & MBC_MBC5) == MBC_MBC5)
+    bind<mbc::MBC5>();
+  else
+    bind<mbc::RomOnly>();
 	
 	char *tmp_name = new char[12];
 	memcpy(tmp_name, header.title, 11);
@@ -330,7 +238,7 @@ void Cartridge::load(const path& rom_name)
   printf("\nLOADING ROM\n");
 	printf("-------------\n\n");
 	printf("Rom name: %s\n", tmp_name);
-	printf("Effective file length: %lu\n", length);
+	printf("Effective file length: %zu\n", romImage->length());
 	printf("ROM size: %u\n", romSize());
 	printf("RAM size: %u\n", ramSize());
   printf("Cart type: %.2x\n", header.cart_type);
@@ -340,84 +248,38 @@ void Cartridge::load(const path& rom_name)
 
 
 
-	if ((status.flags & MBC_ROM) == MBC_ROM)
-	{
-		printf("ROM allocating %ld bytes\r\n", length);
-		
-		/* il tipo è ROM -> dimensione max 32kb in due blocchi da 16kb */
-		if (length > 32_kb)
-			printf("ROM format invalid!\r\n");
-
-		status.rom_bank_0 = (u8*)malloc(16_kb);
-		
-		fread(status.rom_bank_0, 1, 16_kb, in);
-		
-		status.rom_bank_1 = (u8*)malloc(length - 16_kb);
-		
-		fread(status.rom_bank_1, 1, length - 16_kb, in);
-	}
-  else if ((status.flags & MBC_MBC1) == MBC_MBC1)
-	{
-		unsigned long n = length / 16_kb;
-		
-		/* allochiamo n banks da 16kb */
-		printf("MBC1 allocating %lu x 16kb = %ld bytes\r\n", n, length);
-
-		status.rom = (u8*)calloc(length, sizeof(u8));
-    fread(status.rom, 1, n*16_kb, in);
-    
-		status.rom_bank_0 = status.rom;
-    status.rom_bank_1 = &status.rom[16_kb];
-	}
-  else if ((status.flags & MBC_MBC2) == MBC_MBC2)
-  {
-    unsigned long n = length / 16_kb;
-		
-		/* allochiamo n banks da 16kb */
-		printf("MBC2 allocating %lu x 16kb = %ld bytes\r\n", n, length);
-    
-		status.rom = (u8*)calloc(length, sizeof(u8));
-    fread(status.rom, 1, n*16_kb, in);
-    
-		status.rom_bank_0 = status.rom;
-    status.rom_bank_1 = &status.rom[16_kb];
-  }
-  else if ((status.flags & MBC_MBC3) == MBC_MBC3)
-  {
-    unsigned long n = length / 16_kb;
-    
-    /* allochiamo n banks da 16kb */
-    printf("MBC3 allocating %lu x 16kb = %ld bytes\r\n", n, length);
-    
-    status.rom = (u8*)calloc(length, sizeof(u8));
-    fread(status.rom, 1, n*16_kb, in);
-    
-    status.rom_bank_0 = status.rom;
-    status.rom_bank_1 = &status.rom[16_kb];
-  }
-  else if ((status.flags & MBC_MBC5) == MBC_MBC5)
-  {
-    unsigned long n = length / 16_kb;
-		
-		/* allochiamo n banks da 16kb */
-		printf("MBC5 allocating %lu x 16kb = %ld bytes\r\n", n, length);
-    
-		status.rom = (u8*)calloc(length, sizeof(u8));
-    fread(status.rom, 1, n*16_kb, in);
-    
-		status.rom_bank_0 = status.rom;
-    status.rom_bank_1 = &status.rom[16_kb];
-  }
+  size_t length = romImage->length();
+  
+	/* il tipo è ROM -> dimensione max 32kb in due blocchi da 16kb */
+	if ((status.flags & MBC_ROM) == MBC_ROM && length > 32_kb)
+		printf("ROM format invalid!\r\n");
+  
+  printf("ROM %s %zu x 16kb = %zu bytes\r\n", romImage->mapped() ? "mapping" : "allocating", length / 16_kb, length);
+  
+  status.rom_bank_0 = status.rom;
+  status.rom_bank_1 = &status.rom[16_kb];
+  
+  /* a partial last bank is still backed, the image is padded to whole banks */
+  status.rom_banks = u16(std::max<size_t>(2, (romImage->length() + 16_kb - 1) / 16_kb));
+  status.rom_bank_mask = u16(std::bit_ceil(status.rom_banks) - 1);
   
   if ((status.flags & MBC_RAM) == MBC_RAM)
   {
     u16 size = ramSize();
     
-    status.ram = (u8*)calloc(size, sizeof(u8));
-    status.ram_bank = status.ram;
+    if (saveMode == SaveMode::MAPPED && mapSave(size))
+      printf("RAM mapping %u x 8kb = %u bytes\r\n", size/8_kb, size);
+    else
+    {
+      status.ram = (u8*)calloc(size, sizeof(u8));
+      
+      /* allochiamo n banks da 8kb */
+      printf("RAM allocating %u x 8kb = %u bytes\r\n", size/8_kb, size);
+    }
     
-    /* allochiamo n banks da 8kb */
-		printf("RAM allocating %u x 8kb = %u bytes\r\n", size/8_kb, size);
+    status.ram_bank = status.ram;
+    status.ram_size = size;
+    status.ram_banks = u8(std::max<u32>(1, size / 8_kb));
   }
   
   if ((status.flags & MBC_TIMER) == MBC_TIMER)
@@ -426,11 +288,9 @@ void Cartridge::load(const path& rom_name)
     
     printf("TIMER allocating 5 bytes for RTC\r\n");
   }
-		
-	fclose(in);
   
   
-  if (ramSize() > 0)
+  if (ramSize() > 0 && status.ram && !saveFile)
   {
     auto savePath = status.fileName.withExtension("sav");
 
@@ -441,9 +301,31 @@ void Cartridge::load(const path& rom_name)
       fread(status.ram, ramSize(), sizeof(u8), in);
       fclose(in);
     }
+    
+    if (saveMode == SaveMode::ASYNC)
+    {
+      saveWriter = std::make_unique<SaveWriter>(savePath, status.ram, ramSize());
+      SaveSync::i().add(saveWriter.get());
+    }
   }
 }
 
+bool Cartridge::mapSave(u32 size)
+{
+  auto savePath = status.fileName.withExtension("sav");
+  
+  /* file is grown to the RAM size beforehand, a mapping can't extend it */
+  if (!FileSystem::i()->fallocate(savePath, size) || !saveFile.map(savePath, map_mode::SHARED) || saveFile.length() < size)
+  {
+    saveFile.unmap();
+    return false;
+  }
+  
+  status.ram = saveFile.data();
+  SaveSync::i().add(&saveFile);
+  return true;
+}
+
 void Cartridge::loadRaw(u8 *code, u32 length)
 {
   status.flags |= MBC_ROM | MBC_SIMPLE;
@@ -454,6 +336,7 @@ void Cartridge::loadRaw(u8 *code, u32 length)
   
   status.ram = (u8*)calloc(8_kb, sizeof(u8));
   status.ram_bank = status.ram;
+  status.ram_size = 8_kb;
   
   u8 jump[4] = {0x00, 0xC3, 0x50, 0x01};
   memcpy(&status.rom_bank_0[0x100], jump, 4);
@@ -470,9 +353,14 @@ void Cartridge::dumpSave()
 {
   u16 size = ramSize();
   
-  if (size > 0)
+  /* a mapped save is already in the file, just make sure it reached the disk */
+  if (saveFile)
+    saveFile.sync(false);
+  else if (saveWriter)
+    saveWriter->flush();
+  else if (size > 0)
   {
-    path outName = status.fileName.withExtension(".sav");
+    path outName = status.fileName.withExtension("sav");
     outName.writeAll(status.ram, sizeof(u8), size);
   }
 }
@@ -9,6 +9,9 @@
 
 #include "common.h"
 #include "base/path.h"
+#include "rom_cache.h"
+#include "save.h"
+#include "devices/component.h"
 #include "rtc.h"
 
 namespace gb
@@ -102,22 +105,48 @@ struct GB_CART_STATUS
   u16 current_rom_bank;
   u8 current_ram_bank;
   
+  /* banks backing rom and ram, bank numbers written by the game are wrapped into them as the
+     unconnected address lines of a smaller cart would do, so bank pointers never leave the memory */
+  u16 rom_banks;
+  u16 rom_bank_mask;
+  u8 ram_banks;
+  u32 ram_size;
+  
 	u32 flags;
   
   path fileName;
 };
 
-class Cartridge
+class Cartridge : public devices::Memory
 {
 private:
   GB_CART_HEADER header;
   GB_CART_STATUS status;
 
-  u32 romSize();
-  u32 ramSize();
+  u32 romSize() const;
+  u32 ramSize() const;
   
   RTC rtc;
   
+  /* backing storage of status.rom, shared with other instances running the same ROM */
+  std::shared_ptr<const RomImage> romImage;
+  
+  SaveMode saveMode;
+  /* backing storage of status.ram with SaveMode::MAPPED */
+  mapped_file saveFile;
+  /* dirty page tracking of status.ram with SaveMode::ASYNC */
+  std::unique_ptr<SaveWriter> saveWriter;
+  
+  bool mapSave(u32 size);
+  
+  /* bound by load() to the memory bank controller of the cart */
+  void (Cartridge::*_write)(u16 address, u8 value);
+  u8 (Cartridge::*_read)(u16 address) const;
+  
+  template<typename MBC> void writeMBC(u16 address, u8 value);
+  template<typename MBC> u8 readMBC(u16 address) const;
+  template<typename MBC> void bind();
+  
   /* initialize values (which bank selected, pointers, etc) */
   void init();
   /* load a cartridge */
@@ -125,19 +154,28 @@ private:
 
 public:
   Cartridge();
-  Cartridge(const path& fileName);
+  Cartridge(const path& fileName, SaveMode saveMode = SaveMode::MANUAL);
 
   ~Cartridge();
 
   void dump();
 
+  bool isLoaded() const { return status.rom != nullptr; }
   bool isCGB() const { return (status.flags & MBC_CGB) != 0; }
+  /* real time clock of MBC3 carts, nullptr if the cart has none */
+  RTC* timer() { return (status.flags & MBC_TIMER) ? &rtc : nullptr; }
 
   /* write value to cart address */
-  void write(u16 address, u8 value);
+  void write(u16 address, u8 value) override;
 
   /* read value at cart address */
-  u8 read(u16 address) const;
+  u8 read(u16 address) const override;
+
+  /* current ROM/RAM bank memory for the bus, RTC and disabled RAM go through read/write */
+  u8* page(u16 address, bool write) override;
+
+  /* maps ROM (0x0000-0x7FFF) and external RAM (0xA000-0xBFFF) windows on the bus */
+  void map(devices::Bus& bus);
 
   void loadRaw(u8 *code, u32 length);
 
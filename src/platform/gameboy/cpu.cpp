@@ -0,0 +1,696 @@
+#include "cpu.h"
+
+#include <algorithm>
+
+using namespace gb;
+
+namespace
+{
+  constexpr std::array<u8, 256> lengths = []() {
+    std::array<u8, 256> table = { };
+    for (size_t i = 0; i < table.size(); ++i)
+      table[i] = u8(CPU::instructionLength(u8(i)));
+    return table;
+  }();
+}
+
+const std::array<CPU::Handler, 256> CPU::_opcodes = CPU::table(std::make_index_sequence<256>());
+const std::array<CPU::Handler, 256> CPU::_cbOpcodes = CPU::cbTable(std::make_index_sequence<256>());
+
+CPU::CPU(devices::Bus& bus, Interrupts& interrupts) : _bus(bus), _interrupts(interrupts), _cache(bus), _useCache(true)
+{
+  _bus.setWatcher([this](const u8* memory) { _cache.invalidate(memory); });
+  reset();
+}
+
+void CPU::reset()
+{
+  /* registers as left by the DMG boot ROM */
+  _regs.setAF(0x01B0);
+  _regs.setBC(0x0013);
+  _regs.setDE(0x00D8);
+  _regs.setHL(0x014D);
+  _regs.sp = 0xFFFE;
+  _regs.pc = 0x0100;
+  
+  _ime = false;
+  _imeScheduled = false;
+  _halted = false;
+  _locked = false;
+  
+  _instructions = 0;
+  _cachedInstructions = 0;
+  _haltedCycles = 0;
+  _idleCycles = 0;
+  _operand = _fetched;
+  
+  /* blocks are keyed by host memory, which a new cartridge could reuse */
+  _cache.clear();
+}
+
+void CPU::push(u16 value)
+{
+  write(--_regs.sp, u8(value >> 8));
+  write(--_regs.sp, u8(value));
+}
+
+u16 CPU::pop()
+{
+  u8 low = read(_regs.sp++);
+  return u16(read(_regs.sp++) << 8 | low);
+}
+
+template<u8 R> u8 CPU::get()
+{
+  if constexpr (R == 0) return _regs.b;
+  else if constexpr (R == 1) return _regs.c;
+  else if constexpr (R == 2) return _regs.d;
+  else if constexpr (R == 3) return _regs.e;
+  else if constexpr (R == 4) return _regs.h;
+  else if constexpr (R == 5) return _regs.l;
+  else if constexpr (R == 6) return read(_regs.hl());
+  else return _regs.a;
+}
+
+template<u8 R> void CPU::set(u8 value)
+{
+  if constexpr (R == 0) _regs.b = value;
+  else if constexpr (R == 1) _regs.c = value;
+  else if constexpr (R == 2) _regs.d = value;
+  else if constexpr (R == 3) _regs.e = value;
+  else if constexpr (R == 4) _regs.h = value;
+  else if constexpr (R == 5) _regs.l = value;
+  else if constexpr (R == 6) write(_regs.hl(), value);
+  else _regs.a = value;
+}
+
+template<u8 P> u16 CPU::getPair() const
+{
+  if constexpr (P == 0) return _regs.bc();
+  else if constexpr (P == 1) return _regs.de();
+  else if constexpr (P == 2) return _regs.hl();
+  else return _regs.sp;
+}
+
+template<u8 P> void CPU::setPair(u16 value)
+{
+  if constexpr (P == 0) _regs.setBC(value);
+  else if constexpr (P == 1) _regs.setDE(value);
+  else if constexpr (P == 2) _regs.setHL(value);
+  else _regs.sp = value;
+}
+
+template<u8 CC> bool CPU::condition() const
+{
+  if constexpr (CC == 0) return !(_regs.f & FLAG_Z);
+  else if constexpr (CC == 1) return (_regs.f & FLAG_Z) != 0;
+  else if constexpr (CC == 2) return !(_regs.f & FLAG_C);
+  else return (_regs.f & FLAG_C) != 0;
+}
+
+/* ADD ADC SUB SBC AND XOR OR CP */
+template<u8 OPERATION> void CPU::alu(u8 value)
+{
+  const u8 a = _regs.a;
+  
+  if constexpr (OPERATION == 0 || OPERATION == 1)
+  {
+    const u32 c = OPERATION == 1 && carry() ? 1 : 0;
+    const u32 result = a + value + c;
+    _regs.a = u8(result);
+    setFlags(u8(result) == 0, false, (a & 0x0F) + (value & 0x0F) + c > 0x0F, result > 0xFF);
+  }
+  else if constexpr (OPERATION == 2 || OPERATION == 3 || OPERATION == 7)
+  {
+    const int c = OPERATION == 3 && carry() ? 1 : 0;
+    const int result = a - value - c;
+    if constexpr (OPERATION != 7)
+      _regs.a = u8(result);
+    setFlags(u8(result) == 0, true, (a & 0x0F) - (value & 0x0F) - c < 0, result < 0);
+  }
+  else if constexpr (OPERATION == 4)
+  {
+    _regs.a = a & value;
+    setFlags(_regs.a == 0, false, true, false);
+  }
+  else if constexpr (OPERATION == 5)
+  {
+    _regs.a = a ^ value;
+    setFlags(_regs.a == 0, false, false, false);
+  }
+  else
+  {
+    _regs.a = a | value;
+    setFlags(_regs.a == 0, false, false, false);
+  }
+}
+
+/* RLC RRC RL RR SLA SRA SWAP SRL, Z is set from the result */
+template<u8 OPERATION> u8 CPU::rotate(u8 value)
+{
+  u8 result;
+  bool c;
+  
+  if constexpr (OPERATION == 0) { c = value & 0x80; result = u8(value << 1 | value >> 7); }
+  else if constexpr (OPERATION == 1) { c = value & 0x01; result = u8(value >> 1 | value << 7); }
+  else if constexpr (OPERATION == 2) { c = value & 0x80; result = u8(value << 1 | (carry() ? 1 : 0)); }
+  else if constexpr (OPERATION == 3) { c = value & 0x01; result = u8(value >> 1 | (carry() ? 0x80 : 0)); }
+  else if constexpr (OPERATION == 4) { c = value & 0x80; result = u8(value << 1); }
+  else if constexpr (OPERATION == 5) { c = value & 0x01; result = u8((value >> 1) | (value & 0x80)); }
+  else if constexpr (OPERATION == 6) { c = false; result = u8(value << 4 | value >> 4); }
+  else { c = value & 0x01; result = u8(value >> 1); }
+  
+  setFlags(result == 0, false, false, c);
+  return result;
+}
+
+/*
+  opcode = xx yyy zzz, y is further split in pp q. Each handler is the instantiation of this
+  function for its opcode, all the decoding below is resolved at compile time.
+*/
+template<u8 OP> u32 CPU::op(CPU& cpu)
+{
+  constexpr u8 x = OP >> 6, y = (OP >> 3) & 7, z = OP & 7, p = y >> 1, q = y & 1;
+  Registers& r = cpu._regs;
+  
+  if constexpr (x == 0)
+  {
+    if constexpr (z == 0)
+    {
+      if constexpr (y == 0) /* NOP */
+        return 4;
+      else if constexpr (y == 1) /* LD (nn),SP */
+      {
+        const u16 address = cpu.imm16();
+        cpu.write(address, u8(r.sp));
+        cpu.write(u16(address + 1), u8(r.sp >> 8));
+        return 20;
+      }
+      else if constexpr (y == 2) /* STOP, behaves as a NOP, its padding byte is counted as an operand */
+        return 4;
+      else /* JR d, JR cc,d */
+      {
+        const s8 offset = s8(cpu.imm8());
+        if constexpr (y > 3)
+        {
+          if (!cpu.condition<y - 4>())
+            return 8;
+        }
+        r.pc = u16(r.pc + offset);
+        return 12;
+      }
+    }
+    else if constexpr (z == 1)
+    {
+      if constexpr (q == 0) /* LD rr,nn */
+      {
+        cpu.setPair<p>(cpu.imm16());
+        return 12;
+      }
+      else /* ADD HL,rr */
+      {
+        const u32 hl = r.hl(), value = cpu.getPair<p>();
+        const u32 result = hl + value;
+        r.f = (r.f & FLAG_Z) | ((hl & 0x0FFF) + (value & 0x0FFF) > 0x0FFF ? FLAG_H : 0) | (result > 0xFFFF ? FLAG_C : 0);
+        r.setHL(u16(result));
+        return 8;
+      }
+    }
+    else if constexpr (z == 2) /* LD (BC),A LD (DE),A LD (HL+),A LD (HL-),A and the loads back */
+    {
+      u16 address;
+      if constexpr (p == 0) address = r.bc();
+      else if constexpr (p == 1) address = r.de();
+      else
+      {
+        address = r.hl();
+        r.setHL(p == 2 ? u16(address + 1) : u16(address - 1));
+      }
+      
+      if constexpr (q == 0)
+        cpu.write(address, r.a);
+      else
+        r.a = cpu.read(address);
+      return 8;
+    }
+    else if constexpr (z == 3) /* INC rr, DEC rr */
+    {
+      cpu.setPair<p>(u16(cpu.getPair<p>() + (q == 0 ? 1 : -1)));
+      return 8;
+    }
+    else if constexpr (z == 4) /* INC r */
+    {
+      const u8 value = u8(cpu.get<y>() + 1);
+      cpu.set<y>(value);
+      r.f = (r.f & FLAG_C) | (value == 0 ? FLAG_Z : 0) | ((value & 0x0F) == 0 ? FLAG_H : 0);
+      return y == 6 ? 12 : 4;
+    }
+    else if constexpr (z == 5) /* DEC r */
+    {
+      const u8 value = u8(cpu.get<y>() - 1);
+      cpu.set<y>(value);
+      r.f = (r.f & FLAG_C) | FLAG_N | (value == 0 ? FLAG_Z : 0) | ((value & 0x0F) == 0x0F ? FLAG_H : 0);
+      return y == 6 ? 12 : 4;
+    }
+    else if constexpr (z == 6) /* LD r,n */
+    {
+      cpu.set<y>(cpu.imm8());
+      return y == 6 ? 12 : 8;
+    }
+    else
+    {
+      if constexpr (y < 4) /* RLCA RRCA RLA RRA, like their CB versions but Z is always cleared */
+      {
+        r.a = cpu.rotate<y>(r.a);
+        r.f &= FLAG_C;
+      }
+      else if constexpr (y == 4) /* DAA */
+      {
+        u8 a = r.a;
+        bool c = cpu.carry();
+        
+        if (!(r.f & FLAG_N))
+        {
+          if (c || a > 0x99) { a += 0x60; c = true; }
+          if ((r.f & FLAG_H) || (a & 0x0F) > 0x09) a += 0x06;
+        }
+        else
+        {
+          if (c) a -= 0x60;
+          if (r.f & FLAG_H) a -= 0x06;
+        }
+        
+        r.a = a;
+        r.f = (r.f & FLAG_N) | (a == 0 ? FLAG_Z : 0) | (c ? FLAG_C : 0);
+      }
+      else if constexpr (y == 5) /* CPL */
+      {
+        r.a = ~r.a;
+        r.f |= FLAG_N | FLAG_H;
+      }
+      else if constexpr (y == 6) /* SCF */
+        r.f = (r.f & FLAG_Z) | FLAG_C;
+      else /* CCF */
+        r.f = (r.f & (FLAG_Z | FLAG_C)) ^ FLAG_C;
+      return 4;
+    }
+  }
+  else if constexpr (x == 1)
+  {
+    if constexpr (OP == 0x76) /* HALT */
+    {
+      cpu._halted = true;
+      return 4;
+    }
+    else /* LD r,r */
+    {
+      cpu.set<y>(cpu.get<z>());
+      return y == 6 || z == 6 ? 8 : 4;
+    }
+  }
+  else if constexpr (x == 2) /* ALU A,r */
+  {
+    cpu.alu<y>(cpu.get<z>());
+    return z == 6 ? 8 : 4;
+  }
+  else
+  {
+    if constexpr (z == 0)
+    {
+      if constexpr (y < 4) /* RET cc */
+      {
+        if (!cpu.condition<y>())
+          return 8;
+        r.pc = cpu.pop();
+        return 20;
+      }
+      else if constexpr (y == 4) /* LDH (n),A */
+      {
+        cpu.write(u16(0xFF00 | cpu.imm8()), r.a);
+        return 12;
+      }
+      else if constexpr (y == 6) /* LDH A,(n) */
+      {
+        r.a = cpu.read(u16(0xFF00 | cpu.imm8()));
+        return 12;
+      }
+      else /* ADD SP,d and LD HL,SP+d, flags come from the unsigned low byte addition */
+      {
+        const u8 offset = cpu.imm8();
+        const u16 result = u16(r.sp + s8(offset));
+        r.f = ((r.sp & 0x0F) + (offset & 0x0F) > 0x0F ? FLAG_H : 0) | ((r.sp & 0xFF) + offset > 0xFF ? FLAG_C : 0);
+        
+        if constexpr (y == 5)
+        {
+          r.sp = result;
+          return 16;
+        }
+        else
+        {
+          r.setHL(result);
+          return 12;
+        }
+      }
+    }
+    else if constexpr (z == 1)
+    {
+      if constexpr (q == 0) /* POP rr */
+      {
+        const u16 value = cpu.pop();
+        if constexpr (p == 3) r.setAF(value);
+        else cpu.setPair<p>(value);
+        return 12;
+      }
+      else if constexpr (p == 0 || p == 1) /* RET, RETI */
+      {
+        r.pc = cpu.pop();
+        if constexpr (p == 1)
+          cpu._ime = true;
+        return 16;
+      }
+      else if constexpr (p == 2) /* JP HL */
+      {
+        r.pc = r.hl();
+        return 4;
+      }
+      else /* LD SP,HL */
+      {
+        r.sp = r.hl();
+        return 8;
+      }
+    }
+    else if constexpr (z == 2)
+    {
+      if constexpr (y < 4) /* JP cc,nn */
+      {
+        const u16 address = cpu.imm16();
+        if (!cpu.condition<y>())
+          return 12;
+        r.pc = address;
+        return 16;
+      }
+      else if constexpr (y == 4) /* LD (C),A */
+      {
+        cpu.write(u16(0xFF00 | r.c), r.a);
+        return 8;
+      }
+      else if constexpr (y == 5) /* LD (nn),A */
+      {
+        cpu.write(cpu.imm16(), r.a);
+        return 16;
+      }
+      else if constexpr (y == 6) /* LD A,(C) */
+      {
+        r.a = cpu.read(u16(0xFF00 | r.c));
+        return 8;
+      }
+      else /* LD A,(nn) */
+      {
+        r.a = cpu.read(cpu.imm16());
+        return 16;
+      }
+    }
+    else if constexpr (z == 3)
+    {
+      if constexpr (y == 0) /* JP nn */
+      {
+        r.pc = cpu.imm16();
+        return 16;
+      }
+      else if constexpr (y == 1) /* CB prefix, its handlers count the prefix too */
+        return _cbOpcodes[cpu.imm8()](cpu);
+      else if constexpr (y == 6) /* DI */
+      {
+        cpu._ime = false;
+        cpu._imeScheduled = false;
+        return 4;
+      }
+      else if constexpr (y == 7) /* EI */
+      {
+        cpu._imeScheduled = true;
+        return 4;
+      }
+      else
+      {
+        cpu._locked = true;
+        return 4;
+      }
+    }
+    else if constexpr (z == 4)
+    {
+      if constexpr (y < 4) /* CALL cc,nn */
+      {
+        const u16 address = cpu.imm16();
+        if (!cpu.condition<y>())
+          return 12;
+        cpu.push(r.pc);
+        r.pc = address;
+        return 24;
+      }
+      else
+      {
+        cpu._locked = true;
+        return 4;
+      }
+    }
+    else if constexpr (z == 5)
+    {
+      if constexpr (q == 0) /* PUSH rr */
+      {
+        if constexpr (p == 3) cpu.push(r.af());
+        else cpu.push(cpu.getPair<p>());
+        return 16;
+      }
+      else if constexpr (p == 0) /* CALL nn */
+      {
+        const u16 address = cpu.imm16();
+        cpu.push(r.pc);
+        r.pc = address;
+        return 24;
+      }
+      else
+      {
+        cpu._locked = true;
+        return 4;
+      }
+    }
+    else if constexpr (z == 6) /* ALU A,n */
+    {
+      cpu.alu<y>(cpu.imm8());
+      return 8;
+    }
+    else /* RST */
+    {
+      cpu.push(r.pc);
+      r.pc = y * 8;
+      return 16;
+    }
+  }
+}
+
+/* xx yyy zzz: rotations/shifts, BIT, RES and SET of bit y on register z */
+template<u8 OP> u32 CPU::cb(CPU& cpu)
+{
+  constexpr u8 x = OP >> 6, y = (OP >> 3) & 7, z = OP & 7;
+  constexpr u8 mask = u8(1 << y);
+  
+  if constexpr (x == 0)
+    cpu.set<z>(cpu.rotate<y>(cpu.get<z>()));
+  else if constexpr (x == 1)
+  {
+    cpu._regs.f = (cpu._regs.f & FLAG_C) | FLAG_H | ((cpu.get<z>() & mask) ? 0 : FLAG_Z);
+    return z == 6 ? 12 : 8;
+  }
+  else if constexpr (x == 2)
+    cpu.set<z>(cpu.get<z>() & ~mask);
+  else
+    cpu.set<z>(cpu.get<z>() | mask);
+  
+  return z == 6 ? 16 : 8;
+}
+
+u32 CPU::interrupt()
+{
+  const u8 pending = _interrupts.pending();
+  if (!pending)
+    return 0;
+  
+  /* any pending interrupt ends HALT, even with IME off */
+  _halted = false;
+  
+  if (!_ime)
+    return 0;
+  
+  /* lowest bit has the highest priority */
+  const u8 interrupt = pending & -pending;
+  _interrupts.acknowledge(interrupt);
+  _ime = false;
+  
+  push(_regs.pc);
+  
+  u16 vector = 0x40;
+  for (u8 bit = interrupt; bit > 1; bit >>= 1)
+    vector += 0x08;
+  _regs.pc = vector;
+  
+  return 20;
+}
+
+u32 CPU::execute()
+{
+  if (u32 cycles = interrupt())
+    return cycles;
+  
+  if (_halted || _locked)
+    return 4;
+  
+  const u8 opcode = read(_regs.pc);
+  const u32 length = lengths[opcode];
+  
+  if (length > 1)
+    _fetched[0] = read(u16(_regs.pc + 1));
+  if (length > 2)
+    _fetched[1] = read(u16(_regs.pc + 2));
+  
+  _operand = _fetched;
+  _regs.pc += u16(length);
+  
+  return invoke(_opcodes[opcode]);
+}
+
+u32 CPU::invoke(Handler handler)
+{
+  const bool enableInterrupts = _imeScheduled;
+  
+  const u32 cycles = handler(*this);
+  ++_instructions;
+  
+  /* a DI right after EI cancels it */
+  if (enableInterrupts && _imeScheduled)
+  {
+    _ime = true;
+    _imeScheduled = false;
+  }
+  
+  return cycles;
+}
+
+void CPU::run(devices::Scheduler& scheduler, devices::cycle_t deadline)
+{
+  if (_useCache)
+    runCached(scheduler, deadline);
+  else
+    runInterpreter(scheduler, deadline);
+}
+
+bool CPU::skipHalt(devices::Scheduler& scheduler, devices::cycle_t limit)
+{
+  if (!_halted || _interrupts.pending())
+    return false;
+  
+  _haltedCycles += limit - scheduler.now();
+  scheduler.advanceTo(limit);
+  return true;
+}
+
+devices::cycle_t CPU::stableUntil(const BlockCache::Block& block) const
+{
+  devices::cycle_t until = devices::Scheduler::NEVER;
+  
+  /* registers are as the block found them, the reads through them happen before the block changes them */
+  for (const BlockCache::Read& read : block.reads)
+  {
+    u16 address = read.address;
+    
+    switch (read.source)
+    {
+      case BlockCache::Read::Source::Fixed: break;
+      case BlockCache::Read::Source::BC: address = _regs.bc(); break;
+      case BlockCache::Read::Source::DE: address = _regs.de(); break;
+      case BlockCache::Read::Source::HL: address = _regs.hl(); break;
+      case BlockCache::Read::Source::C: address = u16(0xFF00 | _regs.c); break;
+    }
+    
+    until = std::min(until, _bus.stableUntil(address));
+  }
+  
+  return until;
+}
+
+void CPU::runInterpreter(devices::Scheduler& scheduler, devices::cycle_t deadline)
+{
+  /* an instruction can schedule an event earlier than the deadline we were given (eg. a timer write) */
+  for (devices::cycle_t limit = std::min(deadline, scheduler.nextDeadline()); scheduler.now() < limit; limit = std::min(deadline, scheduler.nextDeadline()))
+  {
+    if (!skipHalt(scheduler, limit))
+      scheduler.advance(execute());
+  }
+}
+
+void CPU::runCached(devices::Scheduler& scheduler, devices::cycle_t deadline)
+{
+  devices::cycle_t limit = std::min(deadline, scheduler.nextDeadline());
+  
+  while (scheduler.now() < limit)
+  {
+    /* interrupts, HALT and code outside plain memory go through the interpreter */
+    const bool interrupted = _interrupts.pending() && (_ime || _halted);
+    const BlockCache::Block* block = interrupted || _halted || _locked ? nullptr : _cache.lookup(_regs.pc);
+    
+    if (!block)
+    {
+      if (!skipHalt(scheduler, limit))
+        scheduler.advance(execute());
+      limit = std::min(deadline, scheduler.nextDeadline());
+      continue;
+    }
+    
+    if (!block->idle)
+    {
+      runBlock(scheduler, *block, deadline, limit);
+      continue;
+    }
+    
+    /* a polling loop which went around leaving every register as it found them will repeat
+       itself exactly until one of the values it reads changes, which can't be before the next
+       event or the first clock derived register it reads ticks, which is computed before the
+       iteration since it must hold for the values that iteration read */
+    const Registers before = _regs;
+    const devices::cycle_t start = scheduler.now();
+    const devices::cycle_t stable = stableUntil(*block);
+    
+    if (runBlock(scheduler, *block, deadline, limit) && _regs == before)
+    {
+      const devices::cycle_t period = scheduler.now() - start;
+      const devices::cycle_t until = std::min(limit, stable);
+      
+      if (until > scheduler.now())
+      {
+        const devices::cycle_t skipped = (until - scheduler.now()) / period * period;
+        scheduler.advance(skipped);
+        _idleCycles += skipped;
+      }
+    }
+  }
+}
+
+bool CPU::runBlock(devices::Scheduler& scheduler, const BlockCache::Block& block, devices::cycle_t deadline, devices::cycle_t& limit)
+{
+  _cache.clean();
+  
+  for (const BlockCache::Op& op : block.ops)
+  {
+    _operand = op.operand;
+    _regs.pc += op.length;
+    
+    scheduler.advance(invoke(op.handler));
+    ++_cachedInstructions;
+    
+    /* same checks the interpreter does between instructions, plus code written by the block */
+    limit = std::min(deadline, scheduler.nextDeadline());
+    if (scheduler.now() >= limit || _cache.dirty() || (_ime && _interrupts.pending()))
+      return false;
+  }
+  
+  return true;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "common.h"
+#include "devices/component.h"
+#include "interrupts.h"
+#include "block_cache.h"
+
+#include <array>
+#include <utility>
+
+namespace gb
+{
+  /*
+    SM83 interpreter. Every opcode (and every CB prefixed one) has its own handler, specialized at
+    compile time from the opcode bits and dispatched through a 256 entry table, which returns the
+    cycles the instruction took so that time is accounted once per instruction. Operands are fetched
+    before the handler runs, according to instructionLength(), or come pre-decoded from the
+    block cache.
+  */
+  class CPU : public devices::CPU
+  {
+  public:
+    enum : u8
+    {
+      FLAG_Z = 0x80,
+      FLAG_N = 0x40,
+      FLAG_H = 0x20,
+      FLAG_C = 0x10
+    };
+    
+    struct Registers
+    {
+      u8 a, f;
+      u8 b, c;
+      u8 d, e;
+      u8 h, l;
+      u16 sp;
+      u16 pc;
+      
+      u16 af() const { return u16(a << 8 | f); }
+      u16 bc() const { return u16(b << 8 | c); }
+      u16 de() const { return u16(d << 8 | e); }
+      u16 hl() const { return u16(h << 8 | l); }
+      
+      void setAF(u16 v) { a = u8(v >> 8); f = u8(v & 0xF0); }
+      void setBC(u16 v) { b = u8(v >> 8); c = u8(v); }
+      void setDE(u16 v) { d = u8(v >> 8); e = u8(v); }
+      void setHL(u16 v) { h = u8(v >> 8); l = u8(v); }
+      
+      bool operator==(const Registers& other) const = default;
+    };
+    
+    using Handler = BlockCache::Handler;
+    
+  protected:
+    devices::Bus& _bus;
+    Interrupts& _interrupts;
+    
+    Registers _regs;
+    
+    bool _ime;
+    /* EI takes effect after the instruction which follows it */
+    bool _imeScheduled;
+    bool _halted;
+    /* executed an illegal opcode, only a reset recovers */
+    bool _locked;
+    
+    u64 _instructions;
+    
+    BlockCache _cache;
+    bool _useCache;
+    /* instructions run from pre-decoded blocks */
+    u64 _cachedInstructions;
+    
+    u64 _haltedCycles;
+    u64 _idleCycles;
+    
+    /* until when every memory read of an idle block keeps returning the same value */
+    devices::cycle_t stableUntil(const BlockCache::Block& block) const;
+    /* HALT without a pending interrupt can only end with an event */
+    bool skipHalt(devices::Scheduler& scheduler, devices::cycle_t limit);
+    
+    static const std::array<Handler, 256> _opcodes;
+    static const std::array<Handler, 256> _cbOpcodes;
+    
+    template<u8 OP> static u32 op(CPU& cpu);
+    template<u8 OP> static u32 cb(CPU& cpu);
+    template<size_t... I> static constexpr std::array<Handler, 256> table(std::index_sequence<I...>) { return { &op<u8(I)>... }; }
+    template<size_t... I> static constexpr std::array<Handler, 256> cbTable(std::index_sequence<I...>) { return { &cb<u8(I)>... }; }
+    
+    u8 read(u16 address) const { return _bus.read(address); }
+    void write(u16 address, u8 value) { _bus.write(address, value); }
+    
+    /* operand bytes of the current instruction, PC already points past them when the handler runs */
+    const u8* _operand;
+    u8 _fetched[2];
+    
+    u8 imm8() const { return _operand[0]; }
+    u16 imm16() const { return u16(_operand[1] << 8 | _operand[0]); }
+    
+    void push(u16 value);
+    u16 pop();
+    
+    /* B C D E H L (HL) A, as encoded in the opcodes */
+    template<u8 R> u8 get();
+    template<u8 R> void set(u8 value);
+    
+    /* BC DE HL SP */
+    template<u8 P> u16 getPair() const;
+    template<u8 P> void setPair(u16 value);
+    
+    /* NZ Z NC C */
+    template<u8 CC> bool condition() const;
+    
+    template<u8 OPERATION> void alu(u8 value);
+    template<u8 OPERATION> u8 rotate(u8 value);
+    
+    void setFlags(bool z, bool n, bool h, bool c) { _regs.f = (z ? FLAG_Z : 0) | (n ? FLAG_N : 0) | (h ? FLAG_H : 0) | (c ? FLAG_C : 0); }
+    bool carry() const { return (_regs.f & FLAG_C) != 0; }
+    
+    /* dispatches the highest priority pending interrupt, returns the cycles spent (0 if none) */
+    u32 interrupt();
+    
+    /* runs a handler whose operands are in place, applies a pending EI */
+    u32 invoke(Handler handler);
+    
+    void runInterpreter(devices::Scheduler& scheduler, devices::cycle_t deadline);
+    void runCached(devices::Scheduler& scheduler, devices::cycle_t deadline);
+    /* false if it had to stop before the end of the block */
+    bool runBlock(devices::Scheduler& scheduler, const BlockCache::Block& block, devices::cycle_t deadline, devices::cycle_t& limit);
+    
+  public:
+    CPU(devices::Bus& bus, Interrupts& interrupts);
+    
+    /* bytes taken by the instruction, including its opcode (and the CB prefix) */
+    static constexpr u32 instructionLength(u8 opcode)
+    {
+      const u8 x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7, q = y & 1;
+      
+      if (x == 0)
+      {
+        switch (z)
+        {
+          case 0: return y == 0 ? 1 : (y == 1 ? 3 : 2);
+          case 1: return q == 0 ? 3 : 1;
+          case 6: return 2;
+          default: return 1;
+        }
+      }
+      else if (x == 3)
+      {
+        switch (z)
+        {
+          case 0: return y < 4 ? 1 : 2;
+          case 2: return (y < 4 || y == 5 || y == 7) ? 3 : 1;
+          case 3: return y == 0 ? 3 : (y == 1 ? 2 : 1);
+          case 4: return y < 4 ? 3 : 1;
+          case 5: return opcode == 0xCD ? 3 : 1;
+          case 6: return 2;
+          default: return 1;
+        }
+      }
+      
+      return 1;
+    }
+    
+    /* instructions which can change PC or IME, or stop the CPU */
+    static constexpr bool endsBlock(u8 opcode)
+    {
+      const u8 x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7, p = y >> 1, q = y & 1;
+      
+      if (x == 0)
+        return z == 0 && y >= 2;
+      else if (x == 1)
+        return opcode == 0x76;
+      else if (x == 2)
+        return false;
+      
+      switch (z)
+      {
+        case 0: return y < 4;
+        case 1: return q == 1 && p < 3;
+        case 2: return y < 4;
+        case 3: return y != 1;
+        case 4: return true;
+        case 5: return q == 1;
+        case 6: return false;
+        default: return true;
+      }
+    }
+    
+    /* handler of opcode, next is the byte which follows it (for CB prefixed opcodes) */
+    static Handler handler(u8 opcode, u8 next) { return opcode == 0xCB ? _cbOpcodes[next] : _opcodes[opcode]; }
+
+    
+    std::string name() const override { return "SM83"; }
+    
+    void reset() override;
+    u32 execute() override;
+    void run(devices::Scheduler& scheduler, devices::cycle_t deadline) override;
+    
+    const Registers& registers() const { return _regs; }
+    Registers& registers() { return _regs; }
+    
+    bool halted() const { return _halted; }
+    bool locked() const { return _locked; }
+    u64 instructions() const { return _instructions; }
+    
+    void setBlockCache(bool enabled) { _useCache = enabled; }
+    const BlockCache& blockCache() const { return _cache; }
+    u64 cachedInstructions() const { return _cachedInstructions; }
+    
+    Stats stats() const override { return { _instructions, _haltedCycles, _idleCycles }; }
+  };
+}
@@ -0,0 +1,71 @@
+#include "gameboy.h"
+
+using namespace gb;
+
+GameBoy::GameBoy() : _io(_scheduler), _processor(_bus, _io.interrupts()), _ppu(_scheduler, _io.interrupts()),
+  _apu(_scheduler, float(CLOCK_RATE), 44100.0f)
+{
+  _cpu = &_processor;
+  _io.attach(&_ppu);
+  _io.attach(&_apu);
+  
+  _wram = add<devices::Ram>(8_kb);
+  
+  _bus.map(_ppu.vram(), 0x8000, 0x9FFF);
+  _bus.map(_wram, 0xC000, 0xDFFF);
+  /* echo of work RAM */
+  _bus.map(_wram, 0xE000, 0xFDFF);
+  _bus.map(_ppu.oam(), 0xFE00, 0xFE9F);
+  _bus.map(&_io, 0xFF00, 0xFFFF);
+  
+  /* classic green LCD shades, index 0 is the lightest */
+  const gfx::Pixel shades[] = {
+    gfx::Pixel(0xE0, 0xF8, 0xD0),
+    gfx::Pixel(0x88, 0xC0, 0x70),
+    gfx::Pixel(0x34, 0x68, 0x56),
+    gfx::Pixel(0x08, 0x18, 0x20)
+  };
+  
+  _ppu.setShades(shades);
+  
+  _rtcEvent = _scheduler.add("rtc", [this](devices::cycle_t when) {
+    if (RTC* rtc = _cartridge ? _cartridge->timer() : nullptr)
+    {
+      rtc->run(RTC::CYCLES_PER_SECOND);
+      _scheduler.schedule(_rtcEvent, when + RTC::CYCLES_PER_SECOND);
+    }
+  });
+}
+
+bool GameBoy::load(const path& rom, SaveMode saveMode)
+{
+  auto cartridge = std::make_unique<Cartridge>(rom, saveMode);
+  if (!cartridge->isLoaded())
+    return false;
+  
+  if (_cartridge)
+    _bus.unmap(_cartridge.get());
+  
+  _cartridge = std::move(cartridge);
+  _cartridge->map(_bus);
+  
+  _io.reset();
+  _ppu.reset();
+  _apu.reset();
+  _processor.reset();
+  
+  if (_cartridge->timer())
+    _scheduler.scheduleIn(_rtcEvent, RTC::CYCLES_PER_SECOND);
+  else
+    _scheduler.cancel(_rtcEvent);
+  
+  return true;
+}
+
+void GameBoy::runFrame(gfx::FrameBuffer& frame)
+{
+  runFor(CYCLES_PER_FRAME);
+  /* a frame is the longest span the APU is left behind, which bounds its buffers */
+  _apu.sync();
+  _ppu.screen().expand(frame);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+#include "base/path.h"
+#include "devices/machine.h"
+#include "gfx/indexed_frame_buffer.h"
+#include "apu.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "io.h"
+#include "ppu.h"
+
+#include <memory>
+
+namespace gb
+{
+  constexpr u32 CLOCK_RATE = 4194304;
+  
+  /* DMG machine: SM83, cartridge, work RAM, IO registers, PPU and APU */
+  class GameBoy : public devices::Machine
+  {
+  protected:
+    std::unique_ptr<Cartridge> _cartridge;
+    
+    IO _io;
+    CPU _processor;
+    PPU _ppu;
+    APU _apu;
+    devices::Ram* _wram;
+    
+    /* once per emulated second while the cartridge has a RTC */
+    devices::Scheduler::Event* _rtcEvent;
+    
+  public:
+    GameBoy();
+    
+    /* replaces the current cartridge, false if the ROM couldn't be loaded */
+    bool load(const path& rom, SaveMode saveMode = SaveMode::MANUAL);
+    
+    Cartridge* cartridge() { return _cartridge.get(); }
+    CPU& cpu() { return _processor; }
+    IO& io() { return _io; }
+    PPU& ppu() { return _ppu; }
+    APU& apu() { return _apu; }
+    const gfx::IndexedFrameBuffer& screen() const { return _ppu.screen(); }
+    
+    void runFrame(gfx::FrameBuffer& frame) override;
+    float frameRate() const override { return float(CLOCK_RATE) / CYCLES_PER_FRAME; }
+    
+    size_t readAudio(float* out, size_t count) override { return _apu.readAudio(out, count); }
+    float audioRate() const override { return _apu.sampleRate(); }
+  };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.h"
+
+namespace gb
+{
+  /* IF (0xFF0F) and IE (0xFFFF), shared by the CPU and every device that can raise an interrupt */
+  struct Interrupts
+  {
+    enum : u8
+    {
+      VBLANK = 0x01,
+      STAT = 0x02,
+      TIMER = 0x04,
+      SERIAL = 0x08,
+      JOYPAD = 0x10,
+      
+      MASK = 0x1F
+    };
+    
+    u8 flags = 0x01;
+    u8 enable = 0x00;
+    
+    void request(u8 interrupt) { flags |= interrupt; }
+    void acknowledge(u8 interrupt) { flags &= ~interrupt; }
+    
+    /* requested and enabled, regardless of IME */
+    u8 pending() const { return flags & enable & MASK; }
+  };
+}
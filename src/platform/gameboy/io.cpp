@@ -0,0 +1,106 @@
+#include "io.h"
+
+#include "apu.h"
+#include "ppu.h"
+
+using namespace gb;
+
+IO::IO(devices::Scheduler& scheduler) : _timer(scheduler, _interrupts), _apu(nullptr), _ppu(nullptr)
+{
+  reset();
+}
+
+void IO::reset()
+{
+  /* state left by the boot ROM */
+  _regs.fill(0x00);
+  _regs[JOYP] = 0xCF;
+  _regs[SC] = 0x7E;
+  
+  _interrupts = Interrupts();
+  _timer.reset();
+  _serial.clear();
+}
+
+u8 IO::read(devices::addr_t address) const
+{
+  const u8 index = u8(address);
+  
+  if (_apu && index >= APU::NR10 && index <= APU::WAVE_RAM_END)
+    return _apu->read(index);
+  else if (_ppu && index >= LCDC && index <= WX && index != DMA)
+    return _ppu->read(index);
+  
+  switch (index)
+  {
+    /* no buttons pressed */
+    case JOYP: return 0xC0 | (_regs[JOYP] & 0x30) | 0x0F;
+    case Timer::DIV: case Timer::TIMA: case Timer::TMA: case Timer::TAC: return _timer.read(index);
+    case IF: return 0xE0 | _interrupts.flags;
+    case IE: return _interrupts.enable;
+    default: return _regs[index];
+  }
+}
+
+devices::cycle_t IO::stableUntil(devices::addr_t address) const
+{
+  const u8 index = u8(address);
+  
+  if (index == Timer::DIV || index == Timer::TIMA)
+    return _timer.stableUntil(index);
+  else if (_apu && index >= APU::NR10 && index <= APU::WAVE_RAM_END)
+    return _apu->stableUntil(index);
+  else if (_ppu && index >= LCDC && index <= WX && index != DMA)
+    return _ppu->stableUntil(index);
+  
+  /* everything else only changes on writes or in scheduler events */
+  return devices::Scheduler::NEVER;
+}
+
+void IO::write(devices::addr_t address, u8 value)
+{
+  const u8 index = u8(address);
+  
+  if (_apu && index >= APU::NR10 && index <= APU::WAVE_RAM_END)
+  {
+    _apu->write(index, value);
+    return;
+  }
+  else if (_ppu && index >= LCDC && index <= WX && index != DMA)
+  {
+    _ppu->write(index, value);
+    return;
+  }
+  
+  switch (index)
+  {
+    case Timer::DIV: case Timer::TIMA: case Timer::TMA: case Timer::TAC: _timer.write(index, value); break;
+    case IF: _interrupts.flags = value & Interrupts::MASK; break;
+    case IE: _interrupts.enable = value; break;
+    case SC:
+    {
+      _regs[SC] = value | 0x7E;
+      
+      /* internal clock transfer, nobody on the other side answers 0xFF */
+      if ((value & 0x81) == 0x81)
+      {
+        _serial.push_back(char(_regs[SB]));
+        _regs[SB] = 0xFF;
+        _regs[SC] &= 0x7F;
+        _interrupts.request(Interrupts::SERIAL);
+      }
+      break;
+    }
+    case DMA:
+    {
+      _regs[DMA] = value;
+      
+      /* OAM DMA, done at once instead of over 160 cycles */
+      const devices::addr_t source = devices::addr_t(value) << 8;
+      for (devices::addr_t i = 0; i < 0xA0; ++i)
+        _bus->write(0xFE00 + i, _bus->read(source + i));
+      break;
+    }
+    default: _regs[index] = value; break;
+  }
+}
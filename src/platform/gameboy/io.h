@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common.h"
+#include "devices/component.h"
+#include "interrupts.h"
+#include "timer.h"
+
+#include <array>
+#include <string>
+
+namespace gb
+{
+  class APU;
+  class PPU;
+  
+  /*
+    0xFF00-0xFFFF: hardware registers, HRAM and IE. Registers without a device behind them
+    behave as plain storage.
+  */
+  class IO : public devices::Memory
+  {
+  public:
+    enum : u8
+    {
+      JOYP = 0x00,
+      SB = 0x01,
+      SC = 0x02,
+      IF = 0x0F,
+      LCDC = 0x40,
+      DMA = 0x46,
+      WX = 0x4B,
+      IE = 0xFF,
+      
+      HRAM = 0x80
+    };
+    
+  protected:
+    std::array<u8, 256> _regs;
+    
+    Interrupts _interrupts;
+    Timer _timer;
+    /* owns NR10-NR52 and wave RAM */
+    APU* _apu;
+    /* owns LCDC-WX except DMA */
+    PPU* _ppu;
+    
+    /* bytes sent through the serial port, with no link partner every transfer completes at once */
+    std::string _serial;
+    
+  public:
+    IO(devices::Scheduler& scheduler);
+    
+    void reset();
+    
+    void attach(APU* apu) { _apu = apu; }
+    void attach(PPU* ppu) { _ppu = ppu; }
+    
+    Interrupts& interrupts() { return _interrupts; }
+    const std::string& serial() const { return _serial; }
+    
+    u8 read(devices::addr_t address) const override;
+    void write(devices::addr_t address, u8 value) override;
+    devices::cycle_t stableUntil(devices::addr_t address) const override;
+  };
+}
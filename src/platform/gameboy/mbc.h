@@ -0,0 +1,254 @@
+#pragma once
+
+#include "cartridge.h"
+
+namespace gb
+{
+  /*
+    memory bank controllers as policy types, Cartridge::load picks one according to header.cart_type
+    and binds Cartridge::writeMBC<T> / readMBC<T> so that the hot path never tests status.flags.
+
+    write() returns which windows of the cart must be remapped on the bus.
+  */
+  namespace mbc
+  {
+    enum Remap : u8
+    {
+      REMAP_NONE = 0x00,
+      REMAP_ROM = 0x01,
+      REMAP_RAM = 0x02
+    };
+
+    struct Base
+    {
+      /* the mask is the next power of two, what exceeds a bank count which isn't one is folded back */
+      static u16 romBank(const GB_CART_STATUS& status, u16 bank)
+      {
+        bank &= status.rom_bank_mask;
+        return bank < status.rom_banks ? bank : bank - status.rom_banks;
+      }
+
+      static u8 ramBank(const GB_CART_STATUS& status, u8 bank) { return bank & (status.ram_banks - 1); }
+
+      /* offset in status.ram of address in the RAM window, ram_size or more if it isn't backed */
+      static u32 ramOffset(const GB_CART_STATUS& status, u16 address) { return u32(status.ram_bank - status.ram) + (address - 0xA000); }
+
+      static u8 read(const GB_CART_STATUS& status, const RTC& rtc, u16 address)
+      {
+        // first 16kb -> rom_bank_0
+        if (address <= 0x3FFF)
+          return status.rom_bank_0[address];
+        // second 16k -> rom_bank_1
+        else if (address <= 0x7FFF)
+          return status.rom_bank_1[address - 0x4000];
+        // external ram 8k -> ram_bank
+        else if (address >= 0xA000 && address <= 0xBFFF && status.ram_bank && ramOffset(status, address) < status.ram_size)
+          return status.ram_bank[address - 0xA000];
+        else if (address >= 0xA000 && address <= 0xBFFF)
+          return 0xFF;
+
+        return 0;
+      }
+
+      /* this enables or less the RAM (and the RTC for MBC3) */
+      static u8 enableRam(GB_CART_STATUS& status, u8 value)
+      {
+        bool enabled = (value & 0x0A) == 0x0A;
+        u8 remap = enabled != status.ram_enabled ? REMAP_RAM : REMAP_NONE;
+        status.ram_enabled = enabled;
+        return remap;
+      }
+
+      /* only an actual change of bank needs the bus to decode the window again */
+      static u8 selectRom(GB_CART_STATUS& status, u16 bank)
+      {
+        status.current_rom_bank = bank;
+        u8* bankMemory = &status.rom[16_kb*romBank(status, bank)];
+        u8 remap = bankMemory != status.rom_bank_1 ? REMAP_ROM : REMAP_NONE;
+        status.rom_bank_1 = bankMemory;
+        return remap;
+      }
+
+      static u8 selectRam(GB_CART_STATUS& status, u8 bank)
+      {
+        status.current_ram_bank = bank;
+        u8* bankMemory = status.ram + 8_kb*ramBank(status, bank);
+        u8 remap = bankMemory != status.ram_bank ? REMAP_RAM : REMAP_NONE;
+        status.ram_bank = bankMemory;
+        return remap;
+      }
+
+      static u8 writeRam(GB_CART_STATUS& status, u16 address, u8 value)
+      {
+        // scrive basandosi sull'offset nel banco di RAM selezionato
+        if (status.ram_enabled && ramOffset(status, address) < status.ram_size)
+          status.ram_bank[address - 0xA000] = value;
+        return REMAP_NONE;
+      }
+    };
+
+    struct RomOnly : public Base
+    {
+      static u8 write(GB_CART_STATUS& status, RTC&, u16 address, u8 value)
+      {
+#ifdef DEBUGGER
+        if ((status.flags & MBC_SIMPLE) == MBC_SIMPLE)
+          status.rom[address] = value;
+#endif
+        return REMAP_NONE;
+      }
+    };
+
+    struct MBC1 : public Base
+    {
+      static u8 write(GB_CART_STATUS& status, RTC&, u16 address, u8 value)
+      {
+        if (address <= 0x1FFF)
+          return enableRam(status, value);
+        /* this switches ROM bank using 5 lower bits of data */
+        else if (address <= 0x3FFF)
+        {
+          // we select 5 lower bits of the value to set the lower part of the bank
+          u8 romBank = value & 0x1F;
+
+          // if it's zero we should increment by one
+          if (romBank == 0)
+            ++romBank;
+
+          // if we are in ROM banking mode we should keep bit 5-6 from current bank
+          // because they are set by writing at 0x4000-0x5FFF
+          if (status.rom_banking_mode)
+            return selectRom(status, (status.current_rom_bank & 0x60) | romBank);
+          else
+            return selectRom(status, romBank);
+        }
+        // in this address space we can either select bit 5-6 for ROM banks or bank 0-3 for RAM
+        // according to current banking mode
+        else if (address <= 0x5FFF)
+        {
+          if (status.rom_banking_mode)
+          {
+            // we mix lower 5 bits of current rom bank with bit 5-6 of the value provided to select rom bank
+            return selectRom(status, (status.current_rom_bank & 0x1F) | (value & 0x60));
+          }
+          else
+            return selectRam(status, value & 0x03);
+        }
+        // switching from ROM banking to RAM banking
+        else if (address <= 0x7FFF)
+        {
+          status.rom_banking_mode = value & 0x01;
+
+          // if we entered ROM banking mode we should restore
+          // ram bank to 0 since you cannot address anyone other
+          if (status.rom_banking_mode)
+            return selectRam(status, 0);
+        }
+        // RAM nella cart (più banchi switchabili nel caso, da 8kb l'uno)
+        else if (address >= 0xA000 && address <= 0xBFFF)
+          return writeRam(status, address, value);
+
+        return REMAP_NONE;
+      }
+    };
+
+    struct MBC2 : public Base
+    {
+      static u8 write(GB_CART_STATUS& status, RTC&, u16 address, u8 value)
+      {
+        if (address <= 0x1FFF)
+          return enableRam(status, value);
+        else if (address <= 0x3FFF)
+        {
+          return selectRom(status, value & 0x0F);
+        }
+        else if (address >= 0xA000 && address <= 0xA1FF)
+          return writeRam(status, address, value);
+
+        return REMAP_NONE;
+      }
+    };
+
+    struct MBC3 : public Base
+    {
+      static u8 read(const GB_CART_STATUS& status, const RTC& rtc, u16 address)
+      {
+        if (status.rtc_override && address >= 0xA000 && address <= 0xBFFF)
+          return rtc.read();
+
+        return Base::read(status, rtc, address);
+      }
+
+      static u8 write(GB_CART_STATUS& status, RTC& rtc, u16 address, u8 value)
+      {
+        if (address <= 0x1FFF)
+          return enableRam(status, value);
+        /* selects rom bank 01h to 7fh (7 bits) */
+        else if (address <= 0x3FFF)
+        {
+          u8 romBank = value & 0x7F;
+
+          if (romBank == 0) romBank = 1;
+
+          return selectRom(status, romBank);
+        }
+        /* select RAM bank or RTC register */
+        else if (address <= 0x5FFF)
+        {
+          if (value < 0x04)
+          {
+            u8 remap = status.rtc_override ? REMAP_RAM : REMAP_NONE;
+            status.rtc_override = false;
+            return remap | selectRam(status, value & 0x0F);
+          }
+          else if (value >= 0x08 && value <= 0x0C)
+          {
+            /* selects RTC register and mark that writes/read will occur there */
+            rtc.select(value);
+            u8 remap = status.rtc_override ? REMAP_NONE : REMAP_RAM;
+            status.rtc_override = true;
+            return remap;
+          }
+        }
+        /* RCT latch, this will freeze RTC registers until latched again */
+        else if (address <= 0x7FFF)
+          rtc.writeLatch(value);
+        else if (address >= 0xA000 && address <= 0xBFFF)
+        {
+          if (status.ram_enabled && status.rtc_override)
+            rtc.writeData(value);
+          else
+            return writeRam(status, address, value);
+        }
+
+        return REMAP_NONE;
+      }
+    };
+
+    struct MBC5 : public Base
+    {
+      static u8 write(GB_CART_STATUS& status, RTC&, u16 address, u8 value)
+      {
+        if (address <= 0x1FFF)
+          return enableRam(status, value);
+        // this sets 8 lower bits of 9bits for rom bank choose
+        else if (address <= 0x2FFF)
+        {
+          return selectRom(status, (status.current_rom_bank & 0xFF00) | value);
+        }
+        else if (address <= 0x3FFF)
+        {
+          return selectRom(status, (status.current_rom_bank & 0xFF) | ((((u16)value) & 0x01) << 8));
+        }
+        else if (address <= 0x5FFF)
+        {
+          return selectRam(status, value & 0x0F);
+        }
+        else if (address >= 0xA000 && address <= 0xBFFF)
+          return writeRam(status, address, value);
+
+        return REMAP_NONE;
+      }
+    };
+  }
+}
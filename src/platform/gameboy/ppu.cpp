@@ -0,0 +1,383 @@
+#include "ppu.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace gb;
+
+namespace
+{
+  constexpr u32 OAM_SCAN_CYCLES = 80;
+  constexpr u32 TRANSFER_CYCLES = 172;
+  
+  constexpr size_t MAX_SPRITES_PER_LINE = 10;
+  
+  /* STAT interrupt enables */
+  constexpr u8 STAT_HBLANK = 0x08;
+  constexpr u8 STAT_VBLANK = 0x10;
+  constexpr u8 STAT_OAM = 0x20;
+  constexpr u8 STAT_LYC = 0x40;
+}
+
+PPU::PPU(devices::Scheduler& scheduler, Interrupts& interrupts) :
+  LazyDevice(scheduler), _interrupts(interrupts), _vramDevice(*this), _oamDevice(*this),
+  _screen(SCREEN_WIDTH, SCREEN_HEIGHT), _back(SCREEN_WIDTH, SCREEN_HEIGHT)
+{
+  _vblankEvent = _scheduler.add("vblank", [this](devices::cycle_t when) { vblank(when); });
+  _statEvent = _scheduler.add("stat", [this](devices::cycle_t) {
+    _interrupts.request(Interrupts::STAT);
+    scheduleStat();
+  });
+  
+  reset();
+}
+
+void PPU::setShades(const gfx::Pixel* shades)
+{
+  _screen.setPalette(shades, 4);
+  _back.setPalette(shades, 4);
+}
+
+void PPU::reset()
+{
+  _vram.fill(0);
+  _oam.fill(0);
+  _tiles.fill(0);
+  _dirty.fill(0);
+  
+  /* state left by the boot ROM */
+  _lcdc = 0x91;
+  _stat = 0x00;
+  _scy = _scx = 0;
+  _lyc = 0;
+  _bgp = 0xFC;
+  _obp0 = _obp1 = 0xFF;
+  _wy = _wx = 0;
+  _frames = 0;
+  
+  _screen.fill(0);
+  _back.fill(0);
+  
+  start();
+}
+
+void PPU::start()
+{
+  restart();
+  
+  _frameStart = _scheduler.now();
+  _renderedLines = 0;
+  _windowLine = 0;
+  
+  _scheduler.schedule(_vblankEvent, _frameStart + VBLANK_LINE * CYCLES_PER_LINE);
+  scheduleStat();
+}
+
+bool PPU::writeVram(devices::addr_t address, u8 value)
+{
+  if (_vram[address] == value)
+    return false;
+  
+  /* lines due so far are drawn with the old data */
+  sync();
+  _vram[address] = value;
+  
+  /* 0x8000-0x97FF is tile data, 16 bytes per tile */
+  if (address < TILE_COUNT * 16)
+  {
+    const size_t tile = address >> 4;
+    _dirty[tile >> 6] |= u64(1) << (tile & 63);
+  }
+  
+  return true;
+}
+
+void PPU::writeOam(devices::addr_t address, u8 value)
+{
+  if (address < _oam.size() && _oam[address] != value)
+  {
+    sync();
+    _oam[address] = value;
+  }
+}
+
+void PPU::decodeTiles()
+{
+  for (size_t word = 0; word < _dirty.size(); ++word)
+  {
+    for (u64 bits = _dirty[word]; bits; bits &= bits - 1)
+    {
+      const size_t tile = word * 64 + std::countr_zero(bits);
+      const u8* data = &_vram[tile * 16];
+      u8* out = &_tiles[tile * 64];
+      
+      for (size_t row = 0; row < 8; ++row)
+      {
+        const u8 low = data[row * 2], high = data[row * 2 + 1];
+        for (size_t x = 0; x < 8; ++x)
+          out[row * 8 + x] = u8(((low >> (7 - x)) & 1) | (((high >> (7 - x)) & 1) << 1));
+      }
+    }
+    
+    _dirty[word] = 0;
+  }
+}
+
+PPU::Mode PPU::mode() const
+{
+  if (!enabled())
+    return HBLANK;
+  
+  const u32 position = this->position();
+  if (position >= VBLANK_LINE * CYCLES_PER_LINE)
+    return VBLANK;
+  
+  const u32 dot = position % CYCLES_PER_LINE;
+  return dot < OAM_SCAN_CYCLES ? OAM_SCAN : (dot < OAM_SCAN_CYCLES + TRANSFER_CYCLES ? TRANSFER : HBLANK);
+}
+
+u8 PPU::read(u8 reg) const
+{
+  switch (reg)
+  {
+    case LCDC: return _lcdc;
+    case STAT: return 0x80 | (_stat & 0x78) | (enabled() && line() == _lyc ? 0x04 : 0x00) | mode();
+    case SCY: return _scy;
+    case SCX: return _scx;
+    case LY: return line();
+    case LYC: return _lyc;
+    case BGP: return _bgp;
+    case OBP0: return _obp0;
+    case OBP1: return _obp1;
+    case WY: return _wy;
+    case WX: return _wx;
+    default: return 0xFF;
+  }
+}
+
+void PPU::write(u8 reg, u8 value)
+{
+  /* the lines due so far are drawn with the values they saw */
+  sync();
+  
+  switch (reg)
+  {
+    case LCDC:
+    {
+      const bool wasEnabled = enabled();
+      _lcdc = value;
+      
+      if (wasEnabled && !enabled())
+      {
+        /* a disabled LCD shows nothing and restarts from the first line */
+        _scheduler.cancel(_vblankEvent);
+        _scheduler.cancel(_statEvent);
+        _screen.fill(0);
+      }
+      else if (!wasEnabled && enabled())
+        start();
+      break;
+    }
+    case STAT: _stat = value & 0x78; scheduleStat(); break;
+    case SCY: _scy = value; break;
+    case SCX: _scx = value; break;
+    case LYC: _lyc = value; scheduleStat(); break;
+    case BGP: _bgp = value; break;
+    case OBP0: _obp0 = value; break;
+    case OBP1: _obp1 = value; break;
+    case WY: _wy = value; break;
+    case WX: _wx = value; break;
+    default: break;
+  }
+}
+
+devices::cycle_t PPU::stableUntil(u8 reg) const
+{
+  if (!enabled() || (reg != LY && reg != STAT))
+    return devices::Scheduler::NEVER;
+  
+  const devices::cycle_t lineStart = _scheduler.now() - position() % CYCLES_PER_LINE;
+  
+  /* LY changes at the next line, STAT at the next mode change (or line, for the LYC flag) */
+  if (reg == STAT && mode() == OAM_SCAN)
+    return lineStart + OAM_SCAN_CYCLES;
+  else if (reg == STAT && mode() == TRANSFER)
+    return lineStart + OAM_SCAN_CYCLES + TRANSFER_CYCLES;
+  
+  return lineStart + CYCLES_PER_LINE;
+}
+
+void PPU::catchUp(devices::cycle_t from, devices::cycle_t to)
+{
+  if (!enabled())
+    return;
+  
+  for (;;)
+  {
+    const devices::cycle_t elapsed = to - _frameStart;
+    
+    /* lines whose transfer ended by now */
+    const u32 due = elapsed < OAM_SCAN_CYCLES + TRANSFER_CYCLES ? 0 :
+      std::min<u32>(VBLANK_LINE, u32((elapsed - OAM_SCAN_CYCLES - TRANSFER_CYCLES) / CYCLES_PER_LINE + 1));
+    
+    for (; _renderedLines < due; ++_renderedLines)
+      renderLine(u8(_renderedLines));
+    
+    if (elapsed < CYCLES_PER_FRAME)
+      break;
+    
+    _frameStart += CYCLES_PER_FRAME;
+    _renderedLines = 0;
+    _windowLine = 0;
+  }
+}
+
+void PPU::vblank(devices::cycle_t when)
+{
+  sync();
+  
+  std::swap(_screen, _back);
+  ++_frames;
+  _interrupts.request(Interrupts::VBLANK);
+  
+  _scheduler.schedule(_vblankEvent, when + CYCLES_PER_FRAME);
+}
+
+devices::cycle_t PPU::nextStatInterrupt() const
+{
+  if (!enabled() || !(_stat & (STAT_HBLANK | STAT_VBLANK | STAT_OAM | STAT_LYC)))
+    return devices::Scheduler::NEVER;
+  
+  const devices::cycle_t now = _scheduler.now();
+  const devices::cycle_t lineStart = now - position() % CYCLES_PER_LINE;
+  u32 ly = line();
+  
+  /* walks the lines from the current one, at most a whole frame */
+  for (devices::cycle_t start = lineStart; start <= lineStart + CYCLES_PER_FRAME; start += CYCLES_PER_LINE, ly = (ly + 1) % LINES_PER_FRAME)
+  {
+    if (ly < VBLANK_LINE)
+    {
+      if ((_stat & STAT_OAM) && start > now)
+        return start;
+      if ((_stat & STAT_LYC) && ly == _lyc && start > now)
+        return start;
+      if ((_stat & STAT_HBLANK) && start + OAM_SCAN_CYCLES + TRANSFER_CYCLES > now)
+        return start + OAM_SCAN_CYCLES + TRANSFER_CYCLES;
+    }
+    else if (start > now && ((ly == VBLANK_LINE && (_stat & STAT_VBLANK)) || ((_stat & STAT_LYC) && ly == _lyc)))
+      return start;
+  }
+  
+  return devices::Scheduler::NEVER;
+}
+
+void PPU::scheduleStat()
+{
+  const devices::cycle_t when = nextStatInterrupt();
+  
+  if (when == devices::Scheduler::NEVER)
+    _scheduler.cancel(_statEvent);
+  else
+    _scheduler.schedule(_statEvent, when);
+}
+
+void PPU::renderLine(u8 ly)
+{
+  decodeTiles();
+  
+  u8* out = _back.row(ly);
+  
+  /* color numbers of background and window, sprites behind them only show over color 0 */
+  std::array<u8, SCREEN_WIDTH> colors;
+  colors.fill(0);
+  
+  auto tileIndex = [this](u8 index) -> size_t { return (_lcdc & 0x10) ? index : 256 + s8(index); };
+  
+  if (_lcdc & 0x01)
+  {
+    /* whole tiles are copied into a line with room for the fine scroll on both sides */
+    std::array<u8, SCREEN_WIDTH + 16> line;
+    
+    const u8 y = u8(ly + _scy);
+    const u8* map = &_vram[((_lcdc & 0x08) ? 0x1C00 : 0x1800) + (y >> 3) * 32];
+    
+    for (size_t i = 0; i < SCREEN_WIDTH / 8 + 1; ++i)
+    {
+      const u8 index = map[((_scx >> 3) + i) & 31];
+      std::memcpy(&line[i * 8], &_tiles[tileIndex(index) * 64 + (y & 7) * 8], 8);
+    }
+    
+    std::memcpy(colors.data(), &line[_scx & 7], SCREEN_WIDTH);
+    
+    const int windowX = int(_wx) - 7;
+    if ((_lcdc & 0x20) && ly >= _wy && windowX < SCREEN_WIDTH)
+    {
+      const u8* windowMap = &_vram[((_lcdc & 0x40) ? 0x1C00 : 0x1800) + (_windowLine >> 3) * 32];
+      
+      for (size_t i = 0; i < SCREEN_WIDTH / 8 + 1; ++i)
+        std::memcpy(&line[i * 8], &_tiles[tileIndex(windowMap[i]) * 64 + (_windowLine & 7) * 8], 8);
+      
+      const int start = std::max(windowX, 0);
+      std::memcpy(&colors[start], &line[start - windowX], SCREEN_WIDTH - start);
+      ++_windowLine;
+    }
+  }
+  
+  const u8 bgShades[4] = { u8(_bgp & 3), u8((_bgp >> 2) & 3), u8((_bgp >> 4) & 3), u8(_bgp >> 6) };
+  for (int x = 0; x < SCREEN_WIDTH; ++x)
+    out[x] = bgShades[colors[x]];
+  
+  if (!(_lcdc & 0x02))
+    return;
+  
+  const int height = (_lcdc & 0x04) ? 16 : 8;
+  
+  /* first 10 sprites in OAM order which cover the line */
+  std::array<u8, MAX_SPRITES_PER_LINE> sprites;
+  size_t count = 0;
+  for (u8 i = 0; i < 40 && count < MAX_SPRITES_PER_LINE; ++i)
+  {
+    const int top = int(_oam[i * 4]) - 16;
+    if (ly >= top && ly < top + height)
+      sprites[count++] = i;
+  }
+  
+  /* lower X wins, then lower OAM index: draw from the lowest priority so the winner ends on top */
+  std::stable_sort(sprites.begin(), sprites.begin() + count, [this](u8 a, u8 b) { return _oam[a * 4 + 1] < _oam[b * 4 + 1]; });
+  
+  const u8 objShades[2][4] = {
+    { 0, u8((_obp0 >> 2) & 3), u8((_obp0 >> 4) & 3), u8(_obp0 >> 6) },
+    { 0, u8((_obp1 >> 2) & 3), u8((_obp1 >> 4) & 3), u8(_obp1 >> 6) }
+  };
+  
+  for (size_t s = count; s-- > 0; )
+  {
+    const u8* sprite = &_oam[sprites[s] * 4];
+    const u8 attributes = sprite[3];
+    
+    int row = ly - (int(sprite[0]) - 16);
+    if (attributes & 0x40)
+      row = height - 1 - row;
+    
+    u8 tile = sprite[2];
+    if (height == 16)
+      tile = u8((tile & 0xFE) | (row >> 3));
+    
+    const u8* pixels = &_tiles[tile * 64 + (row & 7) * 8];
+    const u8* shades = objShades[(attributes >> 4) & 1];
+    const bool flip = attributes & 0x20, behind = attributes & 0x80;
+    const int left = int(sprite[1]) - 8;
+    
+    for (int i = 0; i < 8; ++i)
+    {
+      const int x = left + i;
+      if (x < 0 || x >= SCREEN_WIDTH)
+        continue;
+      
+      const u8 color = pixels[flip ? 7 - i : i];
+      if (color && !(behind && colors[x]))
+        out[x] = shades[color];
+    }
+  }
+}
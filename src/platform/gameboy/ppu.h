@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common.h"
+#include "devices/component.h"
+#include "devices/lazy_device.h"
+#include "gfx/indexed_frame_buffer.h"
+#include "interrupts.h"
+
+#include <array>
+
+namespace gb
+{
+  constexpr int SCREEN_WIDTH = 160;
+  constexpr int SCREEN_HEIGHT = 144;
+  
+  /* 154 lines of 456 dots */
+  constexpr u32 CYCLES_PER_LINE = 456;
+  constexpr u32 LINES_PER_FRAME = 154;
+  constexpr u32 CYCLES_PER_FRAME = CYCLES_PER_LINE * LINES_PER_FRAME;
+  constexpr u32 VBLANK_LINE = 144;
+  
+  /*
+    DMG PPU, renders a whole scanline at the end of its pixel transfer with the registers of that
+    moment. Tile data is kept decoded as 8 color numbers per tile row: VRAM writes through the bus
+    mark the tile dirty and dirty tiles are decoded again before the next line is drawn, so drawing
+    background, window and sprites is copying rows and looking colors up in the palettes.
+    
+    Nothing runs per line: LY and the mode are derived from the clock, and the lines whose transfer
+    ended since the last sync are drawn at once when a register, VRAM or OAM is about to change, and
+    at VBLANK, which is the only event of a frame (plus STAT interrupts, when enabled). Lines are
+    drawn into a back buffer which becomes the screen at VBLANK.
+  */
+  class PPU : public devices::Component, public devices::LazyDevice
+  {
+  public:
+    enum Mode : u8 { HBLANK = 0, VBLANK = 1, OAM_SCAN = 2, TRANSFER = 3 };
+    
+    enum : u8
+    {
+      LCDC = 0x40,
+      STAT = 0x41,
+      SCY = 0x42,
+      SCX = 0x43,
+      LY = 0x44,
+      LYC = 0x45,
+      BGP = 0x47,
+      OBP0 = 0x48,
+      OBP1 = 0x49,
+      WY = 0x4A,
+      WX = 0x4B
+    };
+    
+    static constexpr size_t TILE_COUNT = 384;
+    
+  protected:
+    /* 0x8000-0x9FFF, reads go straight to memory, writes come here to track tiles */
+    struct VideoMemory : public devices::Memory
+    {
+      PPU& ppu;
+      VideoMemory(PPU& ppu) : ppu(ppu) { }
+      
+      u8 read(devices::addr_t address) const override { return ppu._vram[address]; }
+      /* the bus only sees read only memory, whatever was derived from it (eg. cached code) must hear about the change */
+      void write(devices::addr_t address, u8 value) override
+      {
+        if (ppu.writeVram(address, value) && _bus)
+          _bus->modified(&ppu._vram[address & ~devices::Bus::PAGE_MASK]);
+      }
+      u8* page(devices::addr_t address, bool write) override { return write ? nullptr : &ppu._vram[address]; }
+    };
+    
+    /* 0xFE00-0xFE9F */
+    struct ObjectMemory : public devices::Memory
+    {
+      PPU& ppu;
+      ObjectMemory(PPU& ppu) : ppu(ppu) { }
+      
+      u8 read(devices::addr_t address) const override { return address < ppu._oam.size() ? ppu._oam[address] : 0xFF; }
+      void write(devices::addr_t address, u8 value) override { ppu.writeOam(address, value); }
+    };
+    
+    Interrupts& _interrupts;
+    devices::Scheduler::Event* _vblankEvent;
+    devices::Scheduler::Event* _statEvent;
+    
+    std::array<u8, 8_kb> _vram;
+    std::array<u8, 0xA0> _oam;
+    VideoMemory _vramDevice;
+    ObjectMemory _oamDevice;
+    
+    /* 8 color numbers for each row of each tile, valid unless the tile is dirty */
+    std::array<u8, TILE_COUNT * 64> _tiles;
+    std::array<u64, TILE_COUNT / 64> _dirty;
+    
+    u8 _lcdc, _stat, _scy, _scx, _lyc, _bgp, _obp0, _obp1, _wy, _wx;
+    /* line of the window to draw next, it only advances on lines where the window is visible */
+    u8 _windowLine;
+    
+    /* start of line 0 of the current frame */
+    devices::cycle_t _frameStart;
+    /* lines of the current frame already in the back buffer */
+    u32 _renderedLines;
+    
+    gfx::IndexedFrameBuffer _screen;
+    gfx::IndexedFrameBuffer _back;
+    u64 _frames;
+    
+    bool enabled() const { return (_lcdc & 0x80) != 0; }
+    
+    /* false if the value didn't change */
+    bool writeVram(devices::addr_t address, u8 value);
+    void writeOam(devices::addr_t address, u8 value);
+    void decodeTiles();
+    
+    /* cycles since the start of the current frame, the frame only rolls over in catchUp() so this can be past its end */
+    u32 position() const { return u32((_scheduler.now() - _frameStart) % CYCLES_PER_FRAME); }
+    u8 line() const { return enabled() ? u8(position() / CYCLES_PER_LINE) : 0; }
+    Mode mode() const;
+    
+    void catchUp(devices::cycle_t from, devices::cycle_t to) override;
+    void vblank(devices::cycle_t when);
+    
+    /* first cycle after now at which an enabled STAT source triggers */
+    devices::cycle_t nextStatInterrupt() const;
+    void scheduleStat();
+    
+    void start();
+    void renderLine(u8 ly);
+    
+  public:
+    PPU(devices::Scheduler& scheduler, Interrupts& interrupts);
+    
+    std::string name() const override { return "PPU"; }
+    
+    void reset();
+    
+    devices::Memory* vram() { return &_vramDevice; }
+    devices::Memory* oam() { return &_oamDevice; }
+    
+    u8 read(u8 reg) const;
+    void write(u8 reg, u8 value);
+    /* see devices::Memory::stableUntil(), LY and STAT change with the clock */
+    devices::cycle_t stableUntil(u8 reg) const;
+    
+    /* last complete frame, shades 0-3 */
+    const gfx::IndexedFrameBuffer& screen() const { return _screen; }
+    void setShades(const gfx::Pixel* shades);
+    
+    u64 frames() const { return _frames; }
+  };
+}
@@ -0,0 +1,220 @@
+#include "rom_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+
+#if !_WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace gb;
+
+namespace
+{
+  /* FNV-1a over 64 bit words, tail is padded with zeroes */
+  u64 contentHash(const u8* data, size_t length)
+  {
+    constexpr u64 PRIME = 0x100000001B3ULL;
+    u64 hash = 0xCBF29CE484222325ULL ^ length;
+    
+    size_t i = 0;
+    for (; i + sizeof(u64) <= length; i += sizeof(u64))
+    {
+      u64 word;
+      memcpy(&word, data + i, sizeof(u64));
+      hash = (hash ^ word) * PRIME;
+    }
+    
+    if (i < length)
+    {
+      u64 word = 0;
+      memcpy(&word, data + i, length - i);
+      hash = (hash ^ word) * PRIME;
+    }
+    
+    return hash;
+  }
+}
+
+RomImage::~RomImage()
+{
+  if (!_file)
+    free(_data);
+}
+
+bool RomImage::loadBuffered(const path& fileName)
+{
+  FILE *in = fopen(fileName.c_str(), "rb");
+  
+  if (!in)
+    return false;
+  
+  /* size is not known upfront for non regular files, grow while reading, always at least 2 banks */
+  size_t capacity = 32_kb, length = 0, count = 0;
+  u8* data = (u8*)calloc(capacity, sizeof(u8));
+  
+  while ((count = fread(data + length, 1, capacity - length, in)) > 0)
+  {
+    length += count;
+    
+    if (length == capacity)
+    {
+      data = (u8*)realloc(data, capacity * 2);
+      memset(data + capacity, 0, capacity);
+      capacity *= 2;
+    }
+  }
+  
+  fclose(in);
+  
+  _data = data;
+  _length = length;
+  return true;
+}
+
+std::unique_ptr<RomImage> RomImage::load(const path& fileName, map_mode mode)
+{
+  auto image = std::make_unique<RomImage>();
+  mapped_file& file = image->_file;
+  
+  /* regular files are mapped so that startup doesn't copy anything and instances of the same ROM
+     share physical pages, banks must be whole otherwise a bank pointer could run past the mapping */
+  if (file.map(fileName, mode) && file.length() >= 32_kb && file.length() % 16_kb == 0)
+  {
+    image->_data = file.data();
+    image->_length = file.length();
+    
+    /* bank 0 is always hit, switchable banks are accessed by bank number */
+    file.advise(0, 16_kb, map_advice::WILLNEED);
+    file.advise(16_kb, file.length() - 16_kb, map_advice::RANDOM);
+  }
+  else
+  {
+    file.unmap();
+    if (!image->loadBuffered(fileName))
+      return nullptr;
+  }
+  
+  image->_hash = contentHash(image->_data, image->_length);
+  return image;
+}
+
+RomCache& RomCache::i()
+{
+  static RomCache instance;
+  return instance;
+}
+
+bool RomCache::FileKey::operator<(const FileKey& other) const
+{
+  return std::tie(path, size, modified, inode) < std::tie(other.path, other.size, other.modified, other.inode);
+}
+
+bool RomCache::identify(const path& fileName, FileKey& key)
+{
+  std::error_code error;
+  const auto fspath = std::filesystem::absolute(fileName.fspath(), error);
+  
+  if (error || !std::filesystem::is_regular_file(fspath, error))
+    return false;
+  
+  key.path = fspath.string();
+  key.size = std::filesystem::file_size(fspath, error);
+  key.modified = std::filesystem::last_write_time(fspath, error).time_since_epoch().count();
+  key.inode = 0;
+  
+#if !_WIN32
+  /* a file replaced by another one (eg. renamed over) can keep size and time, not the inode */
+  struct stat info;
+  if (stat(key.path.c_str(), &info) == 0)
+    key.inode = u64(info.st_ino) ^ (u64(info.st_dev) << 32);
+#endif
+  
+  return !error;
+}
+
+void RomCache::purge()
+{
+  for (auto it = _images.begin(); it != _images.end(); )
+    it = it->second.expired() ? _images.erase(it) : std::next(it);
+  
+  for (auto it = _files.begin(); it != _files.end(); )
+    it = it->second.expired() ? _files.erase(it) : std::next(it);
+}
+
+std::shared_ptr<const RomImage> RomCache::acquire(const path& fileName)
+{
+  FileKey key;
+  const bool identified = identify(fileName, key);
+  
+  /* an unchanged file which is still loaded is neither mapped nor hashed again */
+  if (identified)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    auto it = _files.find(key);
+    if (it != _files.end())
+    {
+      if (auto existing = it->second.lock())
+        return existing;
+    }
+  }
+  
+  std::shared_ptr<const RomImage> image = RomImage::load(fileName, map_mode::READING);
+  
+  if (!image)
+    return nullptr;
+  
+  std::lock_guard<std::mutex> lock(_mutex);
+  
+  purge();
+  
+  /* the hash only finds candidates, both images are mapped so comparing them is cheap */
+  std::shared_ptr<const RomImage> shared;
+  auto range = _images.equal_range(image->hash());
+  
+  for (auto it = range.first; it != range.second && !shared; ++it)
+  {
+    auto existing = it->second.lock();
+    if (existing && existing->length() == image->length() && !memcmp(existing->data(), image->data(), image->length()))
+      shared = existing;
+  }
+  
+  if (!shared)
+  {
+    _images.emplace(image->hash(), image);
+    shared = image;
+  }
+  
+  if (identified)
+    _files[key] = shared;
+  
+  return shared;
+}
+
+RomCache::Stats RomCache::stats() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  
+  Stats stats = { 0, 0, 0, 0 };
+  
+  for (const auto& entry : _images)
+  {
+    auto image = entry.second.lock();
+    
+    if (image)
+    {
+      /* the local copy just taken doesn't count */
+      size_t references = entry.second.use_count() - 1;
+      
+      ++stats.images;
+      stats.references += references;
+      stats.held += image->length();
+      stats.requested += image->length() * references;
+    }
+  }
+  
+  return stats;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "common.h"
+#include "base/path.h"
+#include "base/mapped_file.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace gb
+{
+  /* immutable contents of a ROM file, either mapped or read into a buffer */
+  class RomImage
+  {
+  private:
+    mapped_file _file;
+    u8* _data;
+    size_t _length;
+    u64 _hash;
+    
+    /* reads the whole ROM into a buffer, used when the file can't be mapped */
+    bool loadBuffered(const path& fileName);
+    
+  public:
+    RomImage() : _data(nullptr), _length(0), _hash(0) { }
+    RomImage(const RomImage&) = delete;
+    ~RomImage();
+    
+    static std::unique_ptr<RomImage> load(const path& fileName, map_mode mode);
+    
+    u8* data() const { return _data; }
+    size_t length() const { return _length; }
+    u64 hash() const { return _hash; }
+    bool mapped() const { return _file; }
+  };
+  
+  /*
+    process wide cache of ROM images keyed by content hash: any number of cartridges loading the
+    same game share a single image, only their RAM/RTC state is per instance. Images are dropped as
+    soon as the last cartridge referencing them goes away.
+
+    A file which was already loaded and didn't change since (same path, size, modification time and
+    inode) gets its image back without being read, only other files are loaded and hashed. Images
+    with the same hash are compared byte by byte before being shared.
+  */
+  class RomCache
+  {
+  public:
+    struct Stats
+    {
+      size_t images;
+      size_t references;
+      /* bytes of the images, mapped or buffered, and bytes that would be held without sharing. How
+         much of a mapped image is actually resident is up to the OS, see headless --bench romcache */
+      size_t held;
+      size_t requested;
+    };
+    
+  private:
+    struct FileKey
+    {
+      std::string path;
+      u64 size;
+      s64 modified;
+      u64 inode;
+
+      bool operator<(const FileKey& other) const;
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_multimap<u64, std::weak_ptr<const RomImage>> _images;
+    std::map<FileKey, std::weak_ptr<const RomImage>> _files;
+
+    /* false for anything which isn't a regular file, those are always loaded */
+    static bool identify(const path& fileName, FileKey& key);
+    void purge();
+    
+  public:
+    static RomCache& i();
+    
+    std::shared_ptr<const RomImage> acquire(const path& fileName);
+    
+    Stats stats() const;
+  };
+}
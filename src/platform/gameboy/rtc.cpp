@@ -1 +1,40 @@
-#include "rtc.h"
\ No newline at end of file
+#include "rtc.h"
+
+using namespace gb;
+
+void RTC::tick()
+{
+  if (++data[SECONDS] < 60)
+    return;
+  data[SECONDS] = 0;
+  
+  if (++data[MINUTES] < 60)
+    return;
+  data[MINUTES] = 0;
+  
+  if (++data[HOURS] < 24)
+    return;
+  data[HOURS] = 0;
+  
+  /* 9 bit day counter, bit 8 lives in DAYS_HIGH and overflowing it sets the carry until software clears it */
+  if (++data[DAYS_LOW] == 0)
+  {
+    if (data[DAYS_HIGH] & DAY_MSB)
+      data[DAYS_HIGH] = (data[DAYS_HIGH] & ~DAY_MSB) | DAY_CARRY;
+    else
+      data[DAYS_HIGH] |= DAY_MSB;
+  }
+}
+
+void RTC::run(u32 elapsed)
+{
+  if (halted())
+    return;
+  
+  cycles += elapsed;
+  while (cycles >= CYCLES_PER_SECOND)
+  {
+    cycles -= CYCLES_PER_SECOND;
+    tick();
+  }
+}
@@ -2,6 +2,7 @@
 
 #include "common.h"
 
+#include <algorithm>
 #include <array>
 
 namespace gb
@@ -10,6 +11,13 @@ namespace gb
   {
     static constexpr u8 BASE_REG = 0x08;
     
+    enum : u8 { SECONDS = 0, MINUTES, HOURS, DAYS_LOW, DAYS_HIGH };
+    
+    /* bits of DAYS_HIGH */
+    static constexpr u8 DAY_MSB = 0x01;
+    static constexpr u8 HALT = 0x40;
+    static constexpr u8 DAY_CARRY = 0x80;
+    
   private:
     using Regs = std::array<u8, 5>;
     
@@ -18,8 +26,17 @@ namespace gb
     u8 selectedReg;
     bool preparedToLatch;
     
+    /* cycles accumulated towards the next second */
+    u32 cycles;
+    
+    /* advances the counters by one second */
+    void tick();
+    
   public:
-    RTC() : data({0,0,0,0,0}), latched({0,0,0,0,0}), selectedReg(0) { }
+    /* the RTC counts seconds from the 32768Hz crystal, expressed in machine cycles */
+    static constexpr u32 CYCLES_PER_SECOND = 4194304;
+    
+    RTC() : data({0,0,0,0,0}), latched({0,0,0,0,0}), selectedReg(0), preparedToLatch(false), cycles(0) { }
     
     
     void select(u8 value)
@@ -31,21 +48,26 @@ namespace gb
     
     void writeData(u8 value)
     {
+      data[selectedReg] = value;
       latched[selectedReg] = value;
       
       //printf("RTC Write at %02x: %02x\n", BASE_REG+selectedReg, value);
       
     }
     
+    /* a 0x00 followed by 0x01 copies the running counters into the readable ones */
     void writeLatch(u8 v)
     {
-      if (v == 0x00 && !preparedToLatch)
-        preparedToLatch = true;
-      else if (v == 0x01 && preparedToLatch)
-        std::copy(data.begin(), data.end(), data.begin());
+      if (v == 0x01 && preparedToLatch)
+        std::copy(data.begin(), data.end(), latched.begin());
+      
+      preparedToLatch = v == 0x00;
     }
 
-    void run(u32 cycles);
+    bool halted() const { return (data[DAYS_HIGH] & HALT) != 0; }
+
+    /* advances the clock by elapsed machine cycles, meant to be driven by a scheduler event */
+    void run(u32 elapsed);
     
     
   };
@@ -0,0 +1,201 @@
+#include "save.h"
+
+#include "base/file_system.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+
+using namespace gb;
+
+SaveWriter::SaveWriter(const path& path, const u8* data, size_t size) : _path(path), _data(data), _size(std::min(size, size_t(32_kb))), _snapshot(_size)
+{
+  for (auto& word : _dirty)
+    word.store(0, std::memory_order_relaxed);
+}
+
+bool SaveWriter::writeAll()
+{
+  path temporary = _path.str() + ".tmp";
+  
+  if (temporary.writeAll(_snapshot.data(), 1, _size) != 1)
+    return false;
+  
+  /* rename is atomic, readers see either the old or the new save */
+  std::error_code error;
+  std::filesystem::rename(temporary.fspath(), _path.fspath(), error);
+  return !error;
+}
+
+bool SaveWriter::flush()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  
+  std::array<u64, PAGES / 64> dirty;
+  size_t count = 0;
+  
+  /* bits are cleared before copying, a store racing with the copy marks the page again */
+  for (size_t i = 0; i < dirty.size(); ++i)
+  {
+    dirty[i] = _dirty[i].exchange(0, std::memory_order_acquire);
+    count += std::popcount(dirty[i]);
+  }
+  
+  if (count == 0)
+    return true;
+  
+  const size_t pages = (_size + PAGE_SIZE - 1) / PAGE_SIZE;
+  const bool whole = _path.length() != _size || count > pages / 2;
+  bool success = false;
+  
+  /* the copy is short compared to the file writes, which then can't observe stores anymore */
+  for (size_t page = 0; page < pages; ++page)
+  {
+    if (whole || (dirty[page >> 6] & (1ULL << (page & 63))))
+    {
+      size_t offset = page * PAGE_SIZE, length = std::min(PAGE_SIZE, _size - offset);
+      memcpy(_snapshot.data() + offset, _data + offset, length);
+    }
+  }
+  
+  if (whole)
+    success = writeAll();
+  else
+  {
+    FILE* out = fopen(_path.c_str(), "rb+");
+    
+    if (out)
+    {
+      success = true;
+      
+      for (size_t page = 0; page < pages; ++page)
+      {
+        if (dirty[page >> 6] & (1ULL << (page & 63)))
+        {
+          size_t offset = page * PAGE_SIZE, length = std::min(PAGE_SIZE, _size - offset);
+          success &= fseek(out, long(offset), SEEK_SET) == 0 && fwrite(_snapshot.data() + offset, 1, length, out) == length;
+        }
+      }
+      
+      success &= fclose(out) == 0;
+    }
+  }
+  
+  /* nothing is lost on failure, pages are tried again on next flush */
+  if (!success)
+  {
+    for (size_t i = 0; i < dirty.size(); ++i)
+      _dirty[i].fetch_or(dirty[i], std::memory_order_relaxed);
+  }
+  
+  return success;
+}
+
+SaveSync::SaveSync() : _busy(nullptr), _period(1000), _running(false)
+{
+  
+}
+
+SaveSync::~SaveSync()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  
+  _wakeup.notify_all();
+  
+  if (_thread.joinable())
+    _thread.join();
+}
+
+SaveSync& SaveSync::i()
+{
+  static SaveSync instance;
+  return instance;
+}
+
+void SaveSync::run()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  std::vector<const mapped_file*> files;
+  std::vector<SaveWriter*> writers;
+  
+  /* saves are flushed unlocked, so add() and remove() never wait for file I/O of other saves */
+  auto flushAll = [this, &lock](const auto& registered, const auto& snapshot, auto flush) {
+    for (auto* save : snapshot)
+    {
+      /* removed while the previous one was being flushed */
+      if (std::find(registered.begin(), registered.end(), save) == registered.end())
+        continue;
+      
+      _busy = save;
+      lock.unlock();
+      flush(save);
+      lock.lock();
+      _busy = nullptr;
+      _idle.notify_all();
+    }
+  };
+  
+  while (_running)
+  {
+    _wakeup.wait_for(lock, _period);
+    
+    files = _files;
+    writers = _writers;
+    
+    /* just schedules the write back, the blocking sync is left to dumpSave() and ~Cartridge() */
+    flushAll(_files, files, [](const mapped_file* file) { file->sync(true); });
+    flushAll(_writers, writers, [](SaveWriter* writer) { writer->flush(); });
+  }
+}
+
+void SaveSync::start()
+{
+  /* thread is started lazily, processes which never persist a save don't pay for it */
+  if (!_running)
+  {
+    _running = true;
+    _thread = std::thread(&SaveSync::run, this);
+  }
+}
+
+void SaveSync::add(const mapped_file* file)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _files.push_back(file);
+  start();
+}
+
+void SaveSync::add(SaveWriter* writer)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _writers.push_back(writer);
+  start();
+}
+
+void SaveSync::remove(const mapped_file* file)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _files.erase(std::remove(_files.begin(), _files.end(), file), _files.end());
+  _idle.wait(lock, [this, file] { return _busy != file; });
+}
+
+void SaveSync::remove(SaveWriter* writer)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _writers.erase(std::remove(_writers.begin(), _writers.end(), writer), _writers.end());
+  _idle.wait(lock, [this, writer] { return _busy != writer; });
+}
+
+void SaveSync::setPeriod(std::chrono::milliseconds period)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _period = period;
+  }
+  
+  _wakeup.notify_all();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "common.h"
+#include "base/path.h"
+#include "base/mapped_file.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gb
+{
+  /* how battery backed RAM is persisted to the .sav file */
+  enum class SaveMode
+  {
+    /* RAM is on the heap, written back only by Cartridge::dumpSave() */
+    MANUAL,
+    /* RAM is a shared mapping of the .sav file, flushed periodically by SaveSync */
+    MAPPED,
+    /* RAM is on the heap, stores mark dirty pages which SaveSync writes in background */
+    ASYNC,
+  };
+  
+  /*
+    tracks which PAGE_SIZE pages of cartridge RAM were written since the last flush, so that
+    flushing rewrites just those pages in place. When the file is missing, has the wrong size or
+    most pages are dirty the whole RAM is written to a temporary file which is then renamed over
+    the save, so a crash never leaves a half written .sav behind.
+
+    A flush clears the dirty bits, copies the pages into a snapshot and writes the file from that.
+    The emulation thread keeps running meanwhile, so a store landing while its page is copied can
+    leave the page torn in the snapshot. Such a store always sets its bit again after the clear, so
+    the page is rewritten by the next flush: a torn page only lasts one period, the same as any
+    store made after the snapshot. The flush done once emulation stopped (dumpSave(), destructor)
+    writes exactly what is in RAM.
+  */
+  class SaveWriter
+  {
+  public:
+    static constexpr size_t PAGE_SIZE = 256;
+    
+  private:
+    static constexpr size_t PAGES = 32_kb / PAGE_SIZE;
+    
+    path _path;
+    const u8* _data;
+    size_t _size;
+    
+    std::array<std::atomic<u64>, PAGES / 64> _dirty;
+    /* serializes flushes from SaveSync and explicit ones */
+    std::mutex _mutex;
+    /* pages being flushed, the file is written from here rather than from the live RAM */
+    std::vector<u8> _snapshot;
+    
+    bool writeAll();
+    
+  public:
+    SaveWriter(const path& path, const u8* data, size_t size);
+    
+    /* called by the emulation thread after every store into RAM. The or can't be skipped when the bit
+       is seen set: flush() may have cleared it and copied the page before the store was visible */
+    void touch(size_t offset)
+    {
+      if (offset >= _size)
+        return;
+      
+      const size_t page = offset / PAGE_SIZE;
+      _dirty[page >> 6].fetch_or(1ULL << (page & 63), std::memory_order_release);
+    }
+    
+    bool flush();
+  };
+  
+  /*
+    background thread which periodically flushes saves. Mapped save files get an asynchronous msync:
+    the emulation thread just writes to memory and the kernel already owns the dirty pages so a crash
+    of the process loses nothing, syncing only guards against losing them on a system crash. SaveWriters
+    get their dirty pages written out.
+  */
+  class SaveSync
+  {
+  private:
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    /* signaled whenever the thread is done with the save it was flushing */
+    std::condition_variable _idle;
+    std::thread _thread;
+    std::vector<const mapped_file*> _files;
+    std::vector<SaveWriter*> _writers;
+    /* save being flushed without holding the lock, remove() waits for it */
+    const void* _busy;
+    std::chrono::milliseconds _period;
+    bool _running;
+    
+    void run();
+    void start();
+    
+    SaveSync();
+    ~SaveSync();
+    
+  public:
+    static SaveSync& i();
+    
+    void add(const mapped_file* file);
+    void add(SaveWriter* writer);
+    /* return once the save is not being flushed anymore, so it can be safely released, other
+       saves being flushed meanwhile don't delay it */
+    void remove(const mapped_file* file);
+    void remove(SaveWriter* writer);
+    
+    void setPeriod(std::chrono::milliseconds period);
+  };
+}
@@ -0,0 +1,110 @@
+#include "timer.h"
+
+using namespace gb;
+
+Timer::Timer(devices::Scheduler& scheduler, Interrupts& interrupts) : LazyDevice(scheduler), _interrupts(interrupts)
+{
+  _overflow = _scheduler.add("timer", [this](devices::cycle_t) {
+    sync();
+    reschedule();
+  });
+  
+  reset();
+}
+
+void Timer::reset()
+{
+  _divBase = _scheduler.now();
+  restart();
+  _tima = 0;
+  _tma = 0;
+  _tac = 0xF8;
+  
+  _scheduler.cancel(_overflow);
+}
+
+u32 Timer::period() const
+{
+  static constexpr u32 periods[] = { 1024, 16, 64, 256 };
+  return periods[_tac & 0x03];
+}
+
+u64 Timer::ticks(devices::cycle_t from, devices::cycle_t to) const
+{
+  if (!enabled())
+    return 0;
+  
+  const u32 p = period();
+  return (to - _divBase) / p - (from - _divBase) / p;
+}
+
+void Timer::catchUp(devices::cycle_t from, devices::cycle_t to)
+{
+  u64 count = ticks(from, to);
+  
+  if (_tima + count < 256)
+  {
+    _tima += u8(count);
+    return;
+  }
+  
+  /* overflowed at least once: reloads from TMA, then counts up from there */
+  count -= 256 - _tima;
+  _tima = u8(_tma + count % (256 - _tma));
+  _interrupts.request(Interrupts::TIMER);
+}
+
+void Timer::reschedule()
+{
+  if (!enabled())
+  {
+    _scheduler.cancel(_overflow);
+    return;
+  }
+  
+  /* the overflow happens on the (256 - TIMA)th falling edge from now */
+  const u32 p = period();
+  const u64 edge = (_scheduler.now() - _divBase) / p + (256 - _tima);
+  _scheduler.schedule(_overflow, _divBase + edge * p);
+}
+
+u8 Timer::read(u8 reg) const
+{
+  switch (reg)
+  {
+    case DIV: return u8((_scheduler.now() - _divBase) >> 8);
+    /* the overflow event fires before the CPU can run past it, TIMA can't wrap in between */
+    case TIMA: return u8(_tima + ticks(_synced, _scheduler.now()));
+    case TMA: return _tma;
+    case TAC: return _tac;
+    default: return 0xFF;
+  }
+}
+
+devices::cycle_t Timer::stableUntil(u8 reg) const
+{
+  const devices::cycle_t elapsed = _scheduler.now() - _divBase;
+  
+  if (reg == DIV)
+    return _divBase + (elapsed / 256 + 1) * 256;
+  else if (reg == TIMA && enabled())
+    return _divBase + (elapsed / period() + 1) * period();
+  
+  return devices::Scheduler::NEVER;
+}
+
+void Timer::write(u8 reg, u8 value)
+{
+  sync();
+  
+  switch (reg)
+  {
+    case DIV: _divBase = _scheduler.now(); break;
+    case TIMA: _tima = value; break;
+    case TMA: _tma = value; return;
+    case TAC: _tac = 0xF8 | (value & 0x07); break;
+    default: return;
+  }
+  
+  reschedule();
+}
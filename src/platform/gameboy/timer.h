@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.h"
+#include "devices/lazy_device.h"
+#include "interrupts.h"
+
+namespace gb
+{
+  /*
+    DIV/TIMA/TMA/TAC. Nothing is ticked per cycle: DIV is derived from the scheduler clock, TIMA is
+    brought up to date when it is accessed and an event is scheduled at the cycle it will overflow.
+  */
+  class Timer : public devices::LazyDevice
+  {
+  public:
+    enum : u8 { DIV = 0x04, TIMA = 0x05, TMA = 0x06, TAC = 0x07 };
+    
+  protected:
+    Interrupts& _interrupts;
+    devices::Scheduler::Event* _overflow;
+    
+    /* cycle at which the 16 bit internal counter (DIV is its upper byte) was 0 */
+    devices::cycle_t _divBase;
+    
+    u8 _tima;
+    u8 _tma;
+    u8 _tac;
+    
+    bool enabled() const { return (_tac & 0x04) != 0; }
+    /* cycles per TIMA increment */
+    u32 period() const;
+    /* TIMA increments between two cycles, from the falling edges of the selected counter bit */
+    u64 ticks(devices::cycle_t from, devices::cycle_t to) const;
+    
+    void catchUp(devices::cycle_t from, devices::cycle_t to) override;
+    void reschedule();
+    
+  public:
+    Timer(devices::Scheduler& scheduler, Interrupts& interrupts);
+    
+    void reset();
+    
+    u8 read(u8 reg) const;
+    /* next cycle at which DIV or TIMA change on their own */
+    devices::cycle_t stableUntil(u8 reg) const;
+    void write(u8 reg, u8 value);
+  };
+}
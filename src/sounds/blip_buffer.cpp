@@ -0,0 +1,187 @@
+#include "blip_buffer.h"
+
+#include "base/simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+using namespace sounds;
+
+namespace
+{
+  constexpr double PI = 3.14159265358979323846;
+
+  constexpr u32 FRACTION_BITS = 32;
+  constexpr u64 FRACTION_MASK = (u64(1) << FRACTION_BITS) - 1;
+
+  /* an event at sample position p is centered on p + DELAY, which keeps the whole kernel after p */
+  constexpr size_t DELAY = BlipBuffer::KERNEL_WIDTH / 2 - 1;
+
+  /* slow leak of the integrator, keeps rounding errors from accumulating as DC (~1Hz at 44.1kHz) */
+  constexpr float LEAK = 1.0f - 1.0f / 8192.0f;
+  /* ~-120dB */
+  constexpr float SILENCE = 1e-6f;
+
+  using Kernel = std::array<std::array<float, BlipBuffer::KERNEL_WIDTH>, BlipBuffer::PHASES>;
+
+  const Kernel& kernel()
+  {
+    static const Kernel table = []() {
+      Kernel table;
+
+      /* cutoff in cycles per host sample, a bit below Nyquist */
+      const double cutoff = 0.45;
+      const double half = BlipBuffer::KERNEL_WIDTH / 2.0;
+
+      for (size_t p = 0; p < BlipBuffer::PHASES; ++p)
+      {
+        const double fraction = double(p) / BlipBuffer::PHASES;
+        double sum = 0.0;
+
+        for (size_t k = 0; k < BlipBuffer::KERNEL_WIDTH; ++k)
+        {
+          const double x = double(k) - fraction - double(DELAY);
+          const double arg = 2.0 * cutoff * x;
+          const double sinc = arg == 0.0 ? 1.0 : std::sin(PI * arg) / (PI * arg);
+          const double window = std::abs(x) >= half ? 0.0 : 0.42 + 0.5 * std::cos(PI * x / half) + 0.08 * std::cos(2.0 * PI * x / half);
+
+          table[p][k] = float(sinc * window);
+          sum += table[p][k];
+        }
+
+        /* each step must integrate to exactly its delta */
+        for (float& value : table[p])
+          value = float(value / sum);
+      }
+
+      return table;
+    }();
+
+    return table;
+  }
+}
+
+BlipBuffer::BlipBuffer(float clockRate, float sampleRate) : _clockRate(0.0f), _sampleRate(0.0f), _factor(0), _offset(0), _used(0), _integrator(0.0f)
+{
+  setRates(clockRate, sampleRate);
+  clear();
+}
+
+void BlipBuffer::setRates(float clockRate, float sampleRate)
+{
+  if (clockRate == _clockRate && sampleRate == _sampleRate)
+    return;
+
+  _clockRate = clockRate;
+  _sampleRate = sampleRate;
+  _factor = u64(std::llround(double(sampleRate) / clockRate * double(u64(1) << FRACTION_BITS)));
+}
+
+void BlipBuffer::clear()
+{
+  _offset = 0;
+  _used = 0;
+  _integrator = 0.0f;
+  _deltas.assign(1024 + KERNEL_WIDTH, 0.0f);
+}
+
+void BlipBuffer::grow(size_t size)
+{
+  if (_deltas.size() < size)
+    _deltas.resize(std::max(size, _deltas.size() * 2), 0.0f);
+}
+
+u32 BlipBuffer::clocksNeeded(size_t count) const
+{
+  const u64 target = u64(count) << FRACTION_BITS;
+  if (_offset >= target)
+    return 0;
+
+  return u32((target - _offset + _factor - 1) / _factor);
+}
+
+void BlipBuffer::addDelta(double time, float delta)
+{
+  const u64 position = _offset + u64(time * double(_factor));
+  const size_t index = size_t(position >> FRACTION_BITS);
+  const size_t phase = size_t(((position & FRACTION_MASK) * PHASES) >> FRACTION_BITS);
+
+  grow(index + KERNEL_WIDTH);
+  _used = std::max(_used, index + KERNEL_WIDTH);
+
+  const float* h = kernel()[phase].data();
+  float* out = &_deltas[index];
+
+#if SIMD_SSE2
+  const __m128 d = _mm_set1_ps(delta);
+  for (size_t k = 0; k < KERNEL_WIDTH; k += 4)
+    _mm_storeu_ps(out + k, _mm_add_ps(_mm_loadu_ps(out + k), _mm_mul_ps(d, _mm_loadu_ps(h + k))));
+#elif SIMD_NEON
+  for (size_t k = 0; k < KERNEL_WIDTH; k += 4)
+    vst1q_f32(out + k, vmlaq_n_f32(vld1q_f32(out + k), vld1q_f32(h + k), delta));
+#else
+  for (size_t k = 0; k < KERNEL_WIDTH; ++k)
+    out[k] += delta * h[k];
+#endif
+}
+
+void BlipBuffer::addRamp(double start, double end, float rise)
+{
+  const double scale = double(_factor) / double(u64(1) << FRACTION_BITS);
+  const double base = double(_offset) / double(u64(1) << FRACTION_BITS);
+  const double from = base + start * scale, to = base + end * scale;
+
+  if (to <= from)
+  {
+    addDelta(start, rise);
+    return;
+  }
+
+  /* the integrated ramp reaches rise * progress(m) at sample m + DELAY, same alignment as addDelta */
+  auto progress = [from, to](double m) { return std::clamp((m - from) / (to - from), 0.0, 1.0); };
+
+  const size_t first = size_t(from), last = size_t(std::ceil(to));
+  grow(last + DELAY + 1);
+  _used = std::max(_used, last + DELAY + 1);
+
+  for (size_t m = first; m <= last; ++m)
+    _deltas[m + DELAY] += rise * float(progress(double(m)) - progress(double(m) - 1.0));
+}
+
+void BlipBuffer::endFrame(u32 clocks)
+{
+  _offset += u64(clocks) * _factor;
+  grow(samplesAvailable() + KERNEL_WIDTH);
+}
+
+size_t BlipBuffer::read(float* out, size_t count)
+{
+  count = std::min(count, samplesAvailable());
+
+  /* nothing pending and nothing left to decay, eg. a silent channel */
+  if (!_used && _integrator == 0.0f)
+  {
+    std::fill(out, out + count, 0.0f);
+    _offset -= u64(count) << FRACTION_BITS;
+    return count;
+  }
+
+  float sum = _integrator;
+  for (size_t i = 0; i < count; ++i)
+  {
+    sum = sum * LEAK + _deltas[i];
+    out[i] = sum;
+  }
+  /* let the leak end in silence instead of denormals */
+  _integrator = std::abs(sum) < SILENCE ? 0.0f : sum;
+
+  /* shift the pending deltas (including the kernel tails) back to the start */
+  const size_t live = std::max(_used, count);
+  std::copy(_deltas.begin() + count, _deltas.begin() + live, _deltas.begin());
+  std::fill(_deltas.begin() + (live - count), _deltas.begin() + live, 0.0f);
+  _used = live - count;
+  _offset -= u64(count) << FRACTION_BITS;
+
+  return count;
+}
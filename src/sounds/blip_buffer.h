@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace sounds
+{
+  /*
+    band limited step synthesis: instead of ticking a generator at its clock and downsampling, the
+    generator only reports the amplitude changes (deltas) with their time in clocks, each delta is
+    spread over the host rate samples around it with a windowed sinc kernel tabulated for 64 sub-sample
+    phases, reading integrates the deltas back into a waveform. Work is proportional to the number of
+    edges and host samples, not to the generator clock.
+
+    Time is relative to the start of the current frame, endFrame(clocks) closes it and makes the samples
+    it covers readable. Output is delayed by half the kernel width.
+  */
+  class BlipBuffer
+  {
+  public:
+    static constexpr size_t KERNEL_WIDTH = 16;
+    static constexpr size_t PHASES = 64;
+
+  protected:
+    float _clockRate;
+    float _sampleRate;
+
+    /* 32.32 fixed point host samples per clock */
+    u64 _factor;
+    /* 32.32 fixed point position of the start of the current frame in _deltas */
+    u64 _offset;
+
+    std::vector<float> _deltas;
+    /* end of the region touched by deltas since the last read, everything after it is zero */
+    size_t _used;
+    float _integrator;
+
+    void grow(size_t size);
+
+  public:
+    BlipBuffer(float clockRate, float sampleRate);
+
+    void setRates(float clockRate, float sampleRate);
+    void clear();
+
+    float clocksPerSample() const { return _clockRate / _sampleRate; }
+
+    /* clocks the current frame must last so that count samples become readable */
+    u32 clocksNeeded(size_t count) const;
+    size_t samplesAvailable() const { return size_t(_offset >> 32); }
+
+    /* band limited step of delta at time (in clocks, fractional) from the start of the frame */
+    void addDelta(double time, float delta);
+    /* linear change of rise spread between start and end clocks, for the continuous part of a waveform */
+    void addRamp(double start, double end, float rise);
+
+    void endFrame(u32 clocks);
+    /* returns the number of samples produced, at most count */
+    size_t read(float* out, size_t count);
+  };
+}
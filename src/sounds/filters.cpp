@@ -0,0 +1,129 @@
+#include "filters.h"
+
+#include "base/simd.h"
+
+#include <cmath>
+
+using namespace sounds::filters;
+
+namespace
+{
+  constexpr double PI = 3.14159265358979323846;
+}
+
+Biquad::Biquad(Response response, float cutoff, float sampleRate, float q) :
+  _response(response), _cutoff(cutoff), _q(q), _sampleRate(sampleRate), _stale(true),
+  _b0(1.0f), _b1(0.0f), _b2(0.0f), _a1(0.0f), _a2(0.0f)
+{
+  reset();
+}
+
+void Biquad::reset()
+{
+  _z1[0] = _z1[1] = 0.0f;
+  _z2[0] = _z2[1] = 0.0f;
+}
+
+void Biquad::update()
+{
+  _stale = false;
+
+  if (_response == Response::DcBlock)
+  {
+    const double r = std::exp(-2.0 * PI * _cutoff / _sampleRate);
+    _b0 = 1.0f;
+    _b1 = -1.0f;
+    _b2 = 0.0f;
+    _a1 = float(-r);
+    _a2 = 0.0f;
+    return;
+  }
+
+  const double w0 = 2.0 * PI * _cutoff / _sampleRate;
+  const double cosw = std::cos(w0), alpha = std::sin(w0) / (2.0 * _q);
+  const double a0 = 1.0 + alpha;
+
+  /* both responses share the poles, the zeros sit at z = -1 (low pass) or z = 1 (high pass) */
+  const double b = _response == Response::LowPass ? (1.0 - cosw) / 2.0 : (1.0 + cosw) / 2.0;
+  _b0 = float(b / a0);
+  _b1 = float((_response == Response::LowPass ? 2.0 * b : -2.0 * b) / a0);
+  _b2 = _b0;
+  _a1 = float(-2.0 * cosw / a0);
+  _a2 = float((1.0 - alpha) / a0);
+}
+
+void Biquad::process(float* samples, size_t n)
+{
+  if (_stale)
+    update();
+
+  const float b0 = _b0, b1 = _b1, b2 = _b2, a1 = _a1, a2 = _a2;
+  float z1 = _z1[0], z2 = _z2[0];
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const float x = samples[i];
+    const float y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    samples[i] = y;
+  }
+
+  _z1[0] = z1;
+  _z2[0] = z2;
+}
+
+void Biquad::processStereo(float* samples, size_t frames)
+{
+  if (_stale)
+    update();
+
+#if SIMD_SSE2
+  /* left and right in the two low lanes, a frame is loaded and stored as one 64 bit value through
+     __m64, which may alias the floats unlike a double* */
+  const __m128 b0 = _mm_set1_ps(_b0), b1 = _mm_set1_ps(_b1), b2 = _mm_set1_ps(_b2), a1 = _mm_set1_ps(_a1), a2 = _mm_set1_ps(_a2);
+  __m128 z1 = _mm_setr_ps(_z1[0], _z1[1], 0.0f, 0.0f), z2 = _mm_setr_ps(_z2[0], _z2[1], 0.0f, 0.0f);
+
+  for (size_t i = 0; i < frames; ++i)
+  {
+    __m64* frame = reinterpret_cast<__m64*>(samples + i * 2);
+    const __m128 x = _mm_loadl_pi(_mm_setzero_ps(), frame);
+    const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+    z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+    z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+    _mm_storel_pi(frame, y);
+  }
+
+  alignas(16) float state[2][4];
+  _mm_store_ps(state[0], z1);
+  _mm_store_ps(state[1], z2);
+  _z1[0] = state[0][0]; _z1[1] = state[0][1];
+  _z2[0] = state[1][0]; _z2[1] = state[1][1];
+#elif SIMD_NEON
+  float32x2_t z1 = vld1_f32(_z1), z2 = vld1_f32(_z2);
+
+  for (size_t i = 0; i < frames; ++i)
+  {
+    const float32x2_t x = vld1_f32(samples + i * 2);
+    const float32x2_t y = vmla_n_f32(z1, x, _b0);
+    z1 = vmls_n_f32(vmla_n_f32(z2, x, _b1), y, _a1);
+    z2 = vmls_n_f32(vmul_n_f32(x, _b2), y, _a2);
+    vst1_f32(samples + i * 2, y);
+  }
+
+  vst1_f32(_z1, z1);
+  vst1_f32(_z2, z2);
+#else
+  for (size_t i = 0; i < frames; ++i)
+  {
+    for (size_t c = 0; c < 2; ++c)
+    {
+      const float x = samples[i * 2 + c];
+      const float y = _b0 * x + _z1[c];
+      _z1[c] = _b1 * x - _a1 * y + _z2[c];
+      _z2[c] = _b2 * x - _a2 * y;
+      samples[i * 2 + c] = y;
+    }
+  }
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace sounds
+{
+  namespace filters
+  {
+    enum class Response { LowPass, HighPass, DcBlock };
+
+    /*
+      second order IIR section in transposed direct form II, low and high pass are the RBJ cookbook
+      ones. DcBlock is the first order high pass of an output capacitor, y[n] = x[n] - x[n-1] + R y[n-1]
+      with R = exp(-2 pi cutoff / sampleRate).
+
+      Setting a parameter only marks the coefficients stale, the next process call computes them again.
+      process() runs a whole mono block with coefficients and state held in registers, processStereo()
+      runs interleaved pairs with the left and right channels in the lanes of one vector. Machines
+      mix to mono for now (the APU only uses process()), processStereo() and FilterChain are only
+      exercised by headless --bench filters until one has stereo output.
+    */
+    class Biquad
+    {
+    protected:
+      Response _response;
+      float _cutoff;
+      float _q;
+      float _sampleRate;
+      bool _stale;
+
+      /* normalized by a0 */
+      float _b0, _b1, _b2, _a1, _a2;
+      /* left and right state, mono blocks use the left one */
+      float _z1[2], _z2[2];
+
+      void update();
+
+    public:
+      Biquad(Response response, float cutoff, float sampleRate, float q = 0.70710678f);
+
+      void setCutoff(float cutoff) { _stale |= cutoff != _cutoff; _cutoff = cutoff; }
+      void setQ(float q) { _stale |= q != _q; _q = q; }
+      void setSampleRate(float sampleRate) { _stale |= sampleRate != _sampleRate; _sampleRate = sampleRate; }
+
+      float cutoff() const { return _cutoff; }
+
+      void reset();
+
+      /* in place */
+      void process(float* samples, size_t n);
+      void processStereo(float* samples, size_t frames);
+    };
+
+    /* stages run one after the other over the whole block, each with its own tight loop */
+    class FilterChain
+    {
+    protected:
+      std::vector<Biquad> _stages;
+
+    public:
+      /* the reference is only valid until the next add() */
+      Biquad& add(Response response, float cutoff, float sampleRate, float q = 0.70710678f)
+      {
+        _stages.emplace_back(response, cutoff, sampleRate, q);
+        return _stages.back();
+      }
+
+      Biquad& stage(size_t index) { return _stages[index]; }
+      size_t size() const { return _stages.size(); }
+
+      void setSampleRate(float sampleRate) { for (Biquad& stage : _stages) stage.setSampleRate(sampleRate); }
+      void reset() { for (Biquad& stage : _stages) stage.reset(); }
+
+      void process(float* samples, size_t n) { for (Biquad& stage : _stages) stage.process(samples, n); }
+      void processStereo(float* samples, size_t frames) { for (Biquad& stage : _stages) stage.processStereo(samples, frames); }
+    };
+  }
+}
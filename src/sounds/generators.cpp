@@ -0,0 +1,558 @@
+#include "generators.h"
+
+#include "base/simd.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <vector>
+
+using namespace sounds;
+
+namespace
+{
+  /*
+    each shape maps a phase in [0, 1) to a sample, with a scalar and (when available) a vector overload,
+    render() drives the phase accumulator and stores the block. The vector path keeps sixteen consecutive
+    phases in flight as four independent vectors advanced by 16 * increment, wrapping with a truncation
+    since phases are never negative. A single vector would wait on its own wrap every 4 samples.
+  */
+
+#if SIMD_SSE2
+  inline __m128 wrap(__m128 p) { return _mm_sub_ps(p, _mm_cvtepi32_ps(_mm_cvttps_epi32(p))); }
+#endif
+
+  template<typename Shape>
+  float render(float* out, size_t n, float phase, float increment, const Shape& shape)
+  {
+    size_t i = 0;
+
+#if SIMD_SSE2
+    if (n >= 16)
+    {
+      const __m128 inc = _mm_set1_ps(increment);
+      const __m128 step = _mm_set1_ps(16.0f * increment);
+      const __m128 base = _mm_add_ps(_mm_set1_ps(phase), _mm_mul_ps(inc, _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f)));
+
+      __m128 p0 = wrap(base);
+      __m128 p1 = wrap(_mm_add_ps(base, _mm_mul_ps(inc, _mm_set1_ps(4.0f))));
+      __m128 p2 = wrap(_mm_add_ps(base, _mm_mul_ps(inc, _mm_set1_ps(8.0f))));
+      __m128 p3 = wrap(_mm_add_ps(base, _mm_mul_ps(inc, _mm_set1_ps(12.0f))));
+
+      for (; i + 16 <= n; i += 16)
+      {
+        _mm_storeu_ps(out + i, shape(p0));
+        _mm_storeu_ps(out + i + 4, shape(p1));
+        _mm_storeu_ps(out + i + 8, shape(p2));
+        _mm_storeu_ps(out + i + 12, shape(p3));
+
+        phase = _mm_cvtss_f32(_mm_shuffle_ps(p3, p3, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        p0 = wrap(_mm_add_ps(p0, step));
+        p1 = wrap(_mm_add_ps(p1, step));
+        p2 = wrap(_mm_add_ps(p2, step));
+        p3 = wrap(_mm_add_ps(p3, step));
+      }
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+      phase += increment;
+      if (phase >= 1.0f)
+        phase -= 1.0f;
+
+      out[i] = shape(phase);
+    }
+
+    return phase;
+  }
+
+#if SIMD_SSE2
+  inline __m128 select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+  inline __m128 absolute(__m128 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+#endif
+
+  struct Pulse
+  {
+    float duty;
+
+    float operator()(float phase) const { return phase < duty ? 1.0f : -1.0f; }
+#if SIMD_SSE2
+    __m128 operator()(__m128 phase) const { return select(_mm_cmplt_ps(phase, _mm_set1_ps(duty)), _mm_set1_ps(1.0f), _mm_set1_ps(-1.0f)); }
+#endif
+  };
+
+  /* 2|p - 0.5| - 1, starts from 0 going down */
+  struct Triangle
+  {
+    float operator()(float phase) const { return 2.0f * std::abs(phase - 0.5f) - 1.0f; }
+#if SIMD_SSE2
+    __m128 operator()(__m128 phase) const
+    {
+      __m128 v = absolute(_mm_sub_ps(phase, _mm_set1_ps(0.5f)));
+      return _mm_sub_ps(_mm_add_ps(v, v), _mm_set1_ps(1.0f));
+    }
+#endif
+  };
+
+  /* 1 - 4|p - 0.5|, same as the two slopes of SimpleWaveGenerator */
+  struct SymmetricTriangle
+  {
+    float operator()(float phase) const { return (phase < 0.5f) ? (4.0f * phase - 1.0f) : (3.0f - 4.0f * phase); }
+#if SIMD_SSE2
+    __m128 operator()(__m128 phase) const
+    {
+      __m128 v = absolute(_mm_sub_ps(phase, _mm_set1_ps(0.5f)));
+      return _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(v, _mm_set1_ps(4.0f)));
+    }
+#endif
+  };
+
+  struct Sawtooth
+  {
+    float operator()(float phase) const { return 2.0f * phase - 1.0f; }
+#if SIMD_SSE2
+    __m128 operator()(__m128 phase) const { return _mm_sub_ps(_mm_add_ps(phase, phase), _mm_set1_ps(1.0f)); }
+#endif
+  };
+
+  /* reports the edges of a +amplitude/-amplitude pulse over clocks to the blip buffer, returns the final phase */
+  double pulseEdges(BlipBuffer& blip, u32 clocks, double phase, double increment, double duty, float amplitude, float& level)
+  {
+    const float current = phase < duty ? amplitude : -amplitude;
+    if (current != level)
+    {
+      blip.addDelta(0.0, current - level);
+      level = current;
+    }
+
+    double time = 0.0;
+
+    /* a pulse without edges (or a silent one) only needs its phase advanced */
+    if (duty > 0.0 && duty < 1.0 && increment > 0.0 && amplitude != 0.0f)
+    {
+      for (;;)
+      {
+        const double edge = phase < duty ? duty : 1.0;
+        const double until = time + (edge - phase) / increment;
+        if (until >= clocks)
+          break;
+
+        time = until;
+        phase = edge >= 1.0 ? 0.0 : edge;
+
+        const float next = phase < duty ? amplitude : -amplitude;
+        blip.addDelta(time, next - level);
+        level = next;
+      }
+    }
+
+    phase += (clocks - time) * increment;
+    return phase - std::floor(phase);
+  }
+
+  /* rising ramp from -amplitude to +amplitude with a band limited step back on each wrap */
+  double sawtoothEdges(BlipBuffer& blip, u32 clocks, double phase, double increment, float amplitude, float& level)
+  {
+    const float current = amplitude * float(2.0 * phase - 1.0);
+    if (current != level)
+      blip.addDelta(0.0, current - level);
+
+    blip.addRamp(0.0, clocks, float(2.0 * amplitude * increment * clocks));
+
+    double time = 0.0;
+    if (increment > 0.0)
+    {
+      for (;;)
+      {
+        const double until = time + (1.0 - phase) / increment;
+        if (until >= clocks)
+          break;
+
+        time = until;
+        phase = 0.0;
+        blip.addDelta(time, -2.0f * amplitude);
+      }
+    }
+
+    phase += (clocks - time) * increment;
+    phase -= std::floor(phase);
+    level = amplitude * float(2.0 * phase - 1.0);
+    return phase;
+  }
+
+  /* one bit per position of a periodic register sequence, see NoiseGenerator */
+  struct LfsrTable
+  {
+    u32 period = 0;
+    /* followed by a copy of the first PADDING bits so that reads starting before period can run past it */
+    std::vector<u64> bits;
+    /* register at each position and position of each register (by its low width bits), Game Boy tables only */
+    std::vector<u16> registers;
+    std::vector<u16> positions;
+
+    static constexpr u32 PADDING = 128;
+
+    void resize(u32 period)
+    {
+      this->period = period;
+      bits.assign((period + PADDING + 63) / 64, 0);
+    }
+
+    void set(u32 position) { bits[position >> 6] |= u64(1) << (position & 63); }
+    u32 bit(u32 position) const { return (bits[position >> 6] >> (position & 63)) & 1; }
+
+    void pad()
+    {
+      for (u32 i = 0; i < PADDING; ++i)
+        if (bit(i))
+          set(period + i);
+    }
+
+    /* 64 bits from position, the first one in bit 0 */
+    u64 window(u32 position) const
+    {
+      const u32 word = position >> 6, shift = position & 63;
+      return shift ? (bits[word] >> shift) | (bits[word + 1] << (64 - shift)) : bits[word];
+    }
+
+    /* set bits in [position, position + count), position < period */
+    u32 ones(u32 position, u32 count) const
+    {
+      u32 total = 0;
+
+      while (count)
+      {
+        const u32 word = position >> 6, shift = position & 63;
+        const u32 n = std::min({ 64 - shift, count, period + PADDING - position });
+
+        u64 value = bits[word] >> shift;
+        if (n < 64)
+          value &= (u64(1) << n) - 1;
+        total += u32(std::popcount(value));
+
+        count -= n;
+        position += n;
+        if (position >= period)
+          position -= period;
+      }
+
+      return total;
+    }
+  };
+
+  /* bits shifted in by the 23 bit register, starting with the 23 ones it starts from */
+  const LfsrTable& longTable()
+  {
+    static const LfsrTable table = []() {
+      LfsrTable table;
+      table.resize((1 << 23) - 1);
+
+      for (u32 i = 0; i < 23; ++i)
+        table.set(i);
+
+      /* the taps make each bit the xor of the bits 23 and 18 before it, which gives 16 bits at once */
+      for (u32 i = 23; i < table.period; i += 16)
+      {
+        const u64 bits = (table.window(i - 23) ^ table.window(i - 18)) & 0xFFFF;
+        table.bits[i >> 6] |= bits << (i & 63);
+        if ((i & 63) > 48)
+          table.bits[(i >> 6) + 1] |= bits >> (64 - (i & 63));
+      }
+
+      /* the last chunk ran past the period, drop what doesn't belong to the sequence before padding */
+      for (u32 i = table.period; i < table.period + 16; ++i)
+        table.bits[i >> 6] &= ~(u64(1) << (i & 63));
+
+      table.pad();
+      return table;
+    }();
+
+    return table;
+  }
+
+  /* bit 0 of the Game Boy register, which starts from 0x7FFF */
+  LfsrTable buildGameBoyTable(u32 width)
+  {
+    auto step = [width](u16 shift) {
+      const u16 bit = (shift ^ (shift >> 1)) & 1;
+      shift = u16((shift >> 1) | (bit << 14));
+      return width == 7 ? u16((shift & ~0x40) | (bit << 6)) : shift;
+    };
+
+    LfsrTable table;
+    table.resize(width == 7 ? 127 : 32767);
+    table.registers.resize(table.period);
+    table.positions.resize(size_t(1) << width);
+
+    /* the high bits of the 7 bit mode only settle after a few steps, the tabulated cycle is the second one */
+    u16 shift = 0x7FFF;
+    if (width == 7)
+      for (u32 i = 0; i < table.period; ++i)
+        shift = step(shift);
+
+    for (u32 i = 0; i < table.period; ++i)
+    {
+      table.registers[i] = shift;
+      table.positions[shift & ((1 << width) - 1)] = u16(i);
+      if (shift & 1)
+        table.set(i);
+
+      shift = step(shift);
+    }
+
+    table.pad();
+    return table;
+  }
+
+  const LfsrTable& gameBoyTable(u32 width)
+  {
+    static const LfsrTable tables[] = { buildGameBoyTable(7), buildGameBoyTable(15) };
+    return tables[width == 7 ? 0 : 1];
+  }
+
+  /* sample for each top byte of the 23 bit register, indexed by the table bits (oldest first, so reversed) */
+  constexpr std::array<float, 256> NOISE_LEVELS = []() {
+    std::array<float, 256> table{};
+    for (u32 i = 0; i < 256; ++i)
+    {
+      u32 value = 0;
+      for (u32 b = 0; b < 8; ++b)
+        if (i & (1 << b))
+          value |= 0x80 >> b;
+      table[i] = (value / 2.0f) - 1.0f;
+    }
+    return table;
+  }();
+}
+
+void SquareWaveGenerator::generate(float* out, size_t n)
+{
+  _phase = render(out, n, _phase, increment(), Pulse{ _duty });
+}
+
+void TriangleWaveGenerator::generate(float* out, size_t n)
+{
+  _phase = render(out, n, _phase, increment(), Triangle());
+}
+
+void SimpleWaveGenerator::generate(float* out, size_t n)
+{
+  const float inc = increment();
+
+  switch (_type)
+  {
+    case Waveform::Square: _phase = render(out, n, _phase, inc, Pulse{ 0.5f }); break;
+    case Waveform::Sawtooth: _phase = render(out, n, _phase, inc, Sawtooth()); break;
+    case Waveform::Triangle: _phase = render(out, n, _phase, inc, SymmetricTriangle()); break;
+    case Waveform::Sine:
+    {
+      /* no vector sin available, still saves the per sample switch and divide */
+      float phase = _phase;
+      for (size_t i = 0; i < n; ++i)
+      {
+        phase += inc;
+        if (phase >= 1.0f)
+          phase -= 1.0f;
+        out[i] = std::sin(2.0f * float(M_PI) * phase);
+      }
+      _phase = phase;
+      break;
+    }
+  }
+}
+
+void SquareWaveGenerator::synthesize(BlipBuffer& blip, u32 clocks)
+{
+  _phase = float(pulseEdges(blip, clocks, _phase, increment(), _duty, _amplitude, _level));
+}
+
+void SimpleWaveGenerator::synthesize(BlipBuffer& blip, u32 clocks)
+{
+  const double inc = increment();
+
+  switch (_type)
+  {
+    case Waveform::Square: _phase = float(pulseEdges(blip, clocks, _phase, inc, 0.5, _amplitude, _level)); break;
+    case Waveform::Sawtooth: _phase = float(sawtoothEdges(blip, clocks, _phase, inc, _amplitude, _level)); break;
+    case Waveform::Triangle:
+    case Waveform::Sine:
+    {
+      /* no discontinuities to place, the shape is sampled at the host rate and reported as steps */
+      const double step = blip.clocksPerSample();
+
+      for (double time = 0.0; time < clocks; time += step)
+      {
+        double phase = _phase + time * inc;
+        phase -= std::floor(phase);
+
+        const float value = _amplitude * (_type == Waveform::Sine ?
+          std::sin(2.0f * float(M_PI) * float(phase)) :
+          float(phase < 0.5 ? (4.0 * phase - 1.0) : (3.0 - 4.0 * phase)));
+
+        blip.addDelta(time, value - _level);
+        _level = value;
+      }
+
+      const double phase = _phase + clocks * inc;
+      _phase = float(phase - std::floor(phase));
+      break;
+    }
+  }
+}
+
+float NoiseGenerator::next()
+{
+  const LfsrTable& table = longTable();
+
+  if (++_position == table.period)
+    _position = 0;
+
+  return NOISE_LEVELS[table.window(_position) & 0xFF];
+}
+
+void NoiseGenerator::generate(float* out, size_t n)
+{
+  const LfsrTable& table = longTable();
+  u32 position = _position;
+
+  /*
+    after t steps the top 8 bits are the 8 table bits from t, so a single 64 bit load from the table
+    serves the next 56 samples, each one a shift and a lookup independent of the others
+  */
+  for (size_t i = 0; i < n; )
+  {
+    const u32 start = position + 1 == table.period ? 0 : position + 1;
+    const size_t count = std::min<size_t>({ n - i, 56, table.period - start });
+
+    const u64 bits = table.window(start);
+
+    for (size_t j = 0; j < count; ++j)
+      out[i + j] = NOISE_LEVELS[(bits >> j) & 0xFF];
+
+    i += count;
+    position = u32(start + count - 1);
+  }
+
+  _position = position;
+}
+
+void NoiseGenerator::setWidth(u32 width)
+{
+  if (width == _width)
+    return;
+
+  const u16 shift = gameBoyTable(_width).registers[_shiftPosition];
+  _width = width;
+  _shiftPosition = gameBoyTable(width).positions[shift & ((1 << width) - 1)];
+}
+
+void NoiseGenerator::synthesize(BlipBuffer& blip, u32 clocks)
+{
+  const LfsrTable& table = gameBoyTable(_width);
+  const double inc = increment();
+
+  const float current = table.bit(_shiftPosition) ? -_amplitude : _amplitude;
+  if (current != _level)
+  {
+    blip.addDelta(0.0, current - _level);
+    _level = current;
+  }
+
+  if (inc <= 0.0)
+    return;
+
+  /* the register shifts each time the phase wraps, from first on every period clocks */
+  const double period = 1.0 / inc;
+  const double first = (1.0 - _phase) * period;
+  auto stepsBefore = [first, period](double time) { return time > first ? u64(std::ceil((time - first) / period)) : u64(0); };
+
+  const u64 steps = stepsBefore(clocks);
+  u32 position = _shiftPosition;
+
+  if (_amplitude != 0.0f && period >= blip.clocksPerSample())
+  {
+    for (double time = first; time < clocks; time += period)
+    {
+      if (++position == table.period)
+        position = 0;
+
+      const float next = table.bit(position) ? -_amplitude : _amplitude;
+      if (next != _level)
+      {
+        blip.addDelta(time, next - _level);
+        _level = next;
+      }
+    }
+  }
+  else if (_amplitude != 0.0f)
+  {
+    /* several shifts per host sample: each sample gets the average of the bits it covers */
+    const double sample = blip.clocksPerSample();
+    u64 done = 0;
+
+    for (double time = 0.0; time < clocks; time += sample)
+    {
+      const u64 until = stepsBefore(std::min(time + sample, double(clocks)));
+      const u32 count = u32(until - done);
+      if (!count)
+        continue;
+
+      const u32 ones = table.ones(position + 1 == table.period ? 0 : position + 1, count);
+      position = u32((position + count) % table.period);
+      done = until;
+
+      const float next = _amplitude * float(int(count) - 2 * int(ones)) / float(count);
+      if (next != _level)
+      {
+        blip.addDelta(time, next - _level);
+        _level = next;
+      }
+    }
+  }
+
+  /* counted rather than taken from the loops so that it can't drift from the phase, and a silent register keeps running too */
+  _shiftPosition = u32((_shiftPosition + steps) % table.period);
+
+  const double phase = _phase + clocks * inc;
+  _phase = float(phase - std::floor(phase));
+}
+
+void TableWaveGenerator::synthesize(BlipBuffer& blip, u32 clocks)
+{
+  const double inc = increment();
+  const size_t size = _table.size();
+
+  size_t index = std::min(size_t(double(_phase) * size), size - 1);
+  const float current = _amplitude * _table[index];
+  if (current != _level)
+  {
+    blip.addDelta(0.0, current - _level);
+    _level = current;
+  }
+
+  if (inc <= 0.0 || _amplitude == 0.0f)
+  {
+    const double phase = _phase + clocks * inc;
+    _phase = float(phase - std::floor(phase));
+    return;
+  }
+
+  /* one entry of the table lasts 1 / (size * inc) clocks */
+  const double step = 1.0 / (size * inc);
+  for (double time = ((index + 1) / double(size) - _phase) / inc; time < clocks; time += step)
+  {
+    index = index + 1 == size ? 0 : index + 1;
+
+    const float next = _amplitude * _table[index];
+    if (next != _level)
+    {
+      blip.addDelta(time, next - _level);
+      _level = next;
+    }
+  }
+
+  const double phase = _phase + clocks * inc;
+  _phase = float(phase - std::floor(phase));
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "common.h"
+#include "blip_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace sounds
+{
+  struct WaveGenerator
+  {
+  protected:
+    float _frequency;
+    float _clock;
+    float _phase;
+    /* amplitude last reported to a BlipBuffer by synthesize() */
+    float _level;
+    /* peak of the waveform reported by synthesize(), a change shows up as a step at the start of the next call */
+    float _amplitude;
+
+    /* phase advance per clock cycle */
+    float increment() const { return _frequency / _clock; }
+
+  public:
+    WaveGenerator(float frequency = 440.0_hz, float clock = 1.0_mhz) : _frequency(frequency), _clock(clock), _phase(0.0f), _level(0.0f), _amplitude(1.0f) { }
+    float clock() const { return _clock; }
+
+    void frequency(float frequency) { _frequency = frequency; }
+    void setAmplitude(float amplitude) { _amplitude = amplitude; }
+    void resetPhase() { _phase = 0.0f; }
+  };
+
+  /*
+    next() produces a single sample per clock cycle, generate() produces a block of n samples with
+    the same output (up to rounding) with the waveform selection and the phase increment hoisted out
+    of the loop and the phase accumulator vectorized.
+
+    synthesize() advances the generator by a number of clocks but only reports the edges of the
+    waveform to a BlipBuffer, which produces band limited output directly at the host rate.
+  */
+
+  struct SquareWaveGenerator : public WaveGenerator
+  {
+  protected:
+    float _duty;
+
+  public:
+    SquareWaveGenerator(float frequency = 440.0f, float clock = 1.0_mhz) : WaveGenerator(frequency, clock), _duty(0.5f) { }
+
+    void setDuty(float duty) { _duty = std::clamp(duty, 0.0f, 1.0f); }
+
+    float next()
+    {
+      /* increment by a clock cycle */
+      _phase += _frequency / _clock;
+      if (_phase >= 1.0f)
+        _phase -= 1.0f;
+
+      return _phase < _duty ? 1.0f : -1.0f; // Return high or low based on phase
+    }
+
+    void generate(float* out, size_t n);
+    void synthesize(BlipBuffer& blip, u32 clocks);
+  };
+
+  struct TriangleWaveGenerator : public WaveGenerator
+  {
+  public:
+    TriangleWaveGenerator(float frequency = 440.0f) : WaveGenerator(frequency) { }
+
+    float next()
+    {
+      /* increment by a clock cycle */
+      _phase += _frequency / _clock;
+      if (_phase >= 1.0f)
+        _phase -= 1.0f;
+
+      return 2.0f * std::abs(_phase - 0.5f) - 1.0f; // Return triangle wave value
+    }
+
+    void generate(float* out, size_t n);
+  };
+
+  enum class Waveform { Square, Triangle, Sawtooth, Sine };
+
+  class SimpleWaveGenerator : public WaveGenerator
+  {
+    Waveform _type;
+
+  public:
+    SimpleWaveGenerator(Waveform type, float frequency, float clock = 1.0_mhz)
+      : WaveGenerator(frequency, clock), _type(type) { }
+
+    void waveform(Waveform type) { _type = type; }
+
+    float next()
+    {
+      _phase += _frequency / _clock;
+      if (_phase >= 1.0f) _phase -= 1.0f;
+
+      switch (_type)
+      {
+        case Waveform::Square: return (_phase < 0.5f) ? 1.0f : -1.0f;
+        case Waveform::Sawtooth: return 2.0f * _phase - 1.0f;
+        case Waveform::Triangle: return (_phase < 0.5f) ? (4.0f * _phase - 1.0f) : (3.0f - 4.0f * _phase);
+        case Waveform::Sine: return std::sin(2.0f * float(M_PI) * _phase);
+      }
+
+      return 0.0f;
+    }
+
+    void generate(float* out, size_t n);
+    /* square and sawtooth are exact edges, triangle and sine are sampled once per host sample */
+    void synthesize(BlipBuffer& blip, u32 clocks);
+  };
+
+  /*
+    plays a table of samples, frequency() is the rate of whole passes over the table. synthesize()
+    reports a step wherever two consecutive samples differ, so the table is held between them like
+    a DAC would.
+  */
+  struct TableWaveGenerator : public WaveGenerator
+  {
+  protected:
+    std::vector<float> _table;
+
+  public:
+    TableWaveGenerator(size_t size, float clock = 1.0_mhz) : WaveGenerator(0.0f, clock), _table(size, 0.0f) { }
+
+    size_t size() const { return _table.size(); }
+    void set(size_t index, float value) { _table[index] = value; }
+
+    void synthesize(BlipBuffer& blip, u32 clocks);
+  };
+
+  /*
+    shift register noise. Both registers below are maximal length, so their output is a fixed periodic
+    sequence: it is tabulated once per mode (lazily, the 23 bit one takes 1MB) and the generator only
+    keeps its position in it. A block is then walks and popcounts over the table instead of a serial
+    shift and xor per clock.
+  */
+  struct NoiseGenerator : public WaveGenerator
+  {
+  protected:
+    /* steps of the 23 bit register since it was all ones */
+    u32 _position = 0;
+
+    /* same for the register used by synthesize(), in the table of _width */
+    u32 _shiftPosition = 0;
+    u32 _width = 15;
+
+  public:
+    NoiseGenerator(float clock = 1.0_mhz) : WaveGenerator(0.0f, clock) { }
+
+    /* 15 or 7, a short register repeats every 127 steps and sounds metallic. The register keeps its value */
+    void setWidth(u32 width);
+    void restart() { _shiftPosition = 0; }
+
+    /* 23 bit register with taps at bits 22 and 17, one step per clock, outputs its top 8 bits */
+    float next();
+    void generate(float* out, size_t n);
+
+    /*
+      Game Boy style noise: the register shifts right at frequency(), feeding back the xor of its two
+      low bits, and the output is +amplitude while bit 0 is clear, -amplitude otherwise. Shifts slower
+      than the host rate are reported as exact edges, faster ones as the average of the bits of each
+      host sample.
+    */
+    void synthesize(BlipBuffer& blip, u32 clocks);
+  };
+}
@@ -0,0 +1,177 @@
+#include "resampler.h"
+
+#include "base/simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace sounds;
+
+namespace
+{
+  constexpr double PI = 3.14159265358979323846;
+
+  /* fixed point position, 32 bits of fraction are way below the precision of any rate we deal with */
+  constexpr u32 FRACTION_BITS = 32;
+  constexpr u64 FRACTION_MASK = (u64(1) << FRACTION_BITS) - 1;
+
+  /* n is always a multiple of 8 */
+  float dot(const float* x, const float* h, size_t n)
+  {
+#if SIMD_SSE2
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (size_t i = 0; i < n; i += 8)
+    {
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+    }
+
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(acc);
+#elif SIMD_NEON
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < n; i += 8)
+    {
+      acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(h + i));
+      acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+    }
+
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < n; i += 4)
+      for (size_t j = 0; j < 4; ++j)
+        acc[j] += x[i + j] * h[i + j];
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+  }
+}
+
+Resampler::Resampler(float inputRate, float outputRate, size_t zeroCrossings, size_t phases) :
+  _inputRate(inputRate), _outputRate(outputRate), _zeroCrossings(zeroCrossings), _phases(phases), _taps(0)
+{
+  assert(zeroCrossings > 0 && phases > 0);
+  buildKernel();
+  reset();
+}
+
+void Resampler::buildKernel()
+{
+  /* cutoff in cycles per input sample, a bit below Nyquist of the slower side to leave room for the transition band */
+  const double cutoff = 0.5 * std::min(1.0, double(_outputRate) / _inputRate) * 0.9;
+
+  /* the sinc crosses zero every 1 / (2 * cutoff) input samples */
+  _taps = size_t(std::ceil(_zeroCrossings / cutoff));
+  _taps = (_taps + 7) & ~size_t(7);
+
+  const double half = _taps / 2.0;
+
+  _kernel.assign(_phases * _taps, 0.0f);
+
+  for (size_t p = 0; p < _phases; ++p)
+  {
+    const double fraction = double(p) / _phases;
+    float* row = &_kernel[p * _taps];
+    double sum = 0.0;
+
+    /* row[k] weights the input sample which is (_taps - 1 - k) samples before the output position */
+    for (size_t k = 0; k < _taps; ++k)
+    {
+      const double x = fraction + double(_taps - 1 - k) - half;
+
+      if (std::abs(x) >= half)
+        continue;
+
+      const double arg = 2.0 * cutoff * x;
+      const double sinc = arg == 0.0 ? 1.0 : std::sin(PI * arg) / (PI * arg);
+      const double window = 0.42 + 0.5 * std::cos(PI * x / half) + 0.08 * std::cos(2.0 * PI * x / half);
+      const double value = 2.0 * cutoff * sinc * window;
+
+      row[k] = float(value);
+      sum += value;
+    }
+
+    /* unity gain at DC for every phase, otherwise the phase switching would show up as ripple */
+    for (size_t k = 0; k < _taps; ++k)
+      row[k] = float(row[k] / sum);
+  }
+
+  _step = u64(std::llround(double(_inputRate) / _outputRate * double(u64(1) << FRACTION_BITS)));
+}
+
+void Resampler::setRates(float inputRate, float outputRate)
+{
+  if (inputRate == _inputRate && outputRate == _outputRate)
+    return;
+
+  const size_t previousTaps = _taps;
+
+  _inputRate = inputRate;
+  _outputRate = outputRate;
+  buildKernel();
+
+  /* keep the newest history, the kernel length may have changed */
+  if (_taps > previousTaps)
+  {
+    _input.insert(_input.begin(), _taps - previousTaps, 0.0f);
+    _position += u64(_taps - previousTaps) << FRACTION_BITS;
+  }
+  else if (_taps < previousTaps)
+  {
+    _input.erase(_input.begin(), _input.begin() + (previousTaps - _taps));
+    _position -= u64(previousTaps - _taps) << FRACTION_BITS;
+  }
+}
+
+void Resampler::reset()
+{
+  _input.assign(_taps - 1, 0.0f);
+  _position = u64(_taps - 1) << FRACTION_BITS;
+}
+
+size_t Resampler::required(size_t count) const
+{
+  if (count == 0)
+    return 0;
+
+  const size_t last = size_t((_position + (count - 1) * _step) >> FRACTION_BITS);
+  return last < _input.size() ? 0 : last + 1 - _input.size();
+}
+
+void Resampler::write(const float* in, size_t count)
+{
+  _input.insert(_input.end(), in, in + count);
+}
+
+size_t Resampler::read(float* out, size_t count)
+{
+  const size_t available = _input.size();
+  size_t produced = 0;
+
+  while (produced < count)
+  {
+    const size_t index = size_t(_position >> FRACTION_BITS);
+    if (index >= available)
+      break;
+
+    const size_t phase = size_t(((_position & FRACTION_MASK) * _phases) >> FRACTION_BITS);
+    out[produced++] = dot(&_input[index + 1 - _taps], &_kernel[phase * _taps], _taps);
+    _position += _step;
+  }
+
+  /* drop whatever is older than the window of the next output */
+  const size_t consumed = size_t(_position >> FRACTION_BITS) + 1 - _taps;
+  if (consumed > 0)
+  {
+    const size_t dropped = std::min(consumed, available);
+    _input.erase(_input.begin(), _input.begin() + dropped);
+    _position -= u64(dropped) << FRACTION_BITS;
+  }
+
+  return produced;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace sounds
+{
+  /*
+    polyphase windowed sinc resampler, meant to bring the generator clock (~1MHz) down to the host rate.
+    The low pass kernel (cutoff just below the output Nyquist, Blackman window) is tabulated for a fixed
+    number of sub-sample phases so that each output sample is a single dot product between the input
+    history and the row of the closest phase.
+
+    Input is pushed with write(), required(n) tells how much input is needed to produce n outputs,
+    read() produces as many outputs as the buffered input allows. The output is delayed by half the
+    kernel length.
+  */
+  class Resampler
+  {
+  protected:
+    float _inputRate;
+    float _outputRate;
+    size_t _zeroCrossings;
+    size_t _phases;
+
+    /* kernel length in input samples, multiple of 8 */
+    size_t _taps;
+    /* _phases rows of _taps coefficients */
+    std::vector<float> _kernel;
+
+    /* input history, always keeps the _taps - 1 samples preceding the next output */
+    std::vector<float> _input;
+    /* 32.32 fixed point position of the next output sample in _input, step is input samples per output sample */
+    u64 _position;
+    u64 _step;
+
+    void buildKernel();
+
+  public:
+    Resampler(float inputRate, float outputRate, size_t zeroCrossings = 8, size_t phases = 64);
+
+    /* rebuilds the kernel, history is kept */
+    void setRates(float inputRate, float outputRate);
+    void reset();
+
+    float inputRate() const { return _inputRate; }
+    float outputRate() const { return _outputRate; }
+    size_t taps() const { return _taps; }
+
+    /* input samples still missing to produce count output samples */
+    size_t required(size_t count) const;
+
+    void write(const float* in, size_t count);
+    /* returns the number of samples produced, at most count */
+    size_t read(float* out, size_t count);
+  };
+}
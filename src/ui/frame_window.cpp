@@ -5,14 +5,11 @@
 
 #include "SDL.h"
 
-extern SDL_Renderer* renderer;
+#include <cstring>
 
-void gfx::FrameBuffer::fill(Pixel color)
-{
-  std::fill(_data.begin(), _data.end(), color);
-}
+extern SDL_Renderer* renderer;
 
-gfx::Texture::Texture(int width, int height) : _opaque(nullptr), _width(width), _height(height)
+gfx::Texture::Texture(int width, int height) : _width(width), _height(height), _opaque(nullptr), _sequence(0), _uploadedRows(0)
 {
   _opaque = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
 }
@@ -23,22 +20,75 @@ gfx::Texture::~Texture()
     SDL_DestroyTexture(static_cast<SDL_Texture*>(_opaque));
 }
 
-void gfx::Texture::update(void* data)
+void gfx::Texture::update(const void* data)
 {
   if (_opaque)
     SDL_UpdateTexture(static_cast<SDL_Texture*>(_opaque), nullptr, data, _width * sizeof(gfx::Pixel));
+
+  _sequence = 0;
+  _uploadedRows = _height;
+}
+
+void gfx::Texture::stream(const FrameBuffer& frame, bool dirtyOnly)
+{
+  if (!_opaque || frame.width() != _width || frame.height() != _height)
+    return;
+
+  SDL_Texture* texture = static_cast<SDL_Texture*>(_opaque);
+  /* skipped frames may have changed rows that aren't dirty in this one */
+  const bool incremental = dirtyOnly && _sequence != 0 && frame.sequence() == _sequence + 1;
+  const size_t rowBytes = _width * sizeof(gfx::Pixel);
+
+  _uploadedRows = 0;
+
+  for (int y = 0; y < _height; )
+  {
+    if (incremental && !frame.dirty(y))
+    {
+      ++y;
+      continue;
+    }
+
+    /* lock each run of consecutive dirty rows once */
+    int end = y + 1;
+    while (end < _height && (!incremental || frame.dirty(end)))
+      ++end;
+
+    SDL_Rect rect = { 0, y, _width, end - y };
+    void* pixels;
+    int pitch;
+
+    if (SDL_LockTexture(texture, &rect, &pixels, &pitch) == 0)
+    {
+      uint8_t* dest = static_cast<uint8_t*>(pixels);
+      for (int row = y; row < end; ++row, dest += pitch)
+        std::memcpy(dest, frame.row(row), rowBytes);
+
+      SDL_UnlockTexture(texture);
+      _uploadedRows += end - y;
+    }
+
+    y = end;
+  }
+
+  _sequence = frame.sequence();
 }
 
 using namespace ui;
 
 void FrameWindow::doRender()
 {
-  if (_autoupdate)
-    update();
-  
+  update();
+
+  ImGui::Checkbox("Dirty rows only", &_dirtyOnly);
+  ImGui::SameLine();
+  ImGui::Text("upload %.3f ms, %d rows", _uploadTime, _texture.uploadedRows());
+
+  const float width = float(_frames.front().width()), height = float(_frames.front().height());
+
   ImVec2 avail = ImGui::GetContentRegionAvail();
-  float scale = std::min(avail.x / 256, avail.y / 256);
-  ImVec2 size = ImVec2(256 * scale, 256 * scale);
+  float scale = std::min(avail.x / width, avail.y / height);
+  ImVec2 size = ImVec2(width * scale, height * scale);
 
   // Per centrare:
   ImVec2 cursor = ImGui::GetCursorPos();
@@ -50,32 +100,12 @@ void FrameWindow::doRender()
 
 void FrameWindow::update()
 {
-  _frameBuffer->fill(gfx::Pixel(0, 0, 0, 255));
-  
-  struct Star { int x; int y; int layer; };
-  static std::vector<Star> stars;
-  if (stars.empty())
-  {
-    for (size_t i = 0; i < 100; ++i)
-    {
-      stars.push_back({ rand() % _frameBuffer->width(), rand() % _frameBuffer->height(), rand() % 3 });
-    }
-  }
-  
-  /* update stars */
-  for (auto& star : stars)
-  {
-    star.x -= star.layer + 1;
-    if (star.x < 0)
-    {
-      star.x = _frameBuffer->width() - 1;
-      star.y = rand() % _frameBuffer->height();
-    }
-  }
-  
-  /* draw stars */
-  for (const auto& star : stars)
-    _frameBuffer->set(star.x, star.y, gfx::Pixel(255 - star.layer * 80, 255 - star.layer * 80, 255 - star.layer * 80, 255));
-  
-  _texture.update(_frameBuffer->data());
+  if (!_frames.acquire())
+    return;
+
+  const Uint64 start = SDL_GetPerformanceCounter();
+  _texture.stream(_frames.front(), _dirtyOnly);
+  const float elapsed = float(double(SDL_GetPerformanceCounter() - start) * 1000.0 / double(SDL_GetPerformanceFrequency()));
+
+  _uploadTime += (elapsed - _uploadTime) * 0.05f;
 }
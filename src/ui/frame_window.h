@@ -1,73 +1,64 @@
 #pragma once
 
 #include "window.h"
+#include "base/triple_buffer.h"
+#include "gfx/frame_buffer.h"
+
+#include <cstdint>
 
 namespace gfx
 {
-  union Pixel
-  {
-    uint32_t value;
-    struct { uint8_t a, b, g, r; };
-
-    Pixel(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0, uint8_t alpha = 255)
-      : r(red), g(green), b(blue), a(alpha) {}
-  };
-
-  struct FrameBuffer
-  {
-  protected:
-    int _width;
-    int _height;
-    std::vector<Pixel> _data;
-
-  public:
-    FrameBuffer(int width, int height)
-      : _width(width), _height(height), _data(width * height) {}
-
-    Pixel& pixel(int x, int y) { return _data[y * _width + x]; }
-    const Pixel& pixel(int x, int y) const { return _data[y * _width + x]; }
-
-    int width() const { return _width; }
-    int height() const { return _height; }
-    Pixel* data() { return _data.data(); }
-
-    void fill(Pixel color);
-    void set(int x, int y, Pixel color) { pixel(x, y) = color; }
-  };
-
   struct Texture
   {
   protected:
     int _width, _height;
     void* _opaque;
 
+    /* sequence of the last frame streamed, 0 if the content is unknown */
+    uint64_t _sequence;
+    int _uploadedRows;
+
   public:
     Texture(int width, int height);
     Texture(const Texture&) = delete;
     ~Texture();
 
-    void update(void* data);
+    /* copies a whole width * height image */
+    void update(const void* data);
+    /*
+      copies frame rows straight into the locked texture memory, if the texture holds the frame right
+      before this one only the dirty runs of rows are locked and written
+    */
+    void stream(const FrameBuffer& frame, bool dirtyOnly = true);
+
+    int uploadedRows() const { return _uploadedRows; }
     void* opaque() const { return _opaque; }
   };
 }
 
 namespace ui
 {
+  /* shows the frames produced by another thread, the texture is updated only when a new one is published */
   class FrameWindow : public Window
   {
+  public:
+    using Frames = structures::TripleBuffer<gfx::FrameBuffer>;
+
   protected:
-    std::unique_ptr<gfx::FrameBuffer> _frameBuffer;
+    Frames& _frames;
     gfx::Texture _texture;
-    bool _autoupdate;
+
+    bool _dirtyOnly;
+    /* moving average of the upload cost in ms */
+    float _uploadTime;
 
     void doRender() override;
 
   public:
-    FrameWindow(std::string_view title, int width, int height)
-      : Window(title), _frameBuffer(std::make_unique<gfx::FrameBuffer>(width, height)), _texture(width, height), _autoupdate(true) {}
+    FrameWindow(std::string_view title, Frames& frames)
+      : Window(title), _frames(frames), _texture(frames.front().width(), frames.front().height()), _dirtyOnly(true), _uploadTime(0.0f) {}
 
-    gfx::FrameBuffer* frameBuffer() { return _frameBuffer.get(); }
-    const gfx::FrameBuffer* frameBuffer() const { return _frameBuffer.get(); }
+    const gfx::FrameBuffer& frameBuffer() const { return _frames.front(); }
 
     void update();
   };